@@ -82,6 +82,16 @@ if(KLFENGINE_USE_GULRAK_FILESYSTEM)
   )
 endif()
 
+#
+# value::dict type
+#
+if(KLFENGINE_USE_FLAT_DICT)
+  set(_klfengine_interface_tgt_prop_compile_options
+    ${_klfengine_interface_tgt_prop_compile_options}
+    "-DKLFENGINE_USE_FLAT_DICT"
+  )
+endif()
+
 #
 # ghostscript (headers)
 #
@@ -94,6 +94,17 @@ else()
     "${_klfengine_msg}Will use C++17's std::filesystem (KLFENGINE_USE_GULRAK_FILESYSTEM)")
 endif()
 
+#
+# value::dict type
+#
+if(KLFENGINE_USE_FLAT_DICT)
+  message(STATUS
+    "${_klfengine_msg}Will store value::dict entries in a sorted vector (KLFENGINE_USE_FLAT_DICT)")
+else()
+  message(STATUS
+    "${_klfengine_msg}Will use std::map for value::dict (KLFENGINE_USE_FLAT_DICT)")
+endif()
+
 #
 # ghostscript headers (set GHOSTSCRIPT_ROOT_DIR as hint)
 #
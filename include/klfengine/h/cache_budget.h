@@ -0,0 +1,179 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include <klfengine/basedefs>
+
+
+namespace klfengine {
+
+namespace detail {
+
+/** \internal
+ *
+ * How a cache entry can be obtained again once it was evicted, in the order in
+ * which entries are evicted by \ref cache_budget.
+ */
+enum class cache_entry_kind {
+  /** Loaded from a file that remains in the run's temporary directory */
+  from_file = 0,
+  /** Produced on request, can be produced again */
+  produced,
+  /** Cannot be obtained again, or a reference to it was handed out */
+  pinned
+};
+
+/** \internal
+ *
+ * Interface through which \ref cache_budget evicts entries from a cache (see
+ * \ref engine_run_implementation).  Both methods lock the cache's own mutex,
+ * so a cache must not call into the budget while holding it.
+ */
+class evictable_cache
+{
+public:
+  virtual ~evictable_cache() = default;
+
+  /** Last-use tick of the least recently used entry of the given kind, or the
+   *  maximum value if there is no such entry */
+  virtual std::uint64_t oldest_entry_tick(cache_entry_kind kind) = 0;
+
+  /** Evict the least recently used entry of the given kind, return the number
+   *  of bytes freed */
+  virtual std::size_t evict_oldest_entry(cache_entry_kind kind) = 0;
+};
+
+} // namespace detail
+
+
+
+/** \brief Process-wide accounting of the data held in the caches of all runs
+ *
+ * Every run keeps the data of the formats that were produced, including
+ * intermediate formats (LATEX, DVI, PS, raw PDF), for as long as it lives.
+ * The cache_budget keeps track of the total number of bytes held by the
+ * caches of all runs, see \ref bytes_held().
+ *
+ * If a budget is set with \ref set_max_bytes(), cache entries are evicted
+ * whenever the total exceeds the budget:
+ *
+ * - First, intermediate formats that the engine can load again from files in
+ *   the run's temporary directory;
+ *
+ * - Then, formats that can be produced again on request (e.g., by running
+ *   Ghostscript).
+ *
+ * Within each group, the least recently used entries are evicted first.
+ * Evicted entries are transparently loaded or produced again when they are
+ * requested.  Entries to which a reference was handed out by \ref
+ * run::get_data_cref(), as well as those the engine can't obtain again, are
+ * never evicted.  Data returned by \ref run::get_data_shared() remains valid
+ * even if the corresponding entry is evicted, but it no longer counts towards
+ * \ref bytes_held().
+ *
+ * This class is thread-safe.
+ */
+class cache_budget
+{
+public:
+  /** \brief The instance that accounts for all runs of this process
+   *
+   * This instance is never destroyed, so that runs may be destroyed during
+   * static destruction.
+   */
+  static cache_budget & instance();
+
+  /** \brief Set the maximum number of bytes held in run caches
+   *
+   * A value of zero (the default) means that there is no limit.  If the caches
+   * currently hold more than \a max_bytes bytes, entries are evicted right
+   * away.
+   */
+  void set_max_bytes(std::size_t max_bytes);
+
+  /** \brief The maximum number of bytes held in run caches (0 = no limit) */
+  std::size_t max_bytes() const { return _max_bytes.load(); }
+
+  /** \brief The number of bytes currently held in the caches of all runs */
+  std::size_t bytes_held() const { return _bytes_held.load(); }
+
+  /** \brief The total number of bytes evicted so far */
+  std::size_t bytes_evicted() const { return _bytes_evicted.load(); }
+
+  /** \brief The total number of cache entries evicted so far */
+  std::size_t num_evictions() const { return _num_evictions.load(); }
+
+
+  // interface for engine_run_implementation
+
+  /** \internal */
+  void register_cache(detail::evictable_cache * cache);
+  /** \internal */
+  void unregister_cache(detail::evictable_cache * cache);
+  /** \internal Account for \a num_bytes more bytes, evicting entries if needed.
+   *
+   * Must not be called with the mutex of any cache held. */
+  void add_bytes(std::size_t num_bytes);
+  /** \internal */
+  void remove_bytes(std::size_t num_bytes);
+  /** \internal A strictly increasing counter to order cache entry accesses */
+  std::uint64_t next_tick() { return ++_tick; }
+
+  cache_budget(const cache_budget &) = delete;
+  cache_budget & operator=(const cache_budget &) = delete;
+
+private:
+  cache_budget();
+
+  void enforce();
+
+  std::atomic<std::size_t> _max_bytes;
+  std::atomic<std::size_t> _bytes_held;
+  std::atomic<std::size_t> _bytes_evicted;
+  std::atomic<std::size_t> _num_evictions;
+  std::atomic<std::uint64_t> _tick;
+
+  /** \brief Protects \a _caches; held while evicting */
+  std::mutex _mutex;
+  std::vector<detail::evictable_cache *> _caches;
+};
+
+
+} // namespace klfengine
+
+
+#ifndef _KLFENGINE_DONT_INCLUDE_IMPL_HXX
+#include <klfengine/impl/cache_budget.hxx>
+#endif
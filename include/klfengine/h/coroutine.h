@@ -0,0 +1,202 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <memory>
+#include <functional>
+#include <exception>
+#include <stdexcept>
+
+#include <klfengine/basedefs>
+#include <klfengine/input>
+#include <klfengine/format>
+#include <klfengine/shared_binary_data>
+#include <klfengine/job_scheduler>
+
+
+//
+// The coroutine interface requires C++20 coroutine support.  Test for
+// KLFENGINE_HAS_COROUTINES before using any of the definitions below.
+//
+// These are thread-offloading wrappers: each awaited call still runs the
+// blocking LaTeX/Ghostscript processes, on a thread provided by the executor,
+// for as long as they take.  They keep the awaiting coroutine's thread free,
+// but every call in progress occupies one executor thread.  Process
+// completion itself is not awaited asynchronously.
+//
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#  if __has_include(<coroutine>)
+#    define KLFENGINE_HAS_COROUTINES 1
+#  endif
+#endif
+
+
+#ifdef KLFENGINE_HAS_COROUTINES
+
+#include <coroutine>
+#include <optional>
+
+
+namespace klfengine {
+
+class run;
+class engine;
+
+
+/** \brief Runs tasks on behalf of the coroutine interface
+ *
+ * An executor receives a task and must eventually call it exactly once, for
+ * instance on a thread of a thread pool.  The task blocks for as long as the
+ * corresponding LaTeX or Ghostscript processes run, and it resumes the
+ * awaiting coroutine on the executor's thread once it is done.  The executor
+ * thus needs as many threads as calls that should be in progress at the same
+ * time; an executor that runs tasks on the coroutine scheduler's own threads
+ * blocks those threads.
+ */
+using executor = std::function<void(std::function<void()> task)>;
+
+
+namespace detail {
+
+template<typename T>
+struct awaitable_result
+{
+  std::optional<T> value;
+
+  void set(const std::function<T()> & work) { value.emplace(work()); }
+  T get() { return std::move(*value); }
+};
+
+template<>
+struct awaitable_result<void>
+{
+  void set(const std::function<void()> & work) { work(); }
+  void get() { }
+};
+
+} // namespace detail
+
+
+/** \brief The result of a call that can be awaited with \a co_await
+ *
+ * Awaiting this object hands the blocking call over to the \ref executor and
+ * suspends the awaiting coroutine until the call has completed.  The call
+ * itself still blocks the executor thread that runs it.  The result of
+ * the call is the result of the \a co_await expression; exceptions thrown by
+ * the call are rethrown there.
+ *
+ * An awaitable can only be awaited once.
+ */
+template<typename T>
+class awaitable
+{
+public:
+  awaitable(std::function<T()> work, executor exec)
+    : _work(std::move(work)), _exec(std::move(exec)), _result(), _error()
+  {
+    if (!_exec) {
+      throw std::invalid_argument("klfengine::awaitable: no executor given");
+    }
+  }
+
+  bool await_ready() const noexcept { return false; }
+
+  void await_suspend(std::coroutine_handle<> handle)
+  {
+    // the executor might run the task right away or on another thread before
+    // it returns, and this object is destroyed as soon as the coroutine has
+    // resumed -- so call a local copy of the executor, whose captures stay
+    // alive until the call has returned, and don't touch any members after
+    executor exec = std::move(_exec);
+    exec([this, handle]() {
+      try {
+        _result.set(_work);
+      } catch (...) {
+        _error = std::current_exception();
+      }
+      handle.resume();
+    });
+  }
+
+  T await_resume()
+  {
+    if (_error) {
+      std::rethrow_exception(_error);
+    }
+    return _result.get();
+  }
+
+private:
+  std::function<T()> _work;
+  executor _exec;
+  detail::awaitable_result<T> _result;
+  std::exception_ptr _error;
+};
+
+
+/** \brief Compile a run without blocking the awaiting coroutine
+ *
+ * <tt>co_await klfengine::async_compile(r, exec)</tt> is equivalent to
+ * <tt>r.compile()</tt>, except that the compilation happens in a task run by
+ * \a exec.  The run must outlive the \a co_await expression.
+ */
+awaitable<void> async_compile(klfengine::run & r, executor exec);
+
+/** \brief Get output data without blocking the awaiting coroutine
+ *
+ * <tt>co_await klfengine::async_get_data(r, format, exec)</tt> is equivalent
+ * to <tt>r.get_data_shared(format)</tt>, except that the data is produced in a
+ * task run by \a exec.  The run must outlive the \a co_await expression.
+ */
+awaitable<shared_binary_data> async_get_data(klfengine::run & r, format_spec format,
+                                             executor exec);
+
+/** \brief Get a compiled run without blocking the awaiting coroutine
+ *
+ * <tt>co_await klfengine::async_shared_run(e, input, exec)</tt> is equivalent
+ * to <tt>e.shared_run(input)</tt>, except that the run is compiled (or waited
+ * for) in a task run by \a exec.  The engine must outlive the \a co_await
+ * expression.
+ */
+awaitable<std::shared_ptr<klfengine::run>> async_shared_run(
+    klfengine::engine & e,
+    klfengine::input input_,
+    executor exec,
+    job_priority priority = job_priority::interactive
+    );
+
+
+} // namespace klfengine
+
+#endif // KLFENGINE_HAS_COROUTINES
+
+
+#ifndef _KLFENGINE_DONT_INCLUDE_IMPL_HXX
+#include <klfengine/impl/coroutine.hxx>
+#endif
@@ -0,0 +1,123 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include <klfengine/basedefs>
+
+
+namespace klfengine {
+
+namespace detail {
+
+constexpr std::size_t directory_reaper_default_max_backlog = 64;
+
+
+/** \brief Removes or cleans up directories in a background thread
+ *
+ * Deleting the files a LaTeX run leaves behind (aux, log, dvi, ps, pdf, png,
+ * ...) costs a number of system calls that the thread which happens to release
+ * the last reference to a run shouldn't have to pay for.  Instead, such
+ * cleanup jobs are handed over to a reaper with \ref submit(), and are
+ * executed by a worker thread, which is started on the first submitted job.
+ *
+ * The backlog is bounded: if \a max_backlog jobs are already pending, \ref
+ * submit() runs the job immediately in the calling thread.  Pending jobs are
+ * all run before the reaper is destroyed, and \ref flush() waits until they
+ * have been.
+ *
+ * Exceptions thrown by jobs are reported as warnings.  All methods of this
+ * class are thread-safe.
+ */
+class directory_reaper
+{
+public:
+  explicit directory_reaper(
+      std::size_t max_backlog = directory_reaper_default_max_backlog
+      );
+  ~directory_reaper();
+
+  directory_reaper(const directory_reaper &) = delete;
+  directory_reaper & operator=(const directory_reaper &) = delete;
+
+  /** \brief The process-wide reaper used for run working directories
+   *
+   * This instance is never destroyed, so it may be used by static objects
+   * during static destruction.  Its pending jobs are flushed when the program
+   * exits normally; jobs submitted after that are run right away.
+   */
+  static directory_reaper & instance();
+
+  /** \brief Queue a cleanup job, or run it right away if the backlog is full
+   */
+  void submit(std::function<void()> job);
+
+  /** \brief Wait until all jobs submitted so far have been run
+   */
+  void flush();
+
+  /** \brief The number of jobs that have been submitted but not completed yet
+   */
+  std::size_t backlog() const;
+
+private:
+  /** Run the pending jobs and stop the worker thread; subsequent jobs are run
+   *  right away */
+  void stop();
+
+  void worker();
+  static void run_job(const std::function<void()> & job);
+
+  const std::size_t _max_backlog;
+
+  mutable std::mutex _mutex;
+  std::condition_variable _cond_job;
+  std::condition_variable _cond_done;
+  std::deque<std::function<void()>> _jobs;
+  std::size_t _num_running;
+  bool _stopping;
+  std::thread _thread;
+};
+
+
+
+} // namespace detail
+
+} // namespace klfengine
+
+
+
+#ifndef _KLFENGINE_DONT_INCLUDE_IMPL_HXX
+#include <klfengine/impl/detail/directory_reaper.hxx>
+#endif
@@ -0,0 +1,110 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+
+#include <klfengine/basedefs>
+#include <klfengine/input>
+#include <klfengine/settings>
+
+#include <klfengine/h/detail/provide_fs.h>
+
+
+namespace klfengine {
+
+namespace detail {
+
+
+/** \brief How to invoke \c dvisvgm in \ref run_dvisvgm()
+ *
+ * If \a input_is_pdf is set, then the input file is a PDF file (this requires
+ * a \c dvisvgm version that supports \c --pdf, i.e., >= 2.4).  Otherwise it's a
+ * DVI file.
+ *
+ * If \a outline_fonts is set, glyphs are converted to paths (\c --no-fonts)
+ * instead of being embedded as SVG fonts.
+ *
+ * If \a tight_bbox is set, the SVG canvas is the exact bounding box of the
+ * page contents (<code>--bbox=min --exact-bbox</code>); otherwise it is the
+ * paper size of the input page.
+ */
+struct dvisvgm_options {
+  bool input_is_pdf;
+  bool outline_fonts;
+  bool tight_bbox;
+};
+
+/** \brief Run \c dvisvgm to convert a page of a DVI or PDF file to SVG
+ *
+ * The \c dvisvgm executable is looked up in the \a texbin_directory of the
+ * given settings.  It is run in the directory where \a input_file resides.
+ * Converts the given \a page (the first one by default), and returns the SVG
+ * document.
+ *
+ * \note DVI input is converted without Ghostscript (unless the DVI contains
+ *       PostScript specials), but \c dvisvgm's PDF mode always uses the
+ *       Ghostscript library internally.  If \a gs_libgs_path is set in the
+ *       settings, it is passed on with \c --libgs; otherwise \c dvisvgm looks
+ *       for the library on its own, which may fail even though the configured
+ *       \c gs executable works.
+ */
+binary_data run_dvisvgm(const settings & sett,
+                        const fs::path & input_file,
+                        const dvisvgm_options & opts,
+                        int page = 1);
+
+
+/** \brief Add margins, scale and a background to an SVG document
+ *
+ * Enlarges the \c viewBox of the root \c svg element by the given margins
+ * (specified in big points, i.e., in the SVG user units that \c dvisvgm uses),
+ * and sets the \c width and \c height attributes to the size of the new view
+ * box multiplied by \a scale.  If the \a bg_color is not fully transparent, a
+ * rectangle filling the full new view box is inserted before any other content.
+ *
+ * Throws \a std::runtime_error if the SVG data does not have a root \c svg
+ * element with a \c viewBox attribute.
+ */
+std::string svg_adjust_canvas(const std::string & svg,
+                              double margin_left_bp, double margin_top_bp,
+                              double margin_right_bp, double margin_bottom_bp,
+                              double scale,
+                              const color & bg_color);
+
+
+} // namespace detail
+
+} // namespace klfengine
+
+
+
+#ifndef _KLFENGINE_DONT_INCLUDE_IMPL_HXX
+#include <klfengine/impl/detail/dvisvgm.hxx>
+#endif
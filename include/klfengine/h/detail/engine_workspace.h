@@ -0,0 +1,104 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <set>
+#include <mutex>
+
+#include <klfengine/basedefs>
+#include <klfengine/temporary_directory>
+#include <klfengine/process>
+
+
+namespace klfengine {
+
+namespace detail {
+
+
+/** \brief A directory shared by all the runs of an engine instance
+ *
+ * The workspace is a temporary directory that lives as long as the engine (and
+ * any of its runs still alive) that holds shared inputs such as LaTeX style
+ * files.  These files are written only once, with \ref provide_file(), instead
+ * of once for each run.
+ *
+ * The workspace is made visible to TeX processes by prepending it to \a
+ * TEXINPUTS, see \ref texinputs_environment().
+ *
+ * All methods of this class are thread-safe.
+ */
+class engine_workspace
+{
+public:
+  /** \brief Create the workspace directory in \a temp_dir
+   *
+   * The arguments are passed on to the \ref temporary_directory constructor.
+   */
+  engine_workspace(fs::path temp_dir, std::string name_prefix);
+
+  /** \brief The location of the workspace directory
+   */
+  inline fs::path path() const { return _temp_dir.path(); }
+
+  /** \brief Write the file \a fname in the workspace, if we haven't done so
+   *         already
+   *
+   * The first call with a given \a fname writes \a data to that file.
+   * Subsequent calls with the same \a fname do nothing.  Returns the full path
+   * to the file.
+   */
+  fs::path provide_file(const std::string & fname, const char * data);
+
+  /** \brief Environment manipulation that exposes the workspace to TeX
+   *
+   * Pass the returned object to \ref process::run_and_wait() along with a
+   * <code>provide_environment_variables{{{"TEXINPUTS", ""}}}</code> (which
+   * ensures that the TeX default search path, represented by an empty
+   * component, is retained).
+   */
+  prepend_path_environment_variables texinputs_environment() const;
+
+private:
+  temporary_directory _temp_dir;
+  std::mutex _mutex;
+  std::set<std::string> _provided_files;
+};
+
+
+
+} // namespace detail
+
+} // namespace klfengine
+
+
+
+#ifndef _KLFENGINE_DONT_INCLUDE_IMPL_HXX
+#include <klfengine/impl/detail/engine_workspace.hxx>
+#endif
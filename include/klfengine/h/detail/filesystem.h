@@ -29,6 +29,7 @@
 #pragma once
 
 
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <functional>
@@ -69,6 +70,31 @@ find_wildcard_path(const std::vector<std::string> & wildcard_expressions,
 std::vector<std::string> get_environment_PATH(const char * varname = "PATH");
 
 
+/** \internal
+ *
+ * Whether \a p resides on a RAM-backed file system (tmpfs or ramfs).  Always
+ * returns false on platforms where we can't tell.
+ */
+bool is_ram_backed_directory(const fs::path & p);
+
+/** \internal
+ *
+ * Whether the file system on which \a p resides has at least \a
+ * min_free_bytes bytes available.  Returns true if \a min_free_bytes is not
+ * positive, and false if the free space cannot be determined.
+ */
+bool has_free_space(const fs::path & p, std::int64_t min_free_bytes);
+
+/** \internal
+ *
+ * Look for a writable RAM-backed directory with at least \a min_free_bytes
+ * bytes available in which to create temporary files.  The candidates are \a
+ * $TMPDIR (if it is itself a dedicated tmpfs), <code>/dev/shm</code> and
+ * <code>/run/shm</code>.  Returns an empty string if none is suitable.
+ */
+std::string detect_ram_temporary_directory(std::int64_t min_free_bytes);
+
+
 } // namespace detail
 
 } // namespace klfengine
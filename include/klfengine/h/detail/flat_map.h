@@ -0,0 +1,276 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <initializer_list>
+#include <iterator>
+#include <functional>
+#include <stdexcept>
+
+
+namespace klfengine {
+
+namespace detail {
+
+
+/** \internal
+ *
+ * An associative container with the interface of \a std::map (the part of it
+ * that klfengine uses), storing its entries in a single sorted vector.
+ *
+ * Lookups are binary searches over contiguous memory and a whole map is a
+ * single allocation, which is considerably cheaper than std::map's node per
+ * entry for the small parameter dictionaries used throughout klfengine.
+ * Inserting or erasing is linear in the size of the map.
+ *
+ * Differences to std::map: the \a value_type is \a std::pair<Key,T> (keys are
+ * not const, don't modify them through an iterator!), and inserting or
+ * erasing entries invalidates all iterators and references.
+ *
+ * \a T may be an incomplete type at the point where flat_map<Key,T> is named,
+ * so this container can be used in recursive types such as \ref value.
+ */
+template<typename Key, typename T, typename Compare = std::less<Key> >
+class flat_map
+{
+public:
+  using key_type = Key;
+  using mapped_type = T;
+  using value_type = std::pair<Key, T>;
+  using key_compare = Compare;
+  using container_type = std::vector<value_type>;
+  using size_type = typename container_type::size_type;
+  using difference_type = typename container_type::difference_type;
+  using reference = value_type &;
+  using const_reference = const value_type &;
+  using iterator = typename container_type::iterator;
+  using const_iterator = typename container_type::const_iterator;
+
+  flat_map() : _v() { }
+
+  template<typename InputIt>
+  flat_map(InputIt first, InputIt last)
+    : _v()
+  {
+    insert(first, last);
+  }
+
+  flat_map(std::initializer_list<value_type> ilist)
+    : _v()
+  {
+    insert(ilist.begin(), ilist.end());
+  }
+
+  flat_map(const flat_map &) = default;
+  flat_map(flat_map &&) = default;
+  flat_map & operator=(const flat_map &) = default;
+  flat_map & operator=(flat_map &&) = default;
+
+  // -- iterators & capacity --
+
+  iterator begin() { return _v.begin(); }
+  iterator end() { return _v.end(); }
+  const_iterator begin() const { return _v.begin(); }
+  const_iterator end() const { return _v.end(); }
+  const_iterator cbegin() const { return _v.cbegin(); }
+  const_iterator cend() const { return _v.cend(); }
+
+  bool empty() const { return _v.empty(); }
+  size_type size() const { return _v.size(); }
+
+  void reserve(size_type n) { _v.reserve(n); }
+  void clear() { _v.clear(); }
+
+  // -- lookup --
+
+  iterator lower_bound(const Key & key)
+  {
+    return std::lower_bound(_v.begin(), _v.end(), key, key_less{});
+  }
+  const_iterator lower_bound(const Key & key) const
+  {
+    return std::lower_bound(_v.begin(), _v.end(), key, key_less{});
+  }
+
+  iterator find(const Key & key)
+  {
+    iterator it = lower_bound(key);
+    if (it != _v.end() && !Compare{}(key, it->first)) {
+      return it;
+    }
+    return _v.end();
+  }
+  const_iterator find(const Key & key) const
+  {
+    const_iterator it = lower_bound(key);
+    if (it != _v.end() && !Compare{}(key, it->first)) {
+      return it;
+    }
+    return _v.end();
+  }
+
+  size_type count(const Key & key) const
+  {
+    return (find(key) != end()) ? 1 : 0;
+  }
+
+  T & at(const Key & key)
+  {
+    iterator it = find(key);
+    if (it == _v.end()) {
+      throw std::out_of_range{"flat_map::at(): no such key"};
+    }
+    return it->second;
+  }
+  const T & at(const Key & key) const
+  {
+    const_iterator it = find(key);
+    if (it == _v.end()) {
+      throw std::out_of_range{"flat_map::at(): no such key"};
+    }
+    return it->second;
+  }
+
+  T & operator[](const Key & key)
+  {
+    iterator it = lower_bound(key);
+    if (it == _v.end() || Compare{}(key, it->first)) {
+      it = _v.insert(it, value_type{key, T{}});
+    }
+    return it->second;
+  }
+  T & operator[](Key && key)
+  {
+    iterator it = lower_bound(key);
+    if (it == _v.end() || Compare{}(key, it->first)) {
+      it = _v.insert(it, value_type{std::move(key), T{}});
+    }
+    return it->second;
+  }
+
+  // -- modifiers --
+
+  std::pair<iterator,bool> insert(value_type x)
+  {
+    iterator it = lower_bound(x.first);
+    if (it != _v.end() && !Compare{}(x.first, it->first)) {
+      return std::make_pair(it, false);
+    }
+    return std::make_pair(_v.insert(it, std::move(x)), true);
+  }
+
+  iterator insert(const_iterator hint, value_type x)
+  {
+    // use the hint if x belongs right before it (e.g. when inserting sorted
+    // entries at the end with std::inserter())
+    if ( (hint == _v.cend() || Compare{}(x.first, hint->first)) &&
+         (hint == _v.cbegin() || Compare{}(std::prev(hint)->first, x.first)) ) {
+      return _v.insert(hint, std::move(x));
+    }
+    return insert(std::move(x)).first;
+  }
+
+  template<typename InputIt>
+  void insert(InputIt first, InputIt last)
+  {
+    // append everything, then sort and remove duplicate keys in one go.  Like
+    // std::map, keep the first of several entries with the same key.
+    size_type n_sorted = _v.size();
+    for ( ; first != last; ++first) {
+      _v.push_back(value_type(*first));
+    }
+    if (_v.size() == n_sorted) {
+      return;
+    }
+    std::stable_sort(_v.begin() + static_cast<difference_type>(n_sorted), _v.end(),
+                     entry_less{});
+    std::inplace_merge(_v.begin(), _v.begin() + static_cast<difference_type>(n_sorted),
+                       _v.end(), entry_less{});
+    _v.erase(std::unique(_v.begin(), _v.end(), entry_same_key{}), _v.end());
+  }
+
+  template<typename... Args>
+  std::pair<iterator,bool> emplace(Args&&... args)
+  {
+    return insert(value_type(std::forward<Args>(args)...));
+  }
+
+  iterator erase(const_iterator pos)
+  {
+    return _v.erase(pos);
+  }
+  iterator erase(iterator pos)
+  {
+    return _v.erase(pos);
+  }
+  size_type erase(const Key & key)
+  {
+    iterator it = find(key);
+    if (it == _v.end()) {
+      return 0;
+    }
+    _v.erase(it);
+    return 1;
+  }
+
+  void swap(flat_map & other) { _v.swap(other._v); }
+
+  // -- comparisons --
+
+  friend bool operator==(const flat_map & a, const flat_map & b) { return a._v == b._v; }
+  friend bool operator!=(const flat_map & a, const flat_map & b) { return a._v != b._v; }
+  friend bool operator<(const flat_map & a, const flat_map & b) { return a._v < b._v; }
+
+private:
+  struct key_less {
+    bool operator()(const value_type & a, const Key & key) const {
+      return Compare{}(a.first, key);
+    }
+  };
+  struct entry_less {
+    bool operator()(const value_type & a, const value_type & b) const {
+      return Compare{}(a.first, b.first);
+    }
+  };
+  struct entry_same_key {
+    bool operator()(const value_type & a, const value_type & b) const {
+      return !Compare{}(a.first, b.first) && !Compare{}(b.first, a.first);
+    }
+  };
+
+  container_type _v;
+};
+
+
+} // namespace detail
+
+} // namespace klfengine
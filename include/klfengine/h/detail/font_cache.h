@@ -0,0 +1,65 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+
+#include <klfengine/basedefs>
+#include <klfengine/settings>
+#include <klfengine/process>
+
+
+namespace klfengine {
+
+namespace detail {
+
+
+/** \brief Environment variables that point TeX's font caches to the settings'
+ *         \a font_cache_directory
+ *
+ * Returns variables that direct luaotfload's cache (\a TEXMFCACHE) and
+ * fontconfig's user cache (via \a XDG_CACHE_HOME) into subdirectories of the
+ * \a font_cache_directory.  The directories are created if necessary.
+ * kpathsea's \a TEXMFVAR is not changed, so that all TeX tools see the same
+ * one.
+ *
+ * If \a font_cache_directory is empty, an empty environment is returned.
+ */
+environment font_cache_environment(const settings & sett);
+
+
+} // namespace detail
+
+} // namespace klfengine
+
+
+
+#ifndef _KLFENGINE_DONT_INCLUDE_IMPL_HXX
+#include <klfengine/impl/detail/font_cache.hxx>
+#endif
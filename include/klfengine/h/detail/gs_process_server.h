@@ -0,0 +1,216 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include <klfengine/basedefs>
+
+
+namespace klfengine {
+
+namespace detail {
+
+
+/** \brief The resident Ghostscript server process exited unexpectedly
+ *
+ * Thrown by \ref gs_process_server::run_job() if the Ghostscript process died
+ * (crashed, was killed, or otherwise closed its output streams) before it
+ * reported back that the current job was finished.
+ */
+class gs_process_server_died : public klfengine::exception
+{
+public:
+  gs_process_server_died(std::string msg)
+    : klfengine::exception{std::move(msg)}
+  {}
+};
+
+/** \brief A job sent to the resident Ghostscript server took too long
+ *
+ * Thrown by \ref gs_process_server::run_job() if the job did not finish within
+ * the server's job timeout.  The server process was killed; it is started
+ * again for the next job.
+ */
+class gs_process_server_job_timeout : public klfengine::exception
+{
+public:
+  gs_process_server_job_timeout(std::string msg)
+    : klfengine::exception{std::move(msg)}
+  {}
+};
+
+
+/** \brief Translate Ghostscript command-line arguments into a server job
+ *
+ * Attempts to translate the command-line arguments \a gs_args (as they would
+ * be given to \ref klfengine::ghostscript_interface::run_gs()) into a piece of
+ * PostScript code that has the same effect when it is fed to a Ghostscript
+ * process that is already running (see \ref gs_process_server).  The device is
+ * selected with \c selectdevice, device parameters are set with \c
+ * setpagedevice, \c -c code is copied verbatim and input files are executed
+ * with <code>(file) run</code>.
+ *
+ * Only the switches that we know how to translate faithfully are accepted
+ * (<code>-sDEVICE=</code>, <code>-sOutputFile=</code>, <code>-r</code>,
+ * <code>-dDEVICEWIDTHPOINTS=</code>, <code>-dDEVICEHEIGHTPOINTS=</code>,
+ * <code>-dFIXEDMEDIA</code>, a few rendering-related device parameters, the
+ * standard batch flags, <code>-c</code> and <code>-f</code>).  If any other
+ * argument is encountered, or if reading from standard input is requested,
+ * this function returns \a false and the caller should run a regular one-shot
+ * Ghostscript process instead.
+ */
+bool gs_process_server_job_from_args(const std::vector<std::string> & gs_args,
+                                     std::string * ps_code);
+
+
+struct gs_process_server_private;
+
+/** \brief A long-lived Ghostscript process that executes jobs sent to its stdin
+ *
+ * The Ghostscript process is started with the given \a gs_argv (which should
+ * include the executable path in <code>gs_argv[0]</code> and end with \c "-"
+ * so that Ghostscript reads its program from standard input).  Each job is a
+ * piece of PostScript code (see \ref gs_process_server_job_from_args()), which
+ * is wrapped in a <code>save ... restore</code> / \c stopped context and
+ * followed by a sentinel line written to both standard output and standard
+ * error.  We read Ghostscript's output streams until we see the sentinels,
+ * which tells us the job is finished and whether or not it succeeded.
+ *
+ * If a job doesn't finish within \a job_timeout (zero means no limit), the
+ * server process is killed and \ref gs_process_server_job_timeout is thrown.
+ *
+ * This class is not thread-safe; use a \ref gs_process_server_pool to share
+ * server processes across threads.
+ *
+ * Only available on POSIX systems.  On other platforms \ref start() throws a
+ * \a std::runtime_error.
+ */
+class gs_process_server
+{
+public:
+  explicit gs_process_server(std::vector<std::string> gs_argv,
+                             std::chrono::milliseconds job_timeout
+                               = std::chrono::milliseconds(0));
+  ~gs_process_server();
+
+  gs_process_server(const gs_process_server &) = delete;
+  gs_process_server & operator=(const gs_process_server &) = delete;
+
+  /** \brief Launch the Ghostscript process
+   */
+  void start();
+
+  /** \brief Ask Ghostscript to quit, and wait for the process to terminate
+   */
+  void stop();
+
+  /** \brief Whether the Ghostscript process is running and can accept jobs
+   */
+  bool running() const;
+
+  /** \brief Execute some PostScript code in the resident Ghostscript process
+   *
+   * Returns \a true if the job completed without errors and \a false if
+   * Ghostscript reported an error.  Any output that Ghostscript writes to its
+   * standard output and standard error while executing the job is stored in
+   * \a capture_stdout and \a capture_stderr, respectively, if these pointers
+   * are not \a nullptr.
+   *
+   * Throws \ref gs_process_server_died if the process terminates before the job
+   * is finished, and \ref gs_process_server_job_timeout if the job takes too
+   * long.  The server is then no longer \ref running().
+   */
+  bool run_job(const std::string & ps_code,
+               binary_data * capture_stdout,
+               binary_data * capture_stderr);
+
+private:
+  gs_process_server_private *d;
+};
+
+
+/** \brief A pool of resident Ghostscript processes
+ *
+ * Hands out jobs to up to \a pool_size \ref gs_process_server instances, which
+ * are started lazily as they are needed.  If all servers are busy, \ref
+ * run_job() waits for one of them to become available.
+ *
+ * If a server process dies while it is handling a job, it is discarded and the
+ * job is retried once on a freshly started server process.  If that second
+ * attempt fails as well, \ref gs_process_server_died is thrown.  Jobs that time
+ * out (see \ref gs_process_server) are not retried.
+ */
+class gs_process_server_pool
+{
+public:
+  gs_process_server_pool(std::vector<std::string> gs_argv, int pool_size,
+                         std::chrono::milliseconds job_timeout
+                           = std::chrono::milliseconds(0));
+  ~gs_process_server_pool();
+
+  /** \brief The maximal number of concurrent Ghostscript server processes
+   */
+  int pool_size() const { return _pool_size; }
+
+  /** \brief Run a job on an available server.  See \ref gs_process_server::run_job().
+   */
+  bool run_job(const std::string & ps_code,
+               binary_data * capture_stdout,
+               binary_data * capture_stderr);
+
+private:
+  std::unique_ptr<gs_process_server> acquire_server();
+  void release_server(std::unique_ptr<gs_process_server> server);
+
+  const std::vector<std::string> _gs_argv;
+  const int _pool_size;
+  const std::chrono::milliseconds _job_timeout;
+
+  std::mutex _mutex;
+  std::condition_variable _server_released;
+  std::vector<std::unique_ptr<gs_process_server>> _idle_servers;
+  int _num_servers;
+};
+
+
+} // namespace detail
+
+} // namespace klfengine
+
+
+
+#ifndef _KLFENGINE_DONT_INCLUDE_IMPL_HXX
+#include <klfengine/impl/detail/gs_process_server.hxx>
+#endif
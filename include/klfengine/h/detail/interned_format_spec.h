@@ -0,0 +1,117 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include <klfengine/basedefs>
+#include <klfengine/format>
+
+
+namespace klfengine {
+
+namespace detail {
+
+
+/** \internal
+ *
+ * An interned, immutable \ref format_spec with a precomputed hash.
+ *
+ * All interned_format_spec instances that were constructed from equal
+ * format_spec's share the same underlying object (as long as any of them is
+ * alive).  Comparing two instances thus only compares pointers, and hashing
+ * returns the hash that was computed once when the format_spec was interned.
+ * This makes them cheap keys for caches, including caches that are shared
+ * across runs.
+ *
+ * Interning itself requires hashing and comparing the full format_spec once,
+ * so it should be done once per distinct format (e.g. when canonicalizing a
+ * format), not on every lookup.
+ */
+class interned_format_spec
+{
+public:
+  /** An empty instance, equal to the interned empty format_spec.  Cheap: the
+   *  empty format_spec is interned only once. */
+  interned_format_spec();
+  /** Intern the given \a format. */
+  explicit interned_format_spec(const format_spec & format);
+
+  inline const format_spec & get() const { return _node->spec; }
+  inline const format_spec & operator*() const { return _node->spec; }
+  inline const format_spec * operator->() const { return &_node->spec; }
+
+  inline std::size_t hash() const { return _node->hash; }
+
+  inline bool operator==(const interned_format_spec & other) const {
+    return _node == other._node;
+  }
+  inline bool operator!=(const interned_format_spec & other) const {
+    return _node != other._node;
+  }
+
+  /** Number of distinct format_spec's that are currently interned. */
+  static std::size_t num_interned();
+
+private:
+  struct node {
+    format_spec spec;
+    std::size_t hash;
+  };
+  struct table;
+  struct node_deleter;
+
+  static std::shared_ptr<table> get_table();
+  static const std::shared_ptr<const node> & empty_node();
+
+  std::shared_ptr<const node> _node;
+};
+
+
+template<>
+struct hash<interned_format_spec>
+{
+  std::size_t operator()(const interned_format_spec & f) const noexcept
+  {
+    return f.hash();
+  }
+};
+
+
+} // namespace detail
+
+} // namespace klfengine
+
+
+
+#ifndef _KLFENGINE_DONT_INCLUDE_IMPL_HXX
+#include <klfengine/impl/detail/interned_format_spec.hxx>
+#endif
@@ -0,0 +1,115 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <memory>
+
+#include <klfengine/basedefs>
+#include <klfengine/shared_binary_data>
+
+#include <klfengine/h/detail/filesystem.h>
+
+
+namespace klfengine {
+
+namespace detail {
+
+
+/** \internal
+ *
+ * Files smaller than this are simply read into memory by \ref
+ * load_file_shared(), as mapping them costs more than it saves.
+ */
+constexpr std::size_t load_file_shared_mmap_threshold = 64 * 1024;
+
+
+#if defined(_KLFENGINE_OS_LINUX) || defined(_KLFENGINE_OS_MACOSX)
+/** \internal
+ *
+ * A read-only, private memory mapping of a whole file.  The mapping remains
+ * valid if the file is removed afterwards.
+ */
+class mapped_file
+{
+public:
+  /** Map the file \a fname.  Throws \a std::system_error on failure. */
+  explicit mapped_file(const fs::path & fname);
+  ~mapped_file();
+
+  mapped_file(const mapped_file &) = delete;
+  mapped_file & operator=(const mapped_file &) = delete;
+
+  inline const std::uint8_t * data() const { return _data; }
+  inline std::size_t size() const { return _size; }
+
+private:
+  const std::uint8_t * _data;
+  std::size_t _size;
+};
+
+/** \internal
+ *
+ * Map a private copy of the file \a fname, which is removed right away.  As
+ * nobody else can open the copy, it can't be truncated or rewritten while it
+ * is mapped (reading the mapping would then raise \a SIGBUS).  Returns a null
+ * pointer if the copy can't be made or mapped.
+ */
+std::shared_ptr<const mapped_file> map_private_copy(const fs::path & fname);
+#endif
+
+
+/** \internal
+ *
+ * Load the contents of the file \a fname without copying it if possible.
+ *
+ * On POSIX systems, files of at least \ref load_file_shared_mmap_threshold
+ * bytes are memory-mapped, and the mapping is kept alive by the returned
+ * object.  Smaller files, and all files on other systems, are read into
+ * memory.
+ *
+ * If \a take_file is set, the file is removed from its directory once it has
+ * been loaded, and a large file is mapped directly.  Without \a take_file,
+ * the file stays and a private copy of it is mapped instead (see \ref
+ * map_private_copy()).  Either way, the file may be modified, truncated or
+ * removed while the returned data is in use, and its directory may be
+ * removed or reused.  A mapped file's data stays available until the
+ * returned object (and all its copies) are destroyed.
+ */
+shared_binary_data load_file_shared(const fs::path & fname, bool take_file = false);
+
+
+} // namespace detail
+
+} // namespace klfengine
+
+
+
+#ifndef _KLFENGINE_DONT_INCLUDE_IMPL_HXX
+#include <klfengine/impl/detail/mapped_file.hxx>
+#endif
@@ -0,0 +1,132 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <klfengine/basedefs>
+#include <klfengine/settings>
+#include <klfengine/process>
+#include <klfengine/latex_log>
+#include <klfengine/h/detail/font_cache.h>
+
+#include <klfengine/h/detail/provide_fs.h>
+
+
+namespace klfengine {
+
+namespace detail {
+
+
+/** \brief Run a LaTeX engine on a file and parse its output
+ *
+ * Runs the executable \a latex_engine (found in the settings' \a
+ * texbin_directory) on \a tex_file in the directory \a run_dir, in
+ * file-line-error and nonstop mode (and with <code>-halt-on-error</code> if
+ * the settings' \a latex_halt_on_error is set).  Any additional arguments \a
+ * env_args are passed on to \ref process::run_and_wait() and can be used to
+ * adjust the environment of the latex process.
+ *
+ * TeX's line wrapping is disabled so that the output can be parsed reliably.
+ * If the settings specify a \a font_cache_directory, the font cache
+ * environment variables are set accordingly (see \ref
+ * font_cache_environment()).
+ *
+ * Returns the diagnostics found in the output.  If the process exits with an
+ * error, a \ref latex_compile_error is thrown instead.
+ *
+ * \note Each call runs a fresh LaTeX process.  Our documents carry their own
+ *       preamble, and TeX only finalizes its output file on exit, so a
+ *       resident LaTeX process can't be reused across jobs.
+ */
+template<typename... EnvArgs>
+inline latex_diagnostics run_latex(const settings & sett,
+                                   const std::string & latex_engine,
+                                   const fs::path & tex_file,
+                                   const fs::path & run_dir,
+                                   EnvArgs && ... env_args)
+{
+  std::vector<std::string> argv{
+    sett.get_tex_executable_path(latex_engine),
+    "-file-line-error",
+    "-interaction=nonstopmode"
+  };
+  if (sett.latex_halt_on_error) {
+    argv.push_back("-halt-on-error");
+  }
+  argv.push_back(tex_file.native());
+
+  environment tex_env{ font_cache_environment(sett) };
+  tex_env["max_print_line"] = "100000";
+  tex_env["error_line"] = "254";
+  tex_env["half_error_line"] = "238";
+
+  binary_data out;
+  binary_data err;
+  int exit_code = 0;
+
+  process::run_and_wait(
+      argv,
+      process::run_in_directory{ run_dir.native() },
+      set_environment_variables{ std::move(tex_env) },
+      std::forward<EnvArgs>(env_args)...,
+      process::capture_stdout_data{&out},
+      process::capture_stderr_data{&err},
+      process::capture_exit_code{exit_code},
+      process::check_exit_code{false}
+      );
+
+  latex_diagnostics diagnostics = latex_log_parser::parse(out);
+
+  if (exit_code != 0) {
+    std::string msg{
+      "Process " + argv.front() + " exited with code " + std::to_string(exit_code)
+    };
+    const latex_diagnostic * error = diagnostics.first_error();
+    if (error != nullptr) {
+      msg += ": ";
+      if (error->kind == latex_diagnostic_kind::Error && !error->file.empty()) {
+        msg += error->file + ":" + std::to_string(error->line) + ": ";
+      }
+      msg += error->message;
+    } else {
+      // we couldn't make sense of the output, include it all
+      msg += suffix_out_and_err(&out, &err);
+    }
+    throw latex_compile_error{std::move(msg), std::move(diagnostics)};
+  }
+
+  return diagnostics;
+}
+
+
+} // namespace detail
+
+} // namespace klfengine
@@ -0,0 +1,170 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <set>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+
+#include <klfengine/basedefs>
+#include <klfengine/temporary_directory>
+#include <klfengine/h/detail/directory_reaper.h>
+
+
+namespace klfengine {
+
+namespace detail {
+
+constexpr std::size_t temp_dir_pool_default_max_idle = 8;
+
+
+/** \brief A pool of recycled temporary working directories
+ *
+ * Creating a \ref temporary_directory for each run involves generating a
+ * random name, creating the directory, and removing the directory again when
+ * the run is done.  An engine can instead keep a pool of working directories:
+ * \ref acquire() hands out an idle directory if there is one (and only creates
+ * a new one otherwise), and when the returned \ref lease is destroyed, the
+ * directory's contents are cleaned up and the directory goes back to the pool.
+ * At most \a max_idle directories are kept idle; further returned directories
+ * are removed.  The cleanup happens in the background, see \ref
+ * directory_reaper::instance().
+ *
+ * Optionally, a \a seed function can populate each newly created directory
+ * with files that all runs need (e.g., a style file).  Files and directories
+ * created by the seed function are preserved when a directory is recycled.
+ * The seed function must produce the same files every time it is called.
+ *
+ * A pool must be managed by a \a std::shared_ptr.  Leases only hold a weak
+ * reference to their pool, so they may safely outlive it; in that case, the
+ * directory is simply removed when the lease is destroyed.  The directories
+ * that are idle when the pool is destroyed are removed in the background, too.
+ *
+ * All methods of this class are thread-safe.
+ */
+class temporary_directory_pool
+  : public std::enable_shared_from_this<temporary_directory_pool>
+{
+  struct entry {
+    entry(fs::path temp_dir, std::string name_prefix)
+      : dir{std::move(temp_dir), std::move(name_prefix)}, seeded{}
+    { }
+    temporary_directory dir;
+    std::set<fs::path> seeded;
+  };
+
+public:
+  using seed_function = std::function<void(const fs::path &)>;
+
+  /** \brief A working directory handed out by \ref acquire()
+   *
+   * The directory is returned to the pool when this object is destroyed.
+   */
+  class lease
+  {
+  public:
+    lease(lease &&) = default;
+    lease & operator=(lease &&) = delete;
+    lease(const lease &) = delete;
+    lease & operator=(const lease &) = delete;
+    ~lease();
+
+    /** \brief The path to the working directory
+     */
+    inline fs::path path() const { return _entry->dir.path(); }
+
+  private:
+    friend class temporary_directory_pool;
+    lease(std::weak_ptr<temporary_directory_pool> pool,
+          std::shared_ptr<entry> e);
+
+    std::weak_ptr<temporary_directory_pool> _pool;
+    std::shared_ptr<entry> _entry;
+  };
+
+  /** \brief Create a pool of directories created in \a temp_dir
+   *
+   * The arguments \a temp_dir and \a name_prefix are passed on to the \ref
+   * temporary_directory constructor when a new directory is needed.
+   */
+  temporary_directory_pool(
+      fs::path temp_dir,
+      std::string name_prefix,
+      std::size_t max_idle = temp_dir_pool_default_max_idle,
+      seed_function seed = seed_function{}
+      );
+  ~temporary_directory_pool();
+
+  /** \brief Get a clean working directory, recycling an idle one if possible
+   */
+  lease acquire();
+
+  /** \brief Create idle directories until there are \a num_dirs of them
+   *
+   * This allows to move the cost of creating (and seeding) directories out of
+   * the first runs.  At most \a max_idle directories are created.
+   */
+  void prefill(std::size_t num_dirs);
+
+  /** \brief The location in which the directories are created
+   */
+  inline const fs::path & base_directory() const { return _temp_dir; }
+
+  /** \brief The number of directories that are currently idle
+   */
+  std::size_t num_idle() const;
+
+private:
+  std::shared_ptr<entry> create_entry();
+  void recycle(std::shared_ptr<entry> e);
+  static void remove_entry(const std::shared_ptr<entry> & e);
+
+  const fs::path _temp_dir;
+  const std::string _name_prefix;
+  const std::size_t _max_idle;
+  const seed_function _seed;
+
+  mutable std::mutex _mutex;
+  std::vector<std::shared_ptr<entry>> _idle;
+};
+
+
+
+} // namespace detail
+
+} // namespace klfengine
+
+
+
+#ifndef _KLFENGINE_DONT_INCLUDE_IMPL_HXX
+#include <klfengine/impl/detail/temporary_directory_pool.hxx>
+#endif
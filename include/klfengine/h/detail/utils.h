@@ -41,6 +41,12 @@
 #include <klfengine/h/basedefs.h>
 #include <klfengine/h/detail/provide_fs.h>
 
+#if defined(_KLFENGINE_OS_WIN)
+#include <io.h> // _write()
+#else
+#include <unistd.h> // write()
+#endif
+
 
 namespace klfengine {
 
@@ -191,6 +197,27 @@ binary_data load_file_data(const std::string & fname)
   return data;
 }
 
+inline
+void write_all_to_fd(int fd, const std::uint8_t * data, std::size_t size)
+{
+  while (size > 0) {
+#if defined(_KLFENGINE_OS_WIN)
+    int chunk = static_cast<int>(std::min<std::size_t>(size, 1u << 30));
+    int res = ::_write(fd, data, static_cast<unsigned int>(chunk));
+#else
+    ssize_t res = ::write(fd, data, size);
+#endif
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error{errno, std::generic_category()};
+    }
+    data += res;
+    size -= static_cast<std::size_t>(res);
+  }
+}
+
 
 
 
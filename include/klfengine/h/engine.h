@@ -30,11 +30,16 @@
 
 
 #include <memory>
+#include <mutex>
+#include <future>
+#include <unordered_map>
 
 
 #include <klfengine/basedefs>
 #include <klfengine/input>
 #include <klfengine/settings>
+#include <klfengine/job_scheduler>
+#include <klfengine/h/detail/temporary_directory_pool.h>
 
 
 namespace klfengine
@@ -43,6 +48,27 @@ namespace klfengine
 class run;
 class engine_run_implementation;
 
+
+namespace detail {
+/** \internal
+ *
+ * A run handed out by \ref engine::shared_run(), along with the settings it was
+ * created with.  While the run is compiling, \a compiling holds its future
+ * value; afterwards, the run is only referred to weakly so that it is
+ * destroyed as soon as its last user drops it.
+ */
+struct engine_shared_run_entry
+{
+  klfengine::settings settings;
+  std::shared_future<std::shared_ptr<klfengine::run> > compiling;
+  std::weak_ptr<klfengine::run> compiled;
+};
+
+using engine_shared_runs_type =
+  std::unordered_map<input, engine_shared_run_entry, hash<input> >;
+} // namespace detail
+
+
 /** \brief Base abstract class for implementations
  *
  * Implementations should subclass this class to provide a factory for
@@ -69,12 +95,119 @@ public:
   void set_settings(klfengine::settings settings_);
   inline klfengine::settings settings() const { return _settings; }
 
-  std::unique_ptr<klfengine::run> run( input input_ );
+  /** \brief Create a new run for the given input
+   *
+   * The run's stages (LaTeX, Ghostscript, ...) are scheduled with \ref
+   * scheduler() in the given \a priority class.
+   */
+  std::unique_ptr<klfengine::run> run( input input_,
+                                       job_priority priority = job_priority::interactive );
+
+  /** \brief Get a compiled run for the given input, shared with other callers
+   *
+   * If a run for an equal input (and with the same engine settings) is
+   * currently being compiled or is still in use by another caller, that run is
+   * returned instead of creating a new one.  Concurrent identical requests thus
+   * result in a single LaTeX compilation, and as \ref run instances produce
+   * each format only once, in a single conversion per format.
+   *
+   * Unlike \ref run(), the returned run is already compiled.  If compilation
+   * fails, the exception is reported to all callers waiting for that run, and
+   * the next call will try again.  This method is thread-safe.
+   *
+   * If the run is shared, it keeps the \a priority of the call that created
+   * it.
+   */
+  std::shared_ptr<klfengine::run> shared_run(
+      input input_,
+      job_priority priority = job_priority::interactive
+      );
+
+  /** \brief Set the scheduler that limits how many jobs run each stage
+   *
+   * Each engine has its own \ref job_scheduler (without any limits) by
+   * default.  Set the same scheduler on several engines to apply limits across
+   * all of them.  This applies to runs created after this call.
+   */
+  void set_scheduler(std::shared_ptr<job_scheduler> scheduler);
+  /** \brief The scheduler used by the runs of this engine
+   *
+   * See \ref set_scheduler().  Use it to set the limits, e.g. \ref
+   * job_scheduler::set_max_concurrent().
+   */
+  inline std::shared_ptr<job_scheduler> scheduler() const { return _scheduler; }
+
+  /** \brief Prebuild the font caches of xelatex and lualatex
+   *
+   * Compiles a tiny document that loads \c fontspec with each of the given \a
+   * latex_engines (those that are not installed are skipped).  This makes
+   * luaotfload build its font name database and fontconfig its cache, such that
+   * later runs don't pay for it.  This is mostly useful along with a persistent
+   * \ref settings::font_cache_directory.
+   *
+   * Failures are reported as warnings; this function does not throw if an
+   * engine fails to compile the document.
+   */
+  void warm_up_font_caches(
+      const std::vector<std::string> & latex_engines =
+          std::vector<std::string>{"xelatex", "lualatex"}
+      );
+
+  /** \brief Set how many run working directories are kept around for reuse
+   *
+   * Runs get their working directory from a pool maintained by the engine (see
+   * \ref detail::temporary_directory_pool), so that directories don't have to
+   * be created and removed for every run.  At most \a max_idle cleaned-up
+   * directories are kept for reuse.  Setting \a max_idle to zero disables
+   * recycling.  This applies to runs created after this call.
+   */
+  void set_temporary_directory_pool_size(std::size_t max_idle);
+  inline std::size_t temporary_directory_pool_size() const
+  { return _temp_dir_pool_size; }
+
+  /** \brief Create working directories for runs ahead of time
+   *
+   * Ensures that \a num_dirs directories (but at most \ref
+   * temporary_directory_pool_size()) are ready for use by subsequent runs.
+   */
+  void prefill_temporary_directory_pool(std::size_t num_dirs);
+
+protected:
+  /** \brief Set the name prefix and optional seed function of the working
+   *         directory pool
+   *
+   * Subclasses should call this in their constructor.  See \ref
+   * detail::temporary_directory_pool.
+   */
+  void set_temporary_directory_pool_options(
+      std::string name_prefix,
+      detail::temporary_directory_pool::seed_function seed =
+          detail::temporary_directory_pool::seed_function{}
+      );
+
+  /** \brief The pool from which runs should take their working directory
+   *
+   * The pool is created on first use, and is replaced by a new one if the
+   * location returned by \ref settings::get_temporary_directory_path() has
+   * changed.  This method is thread-safe.
+   */
+  std::shared_ptr<detail::temporary_directory_pool> get_temporary_directory_pool();
 
 private:
   const std::string _name;
   klfengine::settings _settings;
 
+  std::mutex _temp_dir_pool_mutex;
+  std::shared_ptr<detail::temporary_directory_pool> _temp_dir_pool;
+  std::size_t _temp_dir_pool_size;
+  std::string _temp_dir_pool_name_prefix;
+  detail::temporary_directory_pool::seed_function _temp_dir_pool_seed;
+
+  std::shared_ptr<job_scheduler> _scheduler;
+
+  std::mutex _shared_runs_mutex;
+  detail::engine_shared_runs_type _shared_runs;
+
   /** \brief Called immediately after new settings were set
    *
    * This is called from set_settings(), after saving the new settings.
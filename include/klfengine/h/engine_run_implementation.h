@@ -32,6 +32,18 @@
 #include <klfengine/input>
 #include <klfengine/settings>
 #include <klfengine/format>
+#include <klfengine/shared_binary_data>
+#include <klfengine/latex_log>
+#include <klfengine/job_scheduler>
+#include <klfengine/cache_budget>
+
+#include <klfengine/h/detail/provide_fs.h>
+#include <klfengine/h/detail/interned_format_spec.h>
+
+#include <mutex>
+#include <future>
+#include <thread>
+#include <memory>
 
 
 namespace klfengine {
@@ -43,14 +55,70 @@ namespace detail
 /**
  * \internal
  *
- * Type to use for cache keys (which represent format_spec's).  We'll store some
- * (binary?) string representing the format_spec (e.g. JSON? or BSON?)
+ * Type to use for cache keys (which represent canonical format_spec's).  These
+ * are interned with a precomputed hash, so lookups don't need to visit the
+ * format's parameters.
  */
-using fmtspec_cache_key_type = format_spec; //std::string;
+using fmtspec_cache_key_type = interned_format_spec;
+
+/**
+ * \internal
+ *
+ * The cached data of a format, along with what \ref cache_budget needs to know
+ * to evict it.
+ */
+struct run_impl_cache_entry
+{
+  shared_binary_data data;
+  cache_entry_kind kind;
+  /** see cache_budget::next_tick() */
+  std::uint64_t last_use;
+};
 
 using run_impl_cache_type =
   std::unordered_map<fmtspec_cache_key_type,
-                     binary_data,
+                     run_impl_cache_entry,
+                     hash<fmtspec_cache_key_type> >;
+
+/**
+ * \internal
+ *
+ * The files from which intermediate formats were loaded (see
+ * engine_run_implementation::store_file_to_cache()), so that they can be loaded
+ * again after they were evicted from the cache.
+ */
+using run_impl_source_files_type =
+  std::unordered_map<fmtspec_cache_key_type,
+                     fs::path,
+                     hash<fmtspec_cache_key_type> >;
+
+/**
+ * \internal
+ *
+ * Memo of the canonical form of the format_spec's that were requested (as
+ * given by the caller) so far.
+ */
+using run_impl_canonical_memo_type =
+  std::unordered_map<format_spec,
+                     fmtspec_cache_key_type,
+                     hash<format_spec> >;
+
+/**
+ * \internal
+ *
+ * A format that is currently being produced by some thread.  Other threads
+ * requesting the same format wait on \a result instead of producing it again.
+ */
+struct run_impl_production
+{
+  std::thread::id thread;
+  std::promise<shared_binary_data> promise;
+  std::shared_future<shared_binary_data> result;
+};
+
+using run_impl_in_flight_type =
+  std::unordered_map<fmtspec_cache_key_type,
+                     std::shared_ptr<run_impl_production>,
                      hash<fmtspec_cache_key_type> >;
 }
 
@@ -111,8 +179,28 @@ using run_impl_cache_type =
  *   \ref compile() method here would not solve the issue because the
  *   compilation should only happen once anyways
  *
+ * <b>Thread safety</b>
+ *
+ * Once compile() has returned, get_data_cref() and get_data_shared() may be
+ * called from several threads at once.  Different formats are then produced in
+ * parallel, i.e., \ref impl_produce_data() (or \ref
+ * impl_produce_shared_data()) may run concurrently for different canonical
+ * formats, and subclasses need to protect any state that they modify while
+ * producing data.  Concurrent requests for the same format are only produced
+ * once; the other callers wait for that result.  \ref impl_make_canonical() may
+ * also be called concurrently, sometimes with an internal lock held, so it
+ * must not request any data itself.
+ *
+ * <b>Cache budget</b>
+ *
+ * The bytes held in the cache are accounted for by \ref cache_budget, which
+ * may evict cache entries if a budget is set.  Evicted entries are loaded (see
+ * \ref store_file_to_cache()) or produced again when they are requested.
+ * Entries stored with \ref store_to_cache() or handed out by \ref
+ * get_data_cref() are never evicted.
  */
-class engine_run_implementation : public format_provider
+class engine_run_implementation : public format_provider,
+                                  private detail::evictable_cache
 {
 public:
   /** \brief Constructor */
@@ -155,8 +243,14 @@ public:
    *
    * The \a format is not assumed to be in canonical form.
    *
+   * If another thread is already producing the same format, this call waits
+   * for that thread's result (or exception) instead of producing it again.
+   *
    * The lifetime of the returned reference is the same as the lifetime of the
-   * current class instance.
+   * current class instance.  The cache entry won't be evicted by \ref
+   * cache_budget.  If the entry refers to a memory-mapped file, it is replaced
+   * by an in-memory copy of the data (which is what the reference refers to),
+   * so that the cache doesn't hold both.
    *
    * \warning A const reference is returned to an internal data structure.  The
    *          caller is responsible for not modifying the data pointed by the
@@ -166,6 +260,43 @@ public:
    */
   const binary_data & get_data_cref(const format_spec & format);
 
+  /** \brief Get a shared handle to the result data for the given format
+   *
+   * Like \ref get_data_cref(), but returns a reference-counted handle to the
+   * cached data instead of a reference.  No data is copied, and the returned
+   * object remains valid after this instance is destroyed.
+   *
+   * If \a store_in_cache is \a false and the data isn't in the cache yet, the
+   * data is produced and returned without storing it to the cache.  (Any
+   * intermediate formats the engine stores to the cache along the way are
+   * still cached.)
+   */
+  shared_binary_data get_data_shared(const format_spec & format,
+                                     bool store_in_cache = true);
+
+  /** \brief Diagnostics reported by LaTeX during compilation
+   *
+   * Engines report these with \ref set_diagnostics().  If compile() failed
+   * with a \ref latex_compile_error, the diagnostics carried by the exception
+   * are stored here as well.
+   */
+  const latex_diagnostics & diagnostics() const { return _diagnostics; }
+
+  /** \brief Set the scheduler for the stages of this run
+   *
+   * This is called by \ref engine::run() before compile().  If no scheduler
+   * is set, the stages of this run are not subject to any limits.  See \ref
+   * acquire_stage().
+   */
+  void set_scheduler(std::shared_ptr<job_scheduler> scheduler,
+                     job_priority priority = job_priority::interactive);
+
+  /** \brief The priority class of this run's stages
+   *
+   * See \ref set_scheduler().
+   */
+  job_priority priority() const { return _priority; }
+
 
 private:
 
@@ -192,6 +323,19 @@ private:
    */
   virtual binary_data impl_produce_data(const format_spec & canon_format) = 0;
 
+  /** \brief Return the data associated with the given canonical format as
+   *         shared data
+   *
+   * This is what \ref get_data_shared() and \ref get_data_cref() actually call
+   * to produce data.  The default implementation calls \ref
+   * impl_produce_data().  Subclasses can reimplement this method instead to
+   * avoid copies, e.g. to return a memory-mapped output file (see \ref
+   * detail::load_file_shared()) or data that is already in the cache (see \ref
+   * get_data_shared()).  In that case, \ref impl_produce_data() should still
+   * be implemented to return a copy of the same data.
+   */
+  virtual shared_binary_data impl_produce_shared_data(const format_spec & canon_format);
+
 
 protected:
 
@@ -210,17 +354,109 @@ protected:
    * \ref binary_data object to the cache (they should use std::move for this).
    * The caller can use the returned reference to maintain (const) access to the
    * data.
+   *
+   * If data for this format is already in the cache (e.g., because it was
+   * stored by a concurrent production of another format), the existing data is
+   * kept and a reference to it is returned.  It is an error to store the format
+   * that the current thread is being asked to produce; that data is stored
+   * automatically once \ref impl_produce_data() returns.
    */
   const binary_data &
   store_to_cache(const format_spec & canonical_format, binary_data && data);
 
+  /** \brief Store the given shared format data to cache
+   *
+   * Same as the other overload, for data that is already held in a \ref
+   * shared_binary_data.  The data is not copied.
+   */
+  const binary_data &
+  store_to_cache(const format_spec & canonical_format, shared_binary_data data);
+
+  /** \brief Store the contents of an intermediate file to cache
+   *
+   * Loads the file \a fname (see \ref detail::load_file_shared()) and stores
+   * its contents to the cache like \ref store_to_cache().  The file must
+   * remain unchanged for the lifetime of this instance (typically, it lives in
+   * the run's temporary directory).  If the cache entry is evicted by \ref
+   * cache_budget, it is loaded again from this file when it is requested.
+   */
+  void store_file_to_cache(const format_spec & canonical_format, const fs::path & fname);
+
+  /** \brief Report the diagnostics output by LaTeX
+   *
+   * See \ref diagnostics() and \ref detail::run_latex().
+   */
+  void set_diagnostics(latex_diagnostics diagnostics_);
+
+  /** \brief Wait until the given stage may be run
+   *
+   * Engines should call this before running LaTeX, dvips, Ghostscript, etc.,
+   * and hold on to the returned slot until that step is finished.  Returns an
+   * empty slot right away if no scheduler was set (see \ref set_scheduler()).
+   *
+   * Don't request data with get_data_cref() (or similar) while holding a slot.
+   */
+  job_scheduler::slot acquire_stage(job_stage stage);
+
 
 private:
   const klfengine::input _input;
   const klfengine::settings _settings;
 
+  /** \brief Protects \a _cache, \a _source_files, \a _bytes_held, \a
+   *         _canonical_memo and \a _in_flight
+   *
+   * This lock is never held while data is being produced, nor while calling
+   * into \ref cache_budget.
+   */
+  std::mutex _cache_mutex;
+
   detail::run_impl_cache_type _cache;
 
+  detail::run_impl_source_files_type _source_files;
+
+  /** \brief The number of bytes in \a _cache, see \ref cache_budget */
+  std::size_t _bytes_held;
+
+  detail::run_impl_canonical_memo_type _canonical_memo;
+
+  detail::run_impl_in_flight_type _in_flight;
+
+  /** \brief Same as canonical_format(), remembering the result
+   *
+   * The canonical form of a given format only depends on the input and
+   * settings of this run, which never change.  Repeated requests for the same
+   * format are thus resolved with a single lookup.  Failures are not
+   * remembered.  Must be called with \a _cache_mutex held.
+   */
+  detail::fmtspec_cache_key_type memoized_canonical_format(const format_spec & format);
+
+  /** \brief Implementation of get_data_shared(), pinning the cache entry if
+   *         \a pin is set (see get_data_cref())
+   */
+  shared_binary_data get_data_impl(const format_spec & format, bool store_in_cache,
+                                   bool pin);
+
+  /** \brief Insert an entry to \a _cache unless it already exists
+   *
+   * Must be called with \a _cache_mutex held.  Returns the cache entry and adds
+   * the number of new bytes held to \a added_bytes, which the caller must
+   * report to cache_budget::add_bytes() once it has released the lock.
+   */
+  detail::run_impl_cache_entry & cache_insert(const detail::fmtspec_cache_key_type & key,
+                                              shared_binary_data data,
+                                              detail::cache_entry_kind kind,
+                                              std::size_t & added_bytes);
+
+  // detail::evictable_cache interface, see cache_budget
+  std::uint64_t oldest_entry_tick(detail::cache_entry_kind kind) final;
+  std::size_t evict_oldest_entry(detail::cache_entry_kind kind) final;
+
+  latex_diagnostics _diagnostics;
+
+  std::shared_ptr<job_scheduler> _scheduler;
+  job_priority _priority;
+
 };
 
 
@@ -28,6 +28,8 @@
 
 #pragma once
 
+#include <mutex>
+
 #include <klfengine/basedefs>
 
 #include <klfengine/engine>
@@ -39,6 +41,7 @@
 namespace klfengine {
 
 class ghostscript_interface_engine_tool;
+namespace detail { class engine_workspace; }
 
 namespace engines {
 namespace klflatexpackage {
@@ -56,6 +59,11 @@ private:
                                          klfengine::settings settings_ );
 
   std::shared_ptr<klfengine::ghostscript_interface_engine_tool> _gs_iface_tool;
+
+  // directory holding klfimpl.sty, shared by all runs; created when the first
+  // run is created
+  std::shared_ptr<klfengine::detail::engine_workspace> _workspace;
+  std::mutex _workspace_mutex;
 };
 
 
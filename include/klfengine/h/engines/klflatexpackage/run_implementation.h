@@ -36,6 +36,7 @@
 namespace klfengine {
 
 class ghostscript_interface_engine_tool;
+namespace detail { class engine_workspace; class temporary_directory_pool; }
 
 namespace engines {
 namespace klflatexpackage {
@@ -47,6 +48,8 @@ class run_implementation : public klfengine::engine_run_implementation
 public:
   run_implementation(
       std::shared_ptr<klfengine::ghostscript_interface_engine_tool> gs_iface_tool_,
+      std::shared_ptr<klfengine::detail::engine_workspace> workspace_,
+      std::shared_ptr<klfengine::detail::temporary_directory_pool> temp_dir_pool_,
       klfengine::input input_,
       klfengine::settings settings_
       );
@@ -61,6 +64,9 @@ private:
       const klfengine::format_spec & format, bool check_only
       );
   virtual klfengine::binary_data impl_produce_data(const klfengine::format_spec & format);
+  virtual klfengine::shared_binary_data impl_produce_shared_data(
+      const klfengine::format_spec & format
+      );
 
   virtual std::string assemble_latex_template(const klfengine::input & input);
 };
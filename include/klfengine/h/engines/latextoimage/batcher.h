@@ -0,0 +1,208 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <chrono>
+#include <functional>
+#include <utility>
+
+#include <klfengine/basedefs>
+#include <klfengine/input>
+#include <klfengine/settings>
+#include <klfengine/latex_log>
+#include <klfengine/job_scheduler>
+#include <klfengine/h/detail/temporary_directory_pool.h>
+
+
+namespace klfengine {
+namespace engines {
+namespace latextoimage {
+
+namespace detail {
+
+
+/** \internal
+ *
+ * The LaTeX document generated for an input, in two parts: \a head is the
+ * part before <code>\\begin{document}</code>, and \a body the part between
+ * <code>\\begin{document}</code> and <code>\\end{document}</code>.
+ */
+struct latex_template_parts
+{
+  std::string head;
+  std::string body;
+};
+
+/** \internal
+ *
+ * Generate the LaTeX document for the given input (see \ref
+ * run_implementation::assemble_latex_template()).  If \a for_batch is set, the
+ * color package is always loaded and the foreground color is defined in the
+ * body, so that the head is the same for all inputs that can be compiled
+ * together in a batch.  The body has the same number of lines either way.
+ */
+latex_template_parts make_latex_template_parts(const klfengine::input & in, bool for_batch);
+
+
+/** \internal
+ *
+ * Whether the given input's LaTeX code might make global changes (counter
+ * assignments, \c \\global or \c \\gdef definitions, ...) that would
+ * affect the other inputs compiled after it in a batch.  Such inputs are not
+ * batched.
+ */
+bool may_have_global_effects(const klfengine::input & in);
+
+
+/** \internal
+ *
+ * The output of compiling several inputs together in a single LaTeX document,
+ * one input per page.  The files remain available as long as this object
+ * exists.
+ */
+struct batch_output
+{
+  explicit batch_output(klfengine::detail::temporary_directory_pool::lease temp_dir_)
+    : temp_dir(std::move(temp_dir_))
+  {
+  }
+
+  klfengine::detail::temporary_directory_pool::lease temp_dir;
+
+  fs::path tex;
+  fs::path dvi;
+  fs::path pdf;
+
+  /** The first and last line of each page's body in the batch document */
+  std::vector<std::pair<int, int> > page_lines;
+
+  latex_diagnostics diagnostics;
+
+  /** \internal
+   *
+   * The diagnostics that refer to the body of the given \a page (1-based),
+   * with their line numbers changed as if the body started on line \a
+   * body_first_line.  Diagnostics that can't be attributed to a page, such as
+   * warnings issued at the end of the document, are left out.
+   */
+  latex_diagnostics page_diagnostics(int page, int body_first_line) const;
+};
+
+
+/** \internal
+ *
+ * Coalesces the LaTeX compilations of runs that are started at about the same
+ * time and that use the same document preamble, see \ref
+ * engine::set_batching().
+ *
+ * The first run to call \ref compile() opens a batch and waits until it is
+ * full or until \a max_delay has elapsed.  Runs with a compatible input that
+ * call \ref compile() in the meantime join the batch and wait for it to be
+ * compiled.  This class is thread-safe.
+ */
+class batcher
+{
+public:
+  batcher(std::size_t max_batch_size, std::chrono::milliseconds max_delay);
+
+  inline std::size_t max_batch_size() const { return _max_batch_size; }
+  inline std::chrono::milliseconds max_delay() const { return _max_delay; }
+
+  /** \internal
+   *
+   * Where a run's input ended up in a batch.  If \a output is null, the input
+   * was not compiled in a batch and the run should compile it on its own.
+   */
+  struct placement
+  {
+    std::shared_ptr<const batch_output> output;
+    int page;
+  };
+
+  /** \internal
+   *
+   * Compile the given input together with other ones, if possible.
+   *
+   * Returns an empty placement if the input can't be compiled in a batch (if
+   * it doesn't use the LaTeX template, or if it may have global effects, see
+   * \ref may_have_global_effects()), if no other run joined the batch, or
+   * if compiling the batch failed; the run should then compile the input on
+   * its own, which also reports any errors for that specific input.
+   * The batch's working directory is taken from \a temp_dir_pool, and LaTeX is
+   * run while holding the slot returned by \a acquire_latex_stage.
+   */
+  placement compile(const klfengine::input & in,
+                    const klfengine::settings & sett,
+                    klfengine::detail::temporary_directory_pool & temp_dir_pool,
+                    const std::function<job_scheduler::slot()> & acquire_latex_stage);
+
+private:
+  struct pending_batch
+  {
+    std::string latex_engine;
+    std::string head;
+    klfengine::settings settings;
+    std::vector<std::string> pages;
+    bool closed;
+    std::promise<std::shared_ptr<const batch_output> > promise;
+    std::shared_future<std::shared_ptr<const batch_output> > result;
+  };
+
+  const std::size_t _max_batch_size;
+  const std::chrono::milliseconds _max_delay;
+
+  std::mutex _mutex;
+  std::condition_variable _cond;
+  std::vector<std::shared_ptr<pending_batch> > _open_batches;
+
+  std::shared_ptr<const batch_output> compile_batch(
+      const pending_batch & batch,
+      std::vector<std::string> pages,
+      klfengine::detail::temporary_directory_pool & temp_dir_pool,
+      const std::function<job_scheduler::slot()> & acquire_latex_stage
+  );
+};
+
+
+} // namespace detail
+
+} // namespace latextoimage
+} // namespace engines
+} // namespace klfengine
+
+
+#ifndef _KLFENGINE_DONT_INCLUDE_IMPL_HXX
+#include <klfengine/impl/engines/latextoimage/batcher.hxx>
+#endif
@@ -28,6 +28,8 @@
 
 #pragma once
 
+#include <chrono>
+
 #include <klfengine/basedefs>
 
 #include <klfengine/engine>
@@ -43,11 +45,73 @@ class ghostscript_interface_engine_tool;
 namespace engines {
 namespace latextoimage {
 
+namespace detail { class batcher; }
+
 class engine : public klfengine::engine {
 public:
   engine();
   virtual ~engine();
 
+  /** \brief Render PNG images directly from the DVI file using \c dvipng
+   *
+   * When enabled, runs that use the \c "latex" engine (i.e., that produce DVI
+   * output) create PNG images by running \c dvipng on the DVI file, instead of
+   * going through \c dvips and Ghostscript.  In this case \c dvips and the
+   * Ghostscript bounding box computation are only run if another format that
+   * requires them is requested.
+   *
+   * The \c dvipng route is only taken for PNG images with zero margins (\c
+   * dvipng has no notion of margins around the tight bounding box); other
+   * requests transparently fall back to the Ghostscript route.  If \c dvipng
+   * cannot be found in the TeX binary directory, a warning is issued and the
+   * Ghostscript route is used as well.
+   *
+   * This setting applies to runs created after calling this method.  It is
+   * disabled by default.
+   */
+  void set_use_dvipng(bool use_dvipng);
+  inline bool use_dvipng() const { return _use_dvipng; }
+
+  /** \brief Compile runs started at about the same time in a single document
+   *
+   * When enabled, a run that is compiled waits for up to \a max_delay for
+   * other runs to be compiled with the same LaTeX engine, document class,
+   * preamble and settings.  These are then compiled together, each input on a
+   * separate page of a single document, which saves LaTeX's startup and
+   * preamble processing for all but the first one.  At most \a max_batch_size
+   * inputs are compiled together; a batch is compiled as soon as it is full.
+   * Runs are typically compiled from different threads for this to be useful,
+   * since compile() blocks until the batch is compiled.
+   *
+   * The remaining steps (Ghostscript, dvipng, ...) are carried out by each run
+   * on its own page.  The \c LATEX format of a run is its own document, as it
+   * would have been compiled on its own, and its diagnostics are those
+   * reported for the lines of its own input.  The raw \c DVI and \c PDF
+   * formats contain the whole batch, so they are not available for runs that
+   * were compiled in a batch.
+   *
+   * If the batch doesn't compile, or if any input doesn't end up on exactly
+   * one page, each run compiles its input on its own instead.  Inputs that
+   * don't use the LaTeX template (see the \c use_latex_template input
+   * parameter) are never batched.
+   *
+   * Each input is compiled in a TeX group, with the page and equation counters
+   * reset, so that its local definitions don't affect the following inputs.
+   * Global assignments are not undone by the group, however, so inputs whose
+   * code contains commands such as \c \\global, \c \\gdef, \c
+   * \\setcounter, \c \\stepcounter, \c \\pagenumbering or \c \\input
+   * are never batched either.  This check is textual: code that makes global
+   * changes through macros defined in the preamble is not detected, so only
+   * enable batching for inputs whose preamble doesn't provide such macros.
+   *
+   * A \a max_batch_size smaller than 2 disables batching (the default).  This
+   * setting applies to runs created after calling this method.
+   */
+  void set_batching(std::size_t max_batch_size,
+                    std::chrono::milliseconds max_delay = std::chrono::milliseconds{5});
+  inline std::size_t batch_max_size() const { return _batch_max_size; }
+  inline std::chrono::milliseconds batch_max_delay() const { return _batch_max_delay; }
+
 private:
   // reimplemented from klfengine::engine
   void adjust_for_new_settings(klfengine::settings & settings);
@@ -56,6 +120,13 @@ private:
                                          klfengine::settings settings_ );
 
   std::shared_ptr<klfengine::ghostscript_interface_engine_tool> _gs_iface_tool;
+
+  bool _use_dvipng;
+
+  std::size_t _batch_max_size;
+  std::chrono::milliseconds _batch_max_delay;
+  // null if batching is disabled
+  std::shared_ptr<detail::batcher> _batcher;
 };
 
 
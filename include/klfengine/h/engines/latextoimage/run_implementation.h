@@ -35,19 +35,24 @@
 
 namespace klfengine {
 class ghostscript_interface_engine_tool;
+namespace detail { class temporary_directory_pool; }
 
 namespace engines {
 namespace latextoimage {
 
 struct run_implementation_private;
+namespace detail { class batcher; }
 
 class run_implementation : public klfengine::engine_run_implementation
 {
 public:
   run_implementation(
     std::shared_ptr<klfengine::ghostscript_interface_engine_tool> gs_iface_tool_,
+    std::shared_ptr<klfengine::detail::temporary_directory_pool> temp_dir_pool_,
     klfengine::input input_,
-    klfengine::settings settings_
+    klfengine::settings settings_,
+    bool use_dvipng_ = false,
+    std::shared_ptr<detail::batcher> batcher_ = nullptr
     );
   virtual ~run_implementation();
 
@@ -60,8 +65,20 @@ private:
       const klfengine::format_spec & format, bool check_only
       );
   virtual klfengine::binary_data impl_produce_data(const klfengine::format_spec & format);
+  virtual klfengine::shared_binary_data impl_produce_shared_data(
+      const klfengine::format_spec & format
+      );
 
   virtual std::string assemble_latex_template(const klfengine::input & input);
+
+  void run_dvips();
+  std::vector<std::string> gs_page_args() const;
+  void compute_gs_bbox();
+  void ensure_gs_input_ready();
+  bool can_use_dvipng(const klfengine::format_spec & format);
+  klfengine::shared_binary_data produce_png_with_dvipng(
+      klfengine::parameter_taker & param
+      );
 };
 
 
@@ -32,6 +32,7 @@
 #include <klfengine/settings>
 #include <klfengine/process>
 #include <klfengine/format>
+#include <klfengine/h/detail/gs_process_server.h>
 
 namespace klfengine {
 
@@ -54,13 +55,26 @@ public:
  * library API (either linked at compile-time or by loading \c "libgs.so" at
  * run-time).  The way Ghostscript is invoked is specified as the \a method,
  * which can be either \a ghostscript_interface::method::Process (or "process"),
- * \a ghostscript_interface::method::LinkedLibgs (or "linked-libgs"), or \a
+ * \a ghostscript_interface::method::ProcessServer (or "process-server"), \a
+ * ghostscript_interface::method::LinkedLibgs (or "linked-libgs"), or \a
  * ghostscript_interface::method::LoadLibgs (or "load-libgs").
  *
  * Depending on the \a method, the corresponding specified \a gs_path should
- * either be the path to the \c "gs" executable (for the \a Process method) or
- * the path to the \c "libgs.so" library (for the \a LoadLibgs method).  The
- * argument \a gs_path is unused if the method is \a LinkedLibgs.
+ * either be the path to the \c "gs" executable (for the \a Process and \a
+ * ProcessServer methods) or the path to the \c "libgs.so" library (for the \a
+ * LoadLibgs method).  The argument \a gs_path is unused if the method is \a
+ * LinkedLibgs.
+ *
+ * The \a ProcessServer method keeps a small pool of resident \c "gs"
+ * processes running (see \ref process_server_options) and sends them jobs
+ * over their standard input, which saves the cost of starting up Ghostscript
+ * for every call.  Calls to \ref run_gs() whose arguments can't be faithfully
+ * translated into a server job (e.g., if they read from standard input or use
+ * unusual switches) transparently fall back to running a separate process, as
+ * with the \a Process method.  The server processes run with \c -dSAFER and
+ * are only granted file access to the directories listed in \a
+ * process_server_options::permitted_paths.  This method requires Ghostscript
+ * 9.50 or later and a POSIX system, otherwise it behaves like \a Process.
  *
  * The \a method and \a gs_path are fixed once and for all for the lifetime of
  * this class instance.  See \ref klfengine::ghostscript_interface_engine_tool
@@ -77,25 +91,60 @@ public:
     None,
     Process,
     LinkedLibgs,
-    LoadLibgs
+    LoadLibgs,
+    ProcessServer
   };
   /** \brief Return the method enum member associated to the given method name
    *
-   * Parses the strings "none", "process", "linked-libgs", and "load-libgs" to
-   * their corresponding \ref method enum members.
+   * Parses the strings "none", "process", "process-server", "linked-libgs", and
+   * "load-libgs" to their corresponding \ref method enum members.
    */
   static method parse_method(const std::string & method_s);
 
+  /** \brief Options for the \a ProcessServer method
+   *
+   * The \a pool_size is the maximal number of resident Ghostscript processes
+   * that are run concurrently.  The server processes are only allowed to read
+   * and write files located inside the directories given in \a
+   * permitted_paths (typically, the directory where temporary files are
+   * created, see \ref klfengine::settings::temporary_directory).  A job that
+   * doesn't finish within \a job_timeout_ms milliseconds (zero means no limit)
+   * fails with a \ref ghostscript_error, and the server process running it is
+   * killed and replaced.
+   *
+   * These options are ignored for all other methods.
+   */
+  struct process_server_options {
+    process_server_options(int pool_size_ = 1,
+                           std::vector<std::string> permitted_paths_ = {},
+                           int job_timeout_ms_ = 300000)
+      : pool_size(pool_size_),
+        permitted_paths(std::move(permitted_paths_)),
+        job_timeout_ms(job_timeout_ms_)
+    { }
+    int pool_size;
+    std::vector<std::string> permitted_paths;
+    int job_timeout_ms;
+  };
+
   /** \brief Constructor, providing \a method and an associated \a gs_path
    */
-  explicit ghostscript_interface(method method_, std::string gs_path = std::string());
+  explicit ghostscript_interface(
+      method method_,
+      std::string gs_path = std::string(),
+      process_server_options server_options = process_server_options{1, {}}
+  );
 
   /** \brief Constructor, providing \a method and an associated \a gs_path
    *
    * This overload is provided for convenience and enables you to specify the
    * method as a string. See \ref parse_method().
    */
-  explicit ghostscript_interface(std::string method_s, std::string gs_path = std::string());
+  explicit ghostscript_interface(
+      std::string method_s,
+      std::string gs_path = std::string(),
+      process_server_options server_options = process_server_options{1, {}}
+  );
   ~ghostscript_interface();
 
   /** \brief Returns the method being used to run Ghostscript
@@ -109,6 +158,10 @@ public:
    */
   const std::string & gs_path() const;
 
+  /** \brief Returns the options used for the \a ProcessServer method
+   */
+  const process_server_options & gs_process_server_options() const;
+
   // gs information
 
   /** \brief Store information about Ghostscript
@@ -426,11 +479,37 @@ public:
       const format_spec & format
   );
 
+  /** \brief Canonical format, taking the parameters from a parameter_taker
+   *
+   * Same as \ref canonical_format() for the format named \a format_name, but
+   * the format parameters are take()en from \a param.  This way an engine can
+   * handle its own parameters and forward the remaining ones here, without
+   * copying them into a new \ref format_spec.  The caller is responsible for
+   * calling param.finished() afterwards.
+   *
+   * Throws \ref no_such_format if the format can't be produced.
+   */
+  format_spec take_canonical_format(const std::string & format_name,
+                                    parameter_taker & param);
+
+  /** \brief Ghostscript arguments, taking the parameters from a parameter_taker
+   *
+   * Same as \ref get_device_args_for_format(), with the format parameters
+   * take()en from \a param.  Unlike get_device_args_for_format(), this
+   * function expects the parameters to be in canonical form already (e.g. as
+   * given by \ref take_canonical_format()).
+   */
+  std::vector<std::string> take_device_args_for_format(const std::string & format_name,
+                                                       parameter_taker & param);
+
 private:
   virtual std::vector<format_description> impl_available_formats();
   virtual format_spec impl_make_canonical(const format_spec & format,
                                           bool check_available_only);
 
+  format_spec _make_canonical_taking(const std::string & format_name,
+                                     parameter_taker & param);
+
   ghostscript_interface_engine_tool * _gs_iface_tool;
   value::dict _param_defaults;
 };
@@ -160,6 +160,35 @@ void to_json(nlohmann::json & j, const input & v);
 void from_json(const nlohmann::json & j, input & v);
 
 
+namespace detail {
+// hash an input, so that identical jobs can be looked up in an unordered_map
+// (see engine::shared_run()).  Fields that rarely differ are left out.
+template<>
+struct hash<klfengine::input>
+{
+  std::size_t operator()(klfengine::input const& in) const noexcept
+  {
+    std::size_t seed = 0;
+    hash_combine(seed, hash<std::string>{}(in.latex));
+    hash_combine(seed, hash<std::string>{}(in.math_mode.first));
+    hash_combine(seed, hash<std::string>{}(in.preamble));
+    hash_combine(seed, hash<std::string>{}(in.latex_engine));
+    hash_combine(seed, hash<double>{}(in.font_size));
+    hash_combine(seed, hash<std::uint32_t>{}(
+                     (std::uint32_t(in.fg_color.red) << 24) | (in.fg_color.green << 16)
+                     | (in.fg_color.blue << 8) | in.fg_color.alpha ));
+    hash_combine(seed, hash<std::uint32_t>{}(
+                     (std::uint32_t(in.bg_color.red) << 24) | (in.bg_color.green << 16)
+                     | (in.bg_color.blue << 8) | in.bg_color.alpha ));
+    hash_combine(seed, hash<int>{}(in.dpi));
+    hash_combine(seed, hash<double>{}(in.scale));
+    hash_combine(seed, hash<klfengine::value::dict>{}(in.parameters));
+    return seed;
+  }
+};
+} // namespace detail
+
+
 } // namespace klfengine
 
 
@@ -0,0 +1,178 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+
+#include <klfengine/basedefs>
+
+
+namespace klfengine {
+
+
+/** \brief The steps of a job that are subject to scheduling
+ *
+ * See \ref job_scheduler.
+ */
+enum class job_stage {
+  /** Running LaTeX (CPU heavy, usually short) */
+  latex = 0,
+  /** Converting DVI output to PostScript with dvips */
+  dvips,
+  /** Computing the bounding box of the output with Ghostscript */
+  gs_bbox,
+  /** Rendering the final output format with Ghostscript (or with other tools
+   *  such as dvipng or dvisvgm).  Renders at high resolution can use a lot of
+   *  memory. */
+  gs_render
+};
+
+/** \brief The number of different \ref job_stage values */
+constexpr std::size_t num_job_stages = 4;
+
+/** \brief Priority class of a job
+ *
+ * Jobs waiting for a \ref job_stage are started in the order they arrived,
+ * except that interactive jobs are always started before batch jobs.
+ */
+enum class job_priority {
+  /** A user is waiting for the result */
+  interactive = 0,
+  /** Background work that can wait */
+  batch
+};
+
+
+/** \brief Limit the number of jobs running each stage at the same time
+ *
+ * LaTeX runs are mostly CPU bound, whereas Ghostscript renders at a high
+ * resolution can use large amounts of memory.  A job_scheduler allows
+ * different concurrency limits for the different stages of the jobs (see \ref
+ * job_stage).  Engines call \ref acquire() before running each of these
+ * stages, and hold on to the returned \ref slot until they are done.
+ *
+ * An engine uses its own scheduler by default (see \ref
+ * engine::set_scheduler()); engines can share a single scheduler to apply
+ * the limits across all of them.  By default, there are no limits.
+ *
+ * This class is thread-safe.  The scheduler must outlive all slots it handed
+ * out.
+ */
+class job_scheduler
+{
+public:
+  /** \brief A permission to run a stage
+   *
+   * The slot is given back to the scheduler when this object is destroyed, or
+   * when \ref release() is called.  A default-constructed slot is empty.
+   */
+  class slot
+  {
+  public:
+    slot() noexcept : _s(nullptr), _stage(job_stage::latex) { }
+    slot(slot && other) noexcept
+      : _s(other._s), _stage(other._stage)
+    {
+      other._s = nullptr;
+    }
+    slot & operator=(slot && other) noexcept;
+    slot(const slot & ) = delete;
+    slot & operator=(const slot & ) = delete;
+    ~slot() { release(); }
+
+    /** \brief Whether this slot is held (and not released yet) */
+    bool held() const noexcept { return _s != nullptr; }
+
+    /** \brief Give this slot back to the scheduler
+     *
+     * Does nothing if the slot is empty or was already released.
+     */
+    void release() noexcept;
+
+  private:
+    friend class job_scheduler;
+    slot(job_scheduler * s, job_stage stage) noexcept : _s(s), _stage(stage) { }
+
+    job_scheduler * _s;
+    job_stage _stage;
+  };
+
+  job_scheduler();
+
+  /** \brief Set how many jobs may run the given stage at the same time
+   *
+   * A value of zero means no limit (the default).  Jobs that are already
+   * running are not affected if the limit is lowered.
+   */
+  void set_max_concurrent(job_stage stage, std::size_t max_concurrent);
+  /** \brief How many jobs may run the given stage at the same time
+   *
+   * See \ref set_max_concurrent().
+   */
+  std::size_t max_concurrent(job_stage stage) const;
+
+  /** \brief Wait until the given stage may be run
+   *
+   * Blocks until a slot for \a stage is available and all jobs of the same or
+   * a higher \a priority that have been waiting before were started.
+   */
+  slot acquire(job_stage stage, job_priority priority = job_priority::interactive);
+
+  /** \brief The number of slots currently held for the given stage */
+  std::size_t num_running(job_stage stage) const;
+  /** \brief The number of jobs currently waiting for the given stage */
+  std::size_t num_waiting(job_stage stage) const;
+
+private:
+  struct stage_state {
+    std::size_t max_concurrent;
+    std::size_t num_running;
+    // tickets handed out to and admitted from the waiting jobs of each
+    // priority class, for FIFO order
+    std::uint64_t next_ticket[2];
+    std::uint64_t now_serving[2];
+    std::condition_variable cond;
+  };
+
+  mutable std::mutex _mutex;
+  stage_state _stages[num_job_stages];
+
+  void release_slot(job_stage stage);
+};
+
+
+} // namespace klfengine
+
+
+#ifndef _KLFENGINE_DONT_INCLUDE_IMPL_HXX
+#include <klfengine/impl/job_scheduler.hxx>
+#endif
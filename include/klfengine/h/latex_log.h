@@ -0,0 +1,193 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <klfengine/basedefs>
+#include <klfengine/process>
+
+
+namespace klfengine {
+
+
+/** \brief The type of a \ref latex_diagnostic
+ */
+enum class latex_diagnostic_kind {
+  /** \brief A TeX error, such as <code>Undefined control sequence.</code> */
+  Error,
+  /** \brief A required input file could not be found
+   *
+   * For this kind of diagnostic, the \a file member of \ref latex_diagnostic
+   * is the name of the file that couldn't be found.
+   */
+  MissingFile,
+  /** \brief A LaTeX, class or package warning */
+  Warning,
+  /** \brief An <code>Overfull \\hbox</code> or <code>\\vbox</code> */
+  OverfullBox,
+  /** \brief An <code>Underfull \\hbox</code> or <code>\\vbox</code> */
+  UnderfullBox
+};
+
+/** \brief A single diagnostic message reported by LaTeX
+ */
+struct latex_diagnostic
+{
+  latex_diagnostic_kind kind;
+
+  /** \brief The file where the problem was reported, if known (may be empty)
+   *
+   * For \ref latex_diagnostic_kind::MissingFile, this is the name of the file
+   * that could not be found.
+   */
+  std::string file;
+
+  /** \brief The input line number the message refers to, or -1 if unknown
+   */
+  int line;
+
+  /** \brief The message itself, without any <code>file:line:</code> or
+   *         <code>!</code> prefix
+   */
+  std::string message;
+};
+
+bool operator==(const latex_diagnostic & a, const latex_diagnostic & b);
+bool operator!=(const latex_diagnostic & a, const latex_diagnostic & b);
+
+
+/** \brief All the diagnostics reported by a LaTeX run, in order of appearance
+ */
+struct latex_diagnostics
+{
+  std::vector<latex_diagnostic> entries;
+
+  /** \brief Whether there are any errors (including missing files)
+   */
+  bool has_errors() const;
+
+  /** \brief Return the first error or missing file, or \a nullptr
+   */
+  const latex_diagnostic * first_error() const;
+
+  /** \brief The number of diagnostics of the given kind
+   */
+  std::size_t count(latex_diagnostic_kind kind) const;
+};
+
+
+/** \brief Parse TeX console/log output into \ref latex_diagnostics
+ *
+ * Feed the output of a TeX process (as it is received, in chunks of arbitrary
+ * size) with \ref feed(), and call \ref finish() once the output is complete.
+ * The parser only keeps the current incomplete line in memory, and does not use
+ * regular expressions.
+ *
+ * The parser understands the messages printed by TeX with
+ * <code>-file-line-error</code> (<code>./file.tex:12: Undefined control
+ * sequence.</code>) as well as the traditional <code>! ...</code> error
+ * messages followed by an <code>l.12 ...</code> context line.  It further
+ * recognizes LaTeX, class, package and pdfTeX warnings, overfull and underfull
+ * boxes, and missing files.
+ *
+ * TeX wraps its output lines at \a max_print_line characters (79 by default).
+ * Long messages are only parsed reliably if TeX is instructed not to wrap
+ * lines, e.g., by setting the \a max_print_line environment variable to a large
+ * value when running TeX.
+ */
+class latex_log_parser
+{
+public:
+  latex_log_parser();
+
+  /** \brief Process some more TeX output
+   */
+  void feed(const char * data, std::size_t size);
+
+  /** \brief Process some more TeX output
+   */
+  inline void feed(const binary_data & data) {
+    feed(reinterpret_cast<const char *>(data.data()), data.size());
+  }
+
+  /** \brief Process any last incomplete line
+   *
+   * Call this after all output has been fed to the parser.
+   */
+  void finish();
+
+  /** \brief The diagnostics collected so far
+   */
+  inline const latex_diagnostics & diagnostics() const { return _diagnostics; }
+
+  /** \brief Convenience function to parse a complete TeX output at once
+   */
+  static latex_diagnostics parse(const binary_data & data);
+
+private:
+  void process_line(const char * begin, const char * end);
+
+  latex_diagnostics _diagnostics;
+
+  std::string _partial_line;
+
+  // set after an error message, while we look for the "l.NN" context line
+  bool _expecting_error_context;
+};
+
+
+/** \brief LaTeX failed to compile the document
+ *
+ * Thrown by engines when the LaTeX process exits with an error.  The \ref
+ * diagnostics() describe what went wrong.  This exception derives from \ref
+ * process_exit_error for compatibility.
+ */
+class latex_compile_error : public process_exit_error
+{
+public:
+  latex_compile_error(std::string msg, latex_diagnostics diagnostics_);
+  virtual ~latex_compile_error();
+
+  inline const latex_diagnostics & diagnostics() const { return _diagnostics; }
+
+private:
+  latex_diagnostics _diagnostics;
+};
+
+
+
+} // namespace klfengine
+
+
+
+#ifndef _KLFENGINE_DONT_INCLUDE_IMPL_HXX
+#include <klfengine/impl/latex_log.hxx>
+#endif
@@ -31,6 +31,7 @@
 #include <memory> // std::unique_ptr
 #include <atomic>
 #include <mutex>
+#include <functional>
 
 #include <klfengine/engine_run_implementation>
 #include <klfengine/format>
@@ -67,8 +68,12 @@ struct dont_call_compile_twice : klfengine::exception
  *
  * Instances of klfengine::run are returned by \ref klfengine::engine::run().
  *
- * All members of this base class are thread-safe, protected by a
- * class-instance-wide mutex lock upon entry in each method.
+ * All members of this base class are thread-safe.  Most of them are protected
+ * by a class-instance-wide mutex lock upon entry in each method.  The methods
+ * that retrieve data (\ref get_data(), \ref get_data_cref(), \ref
+ * get_data_shared() and \ref write_data()) don't take this lock, so that
+ * different formats can be produced in parallel from different threads; the
+ * engine_run_implementation ensures that each format is produced only once.
  *
  * \note This class doesn't inherit from \ref klfengine::format_provider because
  *       it relays calls directly to the engine_run_implementation instance
@@ -167,9 +172,59 @@ public:
    * a const reference to an internal data structure where the data is stored.
    * This method avoids an unecessary copy if you only need read-only access to
    * the data.  Do NOT attempt to modify the data please!
+   *
+   * The referenced data is kept for as long as the run exists; it is never
+   * evicted by \ref cache_budget.
    */
   const binary_data & get_data_cref(const format_spec & format);
 
+  /** \brief Get a shared, read-only handle to the output data
+   *
+   * This function behaves like \ref get_data(), except that it returns a
+   * reference-counted handle to the data stored in the internal cache.  No data
+   * is copied, and unlike the reference returned by \ref get_data_cref(), the
+   * returned object may outlive this run object.
+   */
+  shared_binary_data get_data_shared(const format_spec & format);
+
+  /** \brief Callback that receives output data, see \ref write_data()
+   *
+   * May be called several times with consecutive chunks of the data.
+   */
+  using data_writer = std::function<void(const std::uint8_t * data, std::size_t size)>;
+
+  /** \brief Write output data for a requested format to a sink
+   *
+   * Produces the data for \a format as \ref get_data() would, and passes it
+   * on to \a writer without making any copy of it.  Large output files are
+   * memory-mapped by the engines, so the data is read directly from the
+   * produced file.  No lock is held while \a writer is called, so a slow
+   * consumer doesn't block other calls on this run.
+   *
+   * If \a store_in_cache is \a false, data that isn't in the cache yet is not
+   * kept after it was written.  This saves memory if you know that you won't
+   * need the same format again, but the data is produced again if you do.
+   */
+  void write_data(const format_spec & format, const data_writer & writer,
+                  bool store_in_cache = true);
+
+  /** \brief Write output data for a requested format to a file descriptor
+   *
+   * Same as the other overload, writing all the data to the open file (or
+   * socket, pipe, ...) descriptor \a fd.  Throws \a std::system_error if
+   * writing fails.
+   */
+  void write_data(const format_spec & format, int fd, bool store_in_cache = true);
+
+  /** \brief Diagnostics (errors, warnings, ...) reported by LaTeX
+   *
+   * Returns the errors, warnings, overfull boxes, missing files, etc. that
+   * were found in the LaTeX output while compiling.  This method may also be
+   * called if compile() failed with a \ref latex_compile_error, in which case
+   * it returns the same diagnostics as carried by the exception.
+   */
+  latex_diagnostics diagnostics();
+
 
   // no copy, move, or assignment operators.
   run(const run &) = delete;
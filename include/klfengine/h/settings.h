@@ -28,6 +28,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <map>
@@ -62,9 +63,15 @@ struct settings
 {
   /** \brief A location where we can create temporary files and directories
    *
-   * This can be something like "/tmp".  The method \ref detect_settings() tries
-   * to find a standard system temporary directory.
+   * This can be something like "/tmp".  The method \ref detect_settings()
+   * prefers a RAM-backed location (a tmpfs such as <code>/dev/shm</code>) if
+   * one is available with enough free space, so that the intermediate files
+   * written and read back by latex, dvips and Ghostscript don't hit the disk.
+   * If empty, the standard system temporary directory is used.
    *
+   * Engines should not use this field directly but call \ref
+   * get_temporary_directory_path(), which falls back to the system temporary
+   * directory if this location runs short on space.
    */
   std::string temporary_directory;
 
@@ -85,14 +92,16 @@ struct settings
   /** \brief How to invoke Ghostscript (external process, linked C library, or
    *         library loaded at run-time)
    *
-   * This is one of "none", "process", "linked-libgs", "load-libgs".
-   *
+   * This is one of "none", "process", "process-server", "linked-libgs",
+   * "load-libgs".  The "process-server" method keeps resident Ghostscript
+   * processes around to avoid paying Ghostscript's startup time on every call;
+   * see \ref klfengine::ghostscript_interface.
    */
   std::string gs_method;
 
   /** \brief Path to the Ghostscript \c gs executable
    *
-   * Used in case \a gs_method is set to \c "process".
+   * Used in case \a gs_method is set to \c "process" or \c "process-server".
    */
   std::string gs_executable_path;
 
@@ -110,6 +119,59 @@ struct settings
    */
   std::map<std::string, std::string> subprocess_add_environment;
 
+  /** \brief Maximal number of resident Ghostscript processes
+   *
+   * Used in case \a gs_method is set to \c "process-server".  This many
+   * Ghostscript jobs can be processed concurrently; further jobs wait until a
+   * server process becomes available.
+   */
+  int gs_process_server_pool_size = 1;
+
+  /** \brief Maximal time a job may take in a resident Ghostscript process
+   *
+   * Used in case \a gs_method is set to \c "process-server".  A job that takes
+   * longer than this many milliseconds fails, and the server process running
+   * it is killed and replaced.  Zero means no limit.
+   */
+  int gs_process_server_job_timeout_ms = 300000;
+
+  /** \brief Stop LaTeX at the first error
+   *
+   * If set, LaTeX engines are run with <code>-halt-on-error</code>, so that
+   * failing documents fail as fast as possible.  The first error is reported
+   * in the \ref latex_compile_error exception and in \ref run::diagnostics().
+   */
+  bool latex_halt_on_error = false;
+
+  /** \brief Persistent directory for TeX font caches
+   *
+   * If non-empty, LaTeX processes are run with \a TEXMFCACHE (luaotfload) and
+   * \a XDG_CACHE_HOME (fontconfig) pointing into this
+   * directory, so that the font caches built by \c lualatex and \c xelatex
+   * survive across runs and processes instead of being rebuilt in cold
+   * environments.  See also \ref engine::warm_up_font_caches().
+   *
+   * If empty (the default), the environment is left as is.
+   */
+  std::string font_cache_directory{};
+
+  /** \brief Minimal free space required in \a temporary_directory
+   *
+   * If the file system of \a temporary_directory has fewer than this many
+   * bytes available, \ref get_temporary_directory_path() falls back to the
+   * standard system temporary directory.  This guards against filling up a
+   * small RAM-backed file system.  A value of zero or less disables the check.
+   */
+  std::int64_t temporary_directory_min_free_bytes = 64 * 1024 * 1024;
+
+  /** \brief Get the directory in which to create temporary files now
+   *
+   * Returns \ref temporary_directory if it is set and if it has at least \ref
+   * temporary_directory_min_free_bytes bytes available.  Otherwise, returns the
+   * standard system temporary directory.
+   */
+  std::string get_temporary_directory_path() const;
+
   /** \brief Get the path to a latex executable in texbin_directory
    *
    * Ensures that an executable called \a exe_name (or \a exe_name .exe on
@@ -141,6 +203,24 @@ struct settings
       const std::vector<std::string> & extra_paths = std::vector<std::string>{}
       );
 
+  /** \brief Like \ref detect_settings(), but cache the results on disk
+   *
+   * The detected settings are stored in the JSON file \a cache_file along with
+   * the information needed to check whether they are still up to date: the \a
+   * extra_paths, the value of \a $PATH, and the modification times of the
+   * detected executables and libraries and of the (non-wildcard) directories
+   * that are searched.  If all of these still match, the cached settings are
+   * returned without probing the file system any further.  Otherwise, the full
+   * detection runs and the cache file is rewritten.
+   *
+   * A missing, unreadable or corrupt cache file simply triggers a full
+   * detection.  Failure to write the cache file is reported as a warning.
+   */
+  static settings detect_settings_cached(
+      const std::string & cache_file,
+      const std::vector<std::string> & extra_paths = std::vector<std::string>{}
+      );
+
   /** \brief Collect the paths where we should search for latex and ghostscript
    *
    * You should not normally need this function if you use \ref
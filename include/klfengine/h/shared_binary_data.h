@@ -0,0 +1,136 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+
+#include <klfengine/basedefs>
+
+
+namespace klfengine {
+
+
+/** \brief Immutable, reference-counted output data
+ *
+ * A \a shared_binary_data holds a read-only chunk of bytes, such as the output
+ * data of a \ref run in a given format (see \ref run::get_data_shared()).
+ * Copying a \a shared_binary_data object is cheap, as it only copies a
+ * reference to the same underlying buffer.  The buffer is released when the
+ * last \a shared_binary_data referring to it is destroyed; in particular, it
+ * may outlive the \ref run that produced it.
+ *
+ * The data can be accessed as a raw memory range with \ref data() and \ref
+ * size(), or as a \ref binary_data object with \ref binary().
+ *
+ * All const methods of this class are thread-safe.
+ */
+class shared_binary_data
+{
+public:
+  /** \brief Construct an empty data buffer */
+  shared_binary_data();
+
+  /** \brief Take ownership of the given data
+   *
+   * Pass an rvalue (use \a std::move) to avoid copying the data.
+   */
+  explicit shared_binary_data(binary_data data);
+
+  /** \brief Share the given data */
+  explicit shared_binary_data(std::shared_ptr<const binary_data> data);
+
+  /** \brief Refer to \a size bytes at \a data, which are kept alive by \a owner
+   *
+   * This allows to expose memory that isn't held in a \ref binary_data object
+   * (e.g. a memory-mapped file, see \ref detail::load_file_shared()).  The
+   * memory must remain valid and unchanged for as long as \a owner is alive.
+   */
+  shared_binary_data(std::shared_ptr<const void> owner,
+                     const std::uint8_t * data,
+                     std::size_t size);
+
+  /** \brief Pointer to the first byte of the data */
+  inline const std::uint8_t * data() const { return _data; }
+  /** \brief The number of bytes of data */
+  inline std::size_t size() const { return _size; }
+  /** \brief Whether the data is empty */
+  inline bool empty() const { return _size == 0; }
+
+  inline const std::uint8_t * begin() const { return _data; }
+  inline const std::uint8_t * end() const { return _data + _size; }
+
+  /** \brief Access the data as a \ref binary_data object
+   *
+   * The returned reference remains valid as long as this object, or any copy
+   * of it, is alive.
+   *
+   * If the data isn't held in a \ref binary_data object in the first place
+   * (see the constructor with an \a owner argument), then a copy is made on
+   * the first call to this method, which is then shared by all copies of this
+   * object.
+   */
+  const binary_data & binary() const;
+
+  /** \brief Whether \ref binary() returns the data without making a copy */
+  inline bool has_binary() const { return _vec != nullptr || !_lazy_copy; }
+
+  /** \brief Whether this object and \a other refer to the same buffer */
+  inline bool shares_buffer_with(const shared_binary_data & other) const
+  {
+    return _owner == other._owner;
+  }
+
+private:
+  struct lazy_copy {
+    std::once_flag once;
+    binary_data data;
+  };
+
+  std::shared_ptr<const void> _owner;
+  std::shared_ptr<lazy_copy> _lazy_copy;
+  const binary_data * _vec;
+  const std::uint8_t * _data;
+  std::size_t _size;
+};
+
+
+/** \brief Compare the contents of two data buffers */
+bool operator==(const shared_binary_data & a, const shared_binary_data & b);
+bool operator!=(const shared_binary_data & a, const shared_binary_data & b);
+
+
+
+} // namespace klfengine
+
+
+
+#ifndef _KLFENGINE_DONT_INCLUDE_IMPL_HXX
+#include <klfengine/impl/shared_binary_data.hxx>
+#endif
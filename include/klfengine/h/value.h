@@ -32,6 +32,8 @@
 #include <vector>
 #include <map>
 #include <functional>
+#include <iterator>
+#include <cstdint>
 
 
 #include <klfengine/basedefs>
@@ -52,6 +54,11 @@
 
 #endif
 
+#ifdef KLFENGINE_USE_FLAT_DICT
+// Store value::dict entries in a sorted vector instead of a std::map.
+#include <klfengine/h/detail/flat_map.h>
+#endif
+
 
 
 namespace klfengine {
@@ -87,6 +94,15 @@ using variant_type = std::variant<Args...>;
 #endif
 
 
+#ifdef KLFENGINE_USE_FLAT_DICT
+template<typename Key, typename T>
+using dict_type = flat_map<Key, T>;
+#else
+template<typename Key, typename T>
+using dict_type = std::map<Key, T>;
+#endif
+
+
 // -- helpers for casting variant types --
 
 struct dummy_type {};
@@ -289,6 +305,15 @@ struct simplified_type_name<std::map<T...> >
     return "dict";
   }
 };
+#ifdef KLFENGINE_USE_FLAT_DICT
+template<typename... T>
+struct simplified_type_name<flat_map<T...> >
+{
+  static inline std::string the_name() {
+    return "dict";
+  }
+};
+#endif
 
 struct simplified_type_name_visitor
 {
@@ -308,7 +333,7 @@ struct recursive_variant_with_vector_and_map
   using this_type = recursive_variant_with_vector_and_map<PrimaryDataTypes...>;
 
   using array = std::vector<this_type>;
-  using dict = std::map<std::string,this_type>;
+  using dict = dict_type<std::string,this_type>;
 
   // !!! CAUTION !!! ANY CHANGE TO THE ORDER HERE MUST BE REFLECTED IN THE
   // FUNCTION to_json() IN value.hxx !!!
@@ -497,6 +522,12 @@ std::size_t hash_value_dict(const value::dict & d);
  *
  * <b>value::dict</b>: a typedef of <code>std::map<std::string,
  * klfengine::value></code>
+ *
+ * (If KLFENGINE_USE_FLAT_DICT is set, value::dict is instead a map-like
+ * container that stores its entries in a single sorted vector, see \ref
+ * detail::flat_map.  It is faster to build, copy, hash and compare for the
+ * small dictionaries that are used as format and input parameters.  Code that
+ * only uses the common std::map interface works with either type.)
  */
 using value = detail::value;
 
@@ -614,53 +645,44 @@ inline bool dict_do_if(const value::dict & dict, const std::string & key,
 
 namespace detail {
 
-using paramdict_type = std::map<std::string,const value*>;
-
-class paramdict_citerator : public value::dict::const_iterator
+/** \internal
+ *
+ * Set of entry indices of a value::dict that a parameter_taker has already
+ * consumed.  Dictionaries with up to 64 entries (i.e., all of them in
+ * practice) don't need any allocation.
+ */
+class paramdict_taken_set
 {
 public:
-  paramdict_citerator(value::dict::const_iterator it)
-    : value::dict::const_iterator(std::move(it))
-  {}
-
-  inline paramdict_type::value_type operator*() const
+  explicit paramdict_taken_set(std::size_t size)
+    : _bits{0}, _more()
   {
-    return std::make_pair(
-        value::dict::const_iterator::operator->()->first,
-        & value::dict::const_iterator::operator->()->second
-    );
+    if (size > 64) {
+      _more.resize(size - 64, false);
+    }
   }
 
-private:
-  inline paramdict_type::value_type operator->() const
+  inline bool test(std::size_t i) const
   {
-    throw std::runtime_error{"no operator-> for paramdict_citerator"};
+    if (i < 64) {
+      return (_bits >> i) & 1u;
+    }
+    return _more[i - 64];
   }
-};
-
-class paramdict_to_dict_citerator : public paramdict_type::const_iterator
-{
-public:
-  paramdict_to_dict_citerator(paramdict_type::const_iterator it)
-    : paramdict_type::const_iterator(std::move(it))
-  {}
-
-  inline value::dict::value_type operator*() const
+  inline void set(std::size_t i)
   {
-    return std::make_pair(
-        paramdict_type::const_iterator::operator->()->first,
-        * paramdict_type::const_iterator::operator->()->second
-    );
+    if (i < 64) {
+      _bits |= (std::uint64_t{1} << i);
+      return;
+    }
+    _more[i - 64] = true;
   }
 
 private:
-  inline value::dict::value_type operator->() const
-  {
-    throw std::runtime_error{"no operator-> for paramdict_to_dict_citerator"};
-  }
+  std::uint64_t _bits;
+  std::vector<bool> _more;
 };
 
-
 } // namespace detail
 
 
@@ -704,25 +726,18 @@ public:
   /** \brief Initialize the parameter_taker with a value::dict const reference
    *
    * The provided dictionary reference must be valid and unchanged during the
-   * entire lifetime of the present \a parameter_taker instance.
+   * entire lifetime of the present \a parameter_taker instance.  The dictionary
+   * is not copied; the parameter_taker only keeps track of which of its entries
+   * were taken.
    */
   explicit parameter_taker(const value::dict & dict_,
                            std::string what_ = std::string{})
-    : _paramdict(
-        detail::paramdict_citerator(dict_.begin()),
-        detail::paramdict_citerator(dict_.end())
-      ),
+    : _dict(dict_),
+      _taken(dict_.size()),
+      _num_remaining(dict_.size()),
       _what(what_),
       _check_all_taken_called(false)
   {
-    // for (const auto & p : dict_) {
-    //   fprintf(stderr, "DEBUG: original dictionary got item = %s, ptr = %p\n",
-    //           p.first.c_str(), & p.second);
-    // }
-    // for (const auto & p : _paramdict) {
-    //   fprintf(stderr, "DEBUG: our own pointer dictionary got item = %s, ptr = %p\n",
-    //           p.first.c_str(), p.second);
-    // }
   }
 
   /** \brief Destructor checks that all parameters were "take()en"
@@ -767,37 +782,35 @@ public:
 
   inline bool has(const std::string & key)
   {
-    auto it = _paramdict.find(key);
-    return (it != _paramdict.end());
+    return _find(key) != _dict.end();
   }
   template<typename X>
   inline bool has(const std::string & key)
   {
-    auto it = _paramdict.find(key);
-    if (it == _paramdict.end()) {
+    auto it = _find(key);
+    if (it == _dict.end()) {
       return false;
     }
-    return it->second->has_type<X>();
+    return it->second.template has_type<X>();
   }
   template<typename X>
   inline bool has_castable_to(const std::string & key)
   {
-    auto it = _paramdict.find(key);
-    if (it == _paramdict.end()) {
+    auto it = _find(key);
+    if (it == _dict.end()) {
       return false;
     }
-    return it->second->has_castable_to<X>();
+    return it->second.template has_castable_to<X>();
   }
 
   template<typename X = value>
   const X & take(const std::string & key) {
-    auto it = _paramdict.find(key);
-    if (it == _paramdict.end()) {
+    auto it = _find(key);
+    if (it == _dict.end()) {
       throw std::out_of_range("No such key in dictionary: " + key);
     }
-    const value * val = it->second;
-    _paramdict.erase(it);
-    return val->get<X>();
+    _set_taken(it);
+    return it->second.template get<X>();
   }
 
   template<typename X = value>
@@ -807,67 +820,172 @@ public:
 
   template<typename X>
   const X & take(const std::string & key, const X & dflt) {
-    auto it = _paramdict.find(key);
-    if (it == _paramdict.end()) {
+    auto it = _find(key);
+    if (it == _dict.end()) {
       return dflt;
     }
-    const value * val = it->second;
-    _paramdict.erase(it);
-    return val->get<X>();
+    _set_taken(it);
+    return it->second.template get<X>();
   }
 
   template<typename X>
   X take_cast(const std::string & key, const X & dflt) {
-    auto it = _paramdict.find(key);
-    if (it == _paramdict.end()) {
+    auto it = _find(key);
+    if (it == _dict.end()) {
       return dflt;
     }
-    const value * val = it->second;
-    _paramdict.erase(it);
-    return val->get_cast<X>();
+    _set_taken(it);
+    return it->second.template get_cast<X>();
   }
 
   template<typename X = value>
   inline bool take_and_do_if(const std::string & key,
                              std::function<void(const X&)> fn)
   {
-    auto it = _paramdict.find(key);
-    if (it == _paramdict.end()) {
+    auto it = _find(key);
+    if (it == _dict.end()) {
       return false;
     }
-    const value * val = it->second;
-    _paramdict.erase(it);
-    fn(val->get<X>());
+    _set_taken(it);
+    fn(it->second.template get<X>());
     return true;
   }
 
 
-  value::dict get_remaining() const
+  /** \brief A view of the entries that were not taken yet
+   *
+   * Iterating over this range visits the (key, value) entries of the original
+   * dictionary that haven't been taken, in key order.  No copies are made.  The
+   * view reflects later calls to \ref take().
+   */
+  class remaining_view
   {
-    return value::dict{
-      detail::paramdict_to_dict_citerator( _paramdict.begin() ),
-      detail::paramdict_to_dict_citerator( _paramdict.end() )
+  public:
+    class const_iterator
+    {
+    public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = value::dict::value_type;
+      using difference_type = std::ptrdiff_t;
+      using pointer = const value_type *;
+      using reference = const value_type &;
+
+      const_iterator(const parameter_taker * pt, value::dict::const_iterator it)
+        : _pt(pt), _it(it), _idx(static_cast<std::size_t>(
+                                     std::distance(pt->_dict.begin(), it)))
+      {
+        _skip_taken();
+      }
+
+      inline reference operator*() const { return *_it; }
+      inline pointer operator->() const { return &*_it; }
+      inline const_iterator & operator++()
+      {
+        ++_it;
+        ++_idx;
+        _skip_taken();
+        return *this;
+      }
+      inline const_iterator operator++(int)
+      {
+        const_iterator tmp = *this;
+        ++*this;
+        return tmp;
+      }
+      inline bool operator==(const const_iterator & other) const { return _it == other._it; }
+      inline bool operator!=(const const_iterator & other) const { return _it != other._it; }
+
+    private:
+      const parameter_taker * _pt;
+      value::dict::const_iterator _it;
+      std::size_t _idx;
+
+      inline void _skip_taken()
+      {
+        while (_it != _pt->_dict.end() && _pt->_taken.test(_idx)) {
+          ++_it;
+          ++_idx;
+        }
+      }
     };
+
+    explicit remaining_view(const parameter_taker * pt) : _pt(pt) { }
+
+    inline const_iterator begin() const { return const_iterator(_pt, _pt->_dict.begin()); }
+    inline const_iterator end() const { return const_iterator(_pt, _pt->_dict.end()); }
+    inline std::size_t size() const { return _pt->_num_remaining; }
+    inline bool empty() const { return _pt->_num_remaining == 0; }
+
+  private:
+    const parameter_taker * _pt;
+  };
+
+  /** \brief The parameters that haven't been taken yet, without copying them
+   *
+   * See \ref remaining_view.
+   */
+  inline remaining_view remaining() const { return remaining_view{this}; }
+
+  /** \brief Number of parameters that haven't been taken yet */
+  inline std::size_t num_remaining() const { return _num_remaining; }
+
+  /** \brief A copy of the parameters that haven't been taken yet
+   *
+   * Prefer \ref remaining(), or passing this parameter_taker on to functions
+   * that accept one, to avoid copying the values.
+   */
+  value::dict get_remaining() const
+  {
+    remaining_view rem = remaining();
+    return value::dict(rem.begin(), rem.end());
   }
   value::dict take_remaining()
   {
     value::dict rem = get_remaining();
-    _paramdict.clear();
+    _take_all();
     return rem;
   }
 
 private:
-  detail::paramdict_type _paramdict;
+  const value::dict & _dict;
+  detail::paramdict_taken_set _taken;
+  std::size_t _num_remaining;
   std::string _what;
   bool _check_all_taken_called;
 
+  // find an entry that hasn't been taken yet
+  inline value::dict::const_iterator _find(const std::string & key) const
+  {
+    auto it = _dict.find(key);
+    if (it == _dict.end() || _taken.test(_index_of(it))) {
+      return _dict.end();
+    }
+    return it;
+  }
+  inline std::size_t _index_of(value::dict::const_iterator it) const
+  {
+    return static_cast<std::size_t>(std::distance(_dict.begin(), it));
+  }
+  inline void _set_taken(value::dict::const_iterator it)
+  {
+    _taken.set(_index_of(it));
+    --_num_remaining;
+  }
+  inline void _take_all()
+  {
+    for (std::size_t i = 0; i < _dict.size(); ++i) {
+      _taken.set(i);
+    }
+    _num_remaining = 0;
+  }
+
   void _check_all_taken(bool throw_exception = true)
   {
     _check_all_taken_called = true;
-    if (!_paramdict.empty()) {
+    if (_num_remaining > 0) {
       std::string msg = "superfluous key(s) ";
       bool first = true;
-      for ( const std::pair<std::string, const value *> & p : _paramdict ) {
+      for ( const value::dict::value_type & p : remaining() ) {
         if (!first) {
           msg += ",";
         } else {
@@ -0,0 +1,140 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <limits>
+
+#include <klfengine/cache_budget>
+
+
+namespace klfengine {
+
+
+_KLFENGINE_INLINE
+cache_budget & cache_budget::instance()
+{
+  // Never destroyed: static or global runs that were created before the budget
+  // still unregister from it during static destruction
+  static cache_budget * the_budget = new cache_budget;
+  return *the_budget;
+}
+
+_KLFENGINE_INLINE
+cache_budget::cache_budget()
+  : _max_bytes(0),
+    _bytes_held(0),
+    _bytes_evicted(0),
+    _num_evictions(0),
+    _tick(0),
+    _mutex(),
+    _caches()
+{
+}
+
+_KLFENGINE_INLINE
+void cache_budget::set_max_bytes(std::size_t max_bytes)
+{
+  _max_bytes = max_bytes;
+  enforce();
+}
+
+_KLFENGINE_INLINE
+void cache_budget::register_cache(detail::evictable_cache * cache)
+{
+  std::lock_guard<std::mutex> lckgrd(_mutex);
+  _caches.push_back(cache);
+}
+
+_KLFENGINE_INLINE
+void cache_budget::unregister_cache(detail::evictable_cache * cache)
+{
+  // once we hold the lock, no eviction is using this cache anymore
+  std::lock_guard<std::mutex> lckgrd(_mutex);
+  _caches.erase(std::remove(_caches.begin(), _caches.end(), cache), _caches.end());
+}
+
+_KLFENGINE_INLINE
+void cache_budget::add_bytes(std::size_t num_bytes)
+{
+  std::size_t held = (_bytes_held += num_bytes);
+  std::size_t max = _max_bytes.load();
+  if (max > 0 && held > max) {
+    enforce();
+  }
+}
+
+_KLFENGINE_INLINE
+void cache_budget::remove_bytes(std::size_t num_bytes)
+{
+  _bytes_held -= num_bytes;
+}
+
+_KLFENGINE_INLINE
+void cache_budget::enforce()
+{
+  std::lock_guard<std::mutex> lckgrd(_mutex);
+
+  const std::uint64_t none = std::numeric_limits<std::uint64_t>::max();
+
+  for (detail::cache_entry_kind kind : { detail::cache_entry_kind::from_file,
+                                         detail::cache_entry_kind::produced }) {
+    for (;;) {
+      std::size_t max = _max_bytes.load();
+      if (max == 0 || _bytes_held.load() <= max) {
+        return;
+      }
+
+      // find the least recently used entry of this kind across all caches
+      detail::evictable_cache * victim = nullptr;
+      std::uint64_t victim_tick = none;
+      for (detail::evictable_cache * c : _caches) {
+        std::uint64_t t = c->oldest_entry_tick(kind);
+        if (t < victim_tick) {
+          victim = c;
+          victim_tick = t;
+        }
+      }
+      if (victim == nullptr) {
+        break; // nothing of this kind left, try the next kind
+      }
+
+      // (the cache accounts for the freed bytes itself; an entry that can't be
+      // obtained again after all gets pinned instead, so this loop ends)
+      std::size_t freed = victim->evict_oldest_entry(kind);
+      if (freed > 0) {
+        _bytes_evicted += freed;
+        ++_num_evictions;
+      }
+    }
+  }
+}
+
+
+} // namespace klfengine
@@ -0,0 +1,78 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <klfengine/coroutine>
+
+#ifdef KLFENGINE_HAS_COROUTINES
+
+#include <klfengine/run>
+#include <klfengine/engine>
+
+
+namespace klfengine {
+
+
+_KLFENGINE_INLINE
+awaitable<void> async_compile(klfengine::run & r, executor exec)
+{
+  return awaitable<void>{
+    [&r]() { r.compile(); },
+    std::move(exec)
+  };
+}
+
+_KLFENGINE_INLINE
+awaitable<shared_binary_data> async_get_data(klfengine::run & r, format_spec format,
+                                             executor exec)
+{
+  return awaitable<shared_binary_data>{
+    [&r, format]() { return r.get_data_shared(format); },
+    std::move(exec)
+  };
+}
+
+_KLFENGINE_INLINE
+awaitable<std::shared_ptr<klfengine::run>> async_shared_run(
+    klfengine::engine & e,
+    klfengine::input input_,
+    executor exec,
+    job_priority priority
+    )
+{
+  return awaitable<std::shared_ptr<klfengine::run>>{
+    [&e, input_, priority]() { return e.shared_run(input_, priority); },
+    std::move(exec)
+  };
+}
+
+
+} // namespace klfengine
+
+#endif // KLFENGINE_HAS_COROUTINES
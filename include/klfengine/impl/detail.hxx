@@ -1,2 +1,10 @@
 // include all detail/** hxx files
 #include <klfengine/impl/detail/filesystem.hxx>
+#include <klfengine/impl/detail/gs_process_server.hxx>
+#include <klfengine/impl/detail/dvisvgm.hxx>
+#include <klfengine/impl/detail/engine_workspace.hxx>
+#include <klfengine/impl/detail/font_cache.hxx>
+#include <klfengine/impl/detail/temporary_directory_pool.hxx>
+#include <klfengine/impl/detail/directory_reaper.hxx>
+#include <klfengine/impl/detail/mapped_file.hxx>
+#include <klfengine/impl/detail/interned_format_spec.hxx>
@@ -0,0 +1,167 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdlib> // std::atexit()
+
+#include <klfengine/h/detail/directory_reaper.h>
+
+
+namespace klfengine {
+
+namespace detail {
+
+
+_KLFENGINE_INLINE
+directory_reaper::directory_reaper(std::size_t max_backlog)
+  : _max_backlog{max_backlog},
+    _mutex{},
+    _cond_job{},
+    _cond_done{},
+    _jobs{},
+    _num_running{0},
+    _stopping{false},
+    _thread{}
+{
+}
+
+_KLFENGINE_INLINE
+directory_reaper::~directory_reaper()
+{
+  stop();
+}
+
+// static
+_KLFENGINE_INLINE
+directory_reaper & directory_reaper::instance()
+{
+  // Never destroyed: static or global objects (engines, pools, ...) that were
+  // created before the reaper might release directories during static
+  // destruction, after a function-local static reaper would be gone.  Instead,
+  // the worker is stopped at exit, which runs the pending jobs; from then on,
+  // jobs are run right away in the submitting thread.
+  static directory_reaper * the_reaper = []() {
+    directory_reaper * r = new directory_reaper;
+    std::atexit([]() { instance().stop(); });
+    return r;
+  }();
+  return *the_reaper;
+}
+
+_KLFENGINE_INLINE
+void directory_reaper::stop()
+{
+  std::thread worker_thread;
+  {
+    std::lock_guard<std::mutex> lck(_mutex);
+    _stopping = true;
+    worker_thread = std::move(_thread);
+  }
+  _cond_job.notify_all();
+  if (worker_thread.joinable()) {
+    worker_thread.join(); // the worker drains the queue before exiting
+  }
+}
+
+_KLFENGINE_INLINE
+void directory_reaper::submit(std::function<void()> job)
+{
+  {
+    std::unique_lock<std::mutex> lck(_mutex);
+    if (!_stopping && _jobs.size() < _max_backlog) {
+      if (!_thread.joinable()) {
+        _thread = std::thread{ [this]() { worker(); } };
+      }
+      _jobs.push_back(std::move(job));
+      lck.unlock();
+      _cond_job.notify_one();
+      return;
+    }
+  }
+  // backlog is full (or we're shutting down) -- do the work ourselves
+  run_job(job);
+}
+
+_KLFENGINE_INLINE
+void directory_reaper::flush()
+{
+  std::unique_lock<std::mutex> lck(_mutex);
+  _cond_done.wait(lck, [this]() { return _jobs.empty() && _num_running == 0; });
+}
+
+_KLFENGINE_INLINE
+std::size_t directory_reaper::backlog() const
+{
+  std::lock_guard<std::mutex> lck(_mutex);
+  return _jobs.size() + _num_running;
+}
+
+_KLFENGINE_INLINE
+void directory_reaper::worker()
+{
+  std::unique_lock<std::mutex> lck(_mutex);
+  for (;;) {
+    _cond_job.wait(lck, [this]() { return _stopping || !_jobs.empty(); });
+    if (_jobs.empty()) {
+      return; // stopping, and nothing left to do
+    }
+    std::function<void()> job = std::move(_jobs.front());
+    _jobs.pop_front();
+    ++_num_running;
+    lck.unlock();
+
+    run_job(job);
+    // destroy whatever the job holds (e.g. a directory) outside of the lock
+    job = nullptr;
+
+    lck.lock();
+    --_num_running;
+    if (_jobs.empty() && _num_running == 0) {
+      _cond_done.notify_all();
+    }
+  }
+}
+
+// static
+_KLFENGINE_INLINE
+void directory_reaper::run_job(const std::function<void()> & job)
+{
+  try {
+    job();
+  } catch (const std::exception & e) {
+    warn("klfengine::detail::directory_reaper",
+         std::string{"Error while cleaning up temporary files: "} + e.what());
+  }
+}
+
+
+
+} // namespace detail
+
+} // namespace klfengine
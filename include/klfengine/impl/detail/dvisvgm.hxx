@@ -0,0 +1,177 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <regex>
+#include <string>
+
+#include <klfengine/basedefs>
+#include <klfengine/process>
+#include <klfengine/h/detail/utils.h>
+#include <klfengine/h/detail/dvisvgm.h>
+
+
+namespace klfengine {
+
+namespace detail {
+
+
+_KLFENGINE_INLINE
+binary_data run_dvisvgm(const settings & sett,
+                        const fs::path & input_file,
+                        const dvisvgm_options & opts,
+                        int page)
+{
+  std::vector<std::string> argv{
+    sett.get_tex_executable_path("dvisvgm"),
+    "--page=" + std::to_string(page),
+    "--verbosity=1", // only report errors
+    "--stdout"
+  };
+  if (opts.input_is_pdf) {
+    argv.push_back("--pdf");
+  }
+  if (!sett.gs_libgs_path.empty()) {
+    // for PDF input and PostScript specials, use the same Ghostscript as we do
+    argv.push_back("--libgs=" + sett.gs_libgs_path);
+  }
+  if (opts.outline_fonts) {
+    argv.push_back("--no-fonts");
+  }
+  if (opts.tight_bbox) {
+    argv.push_back("--bbox=min");
+    argv.push_back("--exact-bbox");
+  } else {
+    argv.push_back("--bbox=papersize");
+  }
+  argv.push_back(input_file.filename().native());
+
+  binary_data svg_out;
+  binary_data dvisvgm_err;
+
+  process::run_and_wait(
+      argv,
+      process::run_in_directory{ input_file.parent_path().native() },
+      process::capture_stdout_data{&svg_out},
+      process::capture_stderr_data{&dvisvgm_err}
+      );
+
+  if (svg_out.empty()) {
+    throw std::runtime_error(
+        "dvisvgm did not produce any output: "
+        + std::string{dvisvgm_err.begin(), dvisvgm_err.end()}
+    );
+  }
+
+  return svg_out;
+}
+
+
+
+_KLFENGINE_INLINE
+std::string svg_adjust_canvas(const std::string & svg,
+                              double margin_left_bp, double margin_top_bp,
+                              double margin_right_bp, double margin_bottom_bp,
+                              double scale,
+                              const color & bg_color)
+{
+  using namespace klfengine::detail::utils;
+
+  static const std::regex rx_svg_tag{"<svg\\b[^>]*>"};
+  static const std::regex rx_viewbox{
+    "\\bviewBox\\s*=\\s*(['\"])\\s*"
+    "([0-9.eE+-]+)[\\s,]+([0-9.eE+-]+)[\\s,]+([0-9.eE+-]+)[\\s,]+([0-9.eE+-]+)"
+    "\\s*\\1"
+  };
+  static const std::regex rx_width_height{"\\s(width|height)\\s*=\\s*(['\"])[^'\"]*\\2"};
+
+  std::smatch m_svg;
+  if ( ! std::regex_search(svg, m_svg, rx_svg_tag) ) {
+    throw std::runtime_error("Couldn't find <svg> element in SVG data");
+  }
+  const std::string svg_tag{m_svg[0].str()};
+
+  std::smatch m_vb;
+  if ( ! std::regex_search(svg_tag, m_vb, rx_viewbox) ) {
+    throw std::runtime_error("Couldn't find viewBox attribute in SVG data: " + svg_tag);
+  }
+
+  const double x = std::stod(m_vb[2].str()) - margin_left_bp;
+  const double y = std::stod(m_vb[3].str()) - margin_top_bp;
+  const double w = std::stod(m_vb[4].str()) + margin_left_bp + margin_right_bp;
+  const double h = std::stod(m_vb[5].str()) + margin_top_bp + margin_bottom_bp;
+
+  const std::string new_viewbox{
+    "viewBox='" + dbl_to_string(x) + " " + dbl_to_string(y) + " "
+    + dbl_to_string(w) + " " + dbl_to_string(h) + "'"
+  };
+
+  // replace the view box, and (re)set width & height.  SVG's "pt" unit is the
+  // big point (1/72 in).
+  std::string new_svg_tag{ std::regex_replace(svg_tag, rx_viewbox, new_viewbox) };
+  new_svg_tag = std::regex_replace(
+      new_svg_tag,
+      rx_width_height,
+      ""
+  );
+  // insert before the closing '>' (or '/>')
+  std::string::size_type close_pos = new_svg_tag.size() - 1;
+  if (close_pos > 0 && new_svg_tag[close_pos-1] == '/') {
+    --close_pos;
+  }
+  new_svg_tag.insert(close_pos,
+                     " width='" + dbl_to_string(w * scale) + "pt'"
+                     " height='" + dbl_to_string(h * scale) + "pt'");
+
+  std::string bg_rect;
+  if (bg_color.alpha > 0) {
+    bg_rect =
+      "<rect x='" + dbl_to_string(x) + "' y='" + dbl_to_string(y) + "'"
+      " width='" + dbl_to_string(w) + "' height='" + dbl_to_string(h) + "'"
+      " fill='rgb(" + std::to_string(bg_color.red) + "," + std::to_string(bg_color.green)
+      + "," + std::to_string(bg_color.blue) + ")'";
+    if (bg_color.alpha < 255) {
+      bg_rect += " fill-opacity='" + dbl_to_string(bg_color.alpha/255.0) + "'";
+    }
+    bg_rect += "/>";
+  }
+
+  std::string result;
+  result.reserve(svg.size() + bg_rect.size() + 64);
+  result.append(svg.begin(), svg.begin() + m_svg.position(0));
+  result += new_svg_tag;
+  result += bg_rect;
+  result.append(svg.begin() + m_svg.position(0) + m_svg.length(0), svg.end());
+  return result;
+}
+
+
+} // namespace detail
+
+} // namespace klfengine
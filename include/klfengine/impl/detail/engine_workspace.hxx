@@ -0,0 +1,73 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <klfengine/h/detail/engine_workspace.h>
+#include <klfengine/h/detail/utils.h>
+
+
+namespace klfengine {
+
+namespace detail {
+
+
+_KLFENGINE_INLINE
+engine_workspace::engine_workspace(fs::path temp_dir, std::string name_prefix)
+  : _temp_dir{std::move(temp_dir), std::move(name_prefix)}
+{
+}
+
+_KLFENGINE_INLINE
+fs::path engine_workspace::provide_file(const std::string & fname, const char * data)
+{
+  fs::path p = _temp_dir.path() / fname;
+
+  std::lock_guard<std::mutex> lck(_mutex);
+
+  if (_provided_files.find(fname) == _provided_files.end()) {
+    utils::dump_cstr_to_file(p.native(), data);
+    _provided_files.insert(fname);
+  }
+
+  return p;
+}
+
+_KLFENGINE_INLINE
+prepend_path_environment_variables engine_workspace::texinputs_environment() const
+{
+  return prepend_path_environment_variables{
+    {{"TEXINPUTS", _temp_dir.path().native()}}
+  };
+}
+
+
+
+} // namespace detail
+
+} // namespace klfengine
@@ -29,8 +29,14 @@
 #pragma once
 
 #include <algorithm> // std::transform
+#include <cstdlib> // getenv()
 #include <regex>
 
+#if defined(_KLFENGINE_OS_LINUX)
+#include <sys/vfs.h> // statfs()
+#include <unistd.h> // access()
+#endif
+
 #include <klfengine/basedefs>
 #include <klfengine/h/detail/utils.h>
 #include <klfengine/h/detail/filesystem.h>
@@ -344,6 +350,74 @@ std::vector<std::string> get_environment_PATH(const char * varname)
 
 
 
+_KLFENGINE_INLINE
+bool is_ram_backed_directory(const fs::path & p)
+{
+#if defined(_KLFENGINE_OS_LINUX)
+  constexpr std::uint32_t tmpfs_magic = 0x01021994;
+  constexpr std::uint32_t ramfs_magic = 0x858458f6;
+
+  struct statfs st;
+  if (::statfs(p.c_str(), &st) != 0) {
+    return false;
+  }
+  // f_type's integer type varies across architectures
+  std::uint32_t f_type = static_cast<std::uint32_t>(st.f_type);
+  return f_type == tmpfs_magic || f_type == ramfs_magic;
+#else
+  (void)p;
+  return false;
+#endif
+}
+
+_KLFENGINE_INLINE
+bool has_free_space(const fs::path & p, std::int64_t min_free_bytes)
+{
+  if (min_free_bytes <= 0) {
+    return true;
+  }
+  std::error_code ec;
+  fs::space_info si = fs::space(p, ec);
+  if (ec) {
+    return false;
+  }
+  return si.available >= static_cast<std::uintmax_t>(min_free_bytes);
+}
+
+_KLFENGINE_INLINE
+std::string detect_ram_temporary_directory(std::int64_t min_free_bytes)
+{
+#if defined(_KLFENGINE_OS_LINUX)
+  std::vector<std::string> candidates;
+  const char * tmpdir = std::getenv("TMPDIR");
+  if (tmpdir != nullptr && tmpdir[0] != '\0') {
+    candidates.push_back(tmpdir);
+  }
+  candidates.push_back("/dev/shm");
+  candidates.push_back("/run/shm");
+
+  for (const auto & c : candidates) {
+    std::error_code ec;
+    if (!fs::is_directory(c, ec)) {
+      continue;
+    }
+    if (::access(c.c_str(), W_OK | X_OK) != 0) {
+      continue;
+    }
+    if (!is_ram_backed_directory(c) || !has_free_space(c, min_free_bytes)) {
+      continue;
+    }
+    return c;
+  }
+  return std::string{};
+#else
+  (void)min_free_bytes;
+  return std::string{};
+#endif
+}
+
+
+
 } // namespace detail
 
 } // namespace klfengine
@@ -0,0 +1,69 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <klfengine/h/detail/font_cache.h>
+#include <klfengine/h/detail/filesystem.h>
+
+
+namespace klfengine {
+
+namespace detail {
+
+
+_KLFENGINE_INLINE
+environment font_cache_environment(const settings & sett)
+{
+  environment env;
+
+  if (sett.font_cache_directory.empty()) {
+    return env;
+  }
+
+  const fs::path base{sett.font_cache_directory};
+  const fs::path texmf_cache = base / "texmf-cache";
+  const fs::path xdg_cache = base / "xdg-cache";
+
+  fs::create_directories(texmf_cache);
+  fs::create_directories(xdg_cache);
+
+  // Leave TEXMFVAR alone: dvips, dvipng, dvisvgm and mktexpk would see a
+  // different one than latex, and the user's own updmap-user maps would be
+  // hidden.  Only luaotfload (and ConTeXt) use TEXMFCACHE.
+  env["TEXMFCACHE"] = texmf_cache.native();
+  // fontconfig (used by xetex) keeps its user cache in $XDG_CACHE_HOME/fontconfig
+  env["XDG_CACHE_HOME"] = xdg_cache.native();
+
+  return env;
+}
+
+
+} // namespace detail
+
+} // namespace klfengine
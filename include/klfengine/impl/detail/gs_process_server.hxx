@@ -0,0 +1,837 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <regex>
+#include <string>
+#include <system_error>
+
+#include <klfengine/basedefs>
+#include <klfengine/h/detail/gs_process_server.h>
+
+
+namespace klfengine {
+
+namespace detail {
+
+
+inline std::string gs_ps_string_literal(const std::string & s)
+{
+  std::string lit{"("};
+  lit.reserve(s.size() + 2);
+  for (const char c : s) {
+    if (c == '(' || c == ')' || c == '\\') {
+      lit += '\\';
+    }
+    lit += c;
+  }
+  lit += ")";
+  return lit;
+}
+
+inline bool gs_is_ps_number_or_bool(const std::string & s)
+{
+  static const std::regex rx_num{"^[-+]?([0-9]+[.]?[0-9]*|[.][0-9]+)([eE][-+]?[0-9]+)?$"};
+  return (s == "true" || s == "false" || std::regex_match(s, rx_num));
+}
+
+
+_KLFENGINE_INLINE
+bool gs_process_server_job_from_args(const std::vector<std::string> & gs_args,
+                                     std::string * ps_code)
+{
+  // device parameters that can be safely set with setpagedevice.  Anything
+  // else might be an interpreter switch whose effect we can't reproduce once
+  // Ghostscript is running, so we refuse it.
+  static const std::vector<std::string> known_device_params{
+    "MaxBitmap",
+    "GraphicsAlphaBits",
+    "TextAlphaBits",
+    "NoOutputFonts"
+  };
+
+  auto starts_with = [](const std::string & s, const char * prefix) {
+    return s.rfind(prefix, 0) == 0;
+  };
+
+  std::string device;
+  std::string pagedevice_params;
+  std::string width_pt;
+  std::string height_pt;
+  bool fixed_media = false;
+  std::string body;
+
+  bool in_code = false; // after "-c", until the next switch
+
+  for (const std::string & arg : gs_args) {
+    if (in_code) {
+      if (arg.empty() || arg[0] != '-') {
+        body += arg + "\n";
+        continue;
+      }
+      in_code = false;
+      // and handle this argument normally below
+    }
+
+    if (arg == "-c") {
+      in_code = true;
+      continue;
+    }
+    if (arg == "-f") {
+      // just terminates any -c code; the next argument is an input file
+      continue;
+    }
+    if (arg == "-q" || arg == "-dBATCH" || arg == "-dNOPAUSE" || arg == "-dSAFER") {
+      // the server process already runs in this mode
+      continue;
+    }
+    if (starts_with(arg, "-sDEVICE=")) {
+      device = arg.substr(9);
+      continue;
+    }
+    if (starts_with(arg, "-sOutputFile=")) {
+      std::string outputfile{arg.substr(13)};
+      if (outputfile.empty() || outputfile == "-" || outputfile[0] == '|'
+          || outputfile[0] == '%') {
+        // stdout, pipes or special files -- can't do this in a server job
+        return false;
+      }
+      pagedevice_params += "/OutputFile " + gs_ps_string_literal(outputfile) + " ";
+      continue;
+    }
+    if (starts_with(arg, "-r")) {
+      static const std::regex rx_res{"^([0-9.]+)(?:x([0-9.]+))?$"};
+      std::smatch m;
+      const std::string res_s{arg.substr(2)};
+      if ( ! std::regex_match(res_s, m, rx_res) ) {
+        return false;
+      }
+      const std::string xres{m[1].str()};
+      const std::string yres{m[2].matched ? m[2].str() : xres};
+      pagedevice_params += "/HWResolution [" + xres + " " + yres + "] ";
+      continue;
+    }
+    if (starts_with(arg, "-dDEVICEWIDTHPOINTS=")) {
+      width_pt = arg.substr(20);
+      if ( ! gs_is_ps_number_or_bool(width_pt) ) {
+        return false;
+      }
+      continue;
+    }
+    if (starts_with(arg, "-dDEVICEHEIGHTPOINTS=")) {
+      height_pt = arg.substr(21);
+      if ( ! gs_is_ps_number_or_bool(height_pt) ) {
+        return false;
+      }
+      continue;
+    }
+    if (arg == "-dFIXEDMEDIA") {
+      fixed_media = true;
+      continue;
+    }
+    if (starts_with(arg, "-d")) {
+      const std::string::size_type eqpos = arg.find('=');
+      const std::string name{arg.substr(2, eqpos == std::string::npos ? std::string::npos
+                                                                      : eqpos - 2)};
+      const std::string val{eqpos == std::string::npos ? std::string{"true"}
+                                                       : arg.substr(eqpos+1)};
+      if (std::find(known_device_params.begin(), known_device_params.end(), name)
+          == known_device_params.end()) {
+        return false;
+      }
+      if ( ! gs_is_ps_number_or_bool(val) ) {
+        return false;
+      }
+      pagedevice_params += "/" + name + " " + val + " ";
+      continue;
+    }
+    if (arg.empty() || arg[0] == '-') {
+      // stdin input ("-"), or some other switch we don't know how to handle
+      return false;
+    }
+
+    // otherwise, it's an input file
+    body += gs_ps_string_literal(arg) + " run\n";
+  }
+
+  if (device.empty()) {
+    // we don't want to guess what the default device would have been
+    return false;
+  }
+  if (width_pt.empty() != height_pt.empty()) {
+    return false;
+  }
+
+  if (!width_pt.empty()) {
+    pagedevice_params += "/PageSize [" + width_pt + " " + height_pt + "] ";
+  }
+  if (fixed_media) {
+    pagedevice_params += "/Policies << /PageSize 7 >> ";
+  }
+
+  std::string code;
+  code += gs_ps_string_literal(device) + " selectdevice\n";
+  if (!pagedevice_params.empty()) {
+    code += "<< " + pagedevice_params + ">> setpagedevice\n";
+  }
+  if (fixed_media) {
+    // picked up by the PDF interpreter, like -dFIXEDMEDIA would
+    code += "/FIXEDMEDIA true def\n";
+  }
+  code += body;
+
+  *ps_code = std::move(code);
+  return true;
+}
+
+
+} // namespace detail
+
+} // namespace klfengine
+
+
+
+
+// -----------------------------------------------------------------------------
+
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <chrono>
+#include <thread>
+#include <cerrno>
+#include <csignal>
+
+#include <string.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+namespace klfengine {
+
+namespace detail {
+
+
+struct gs_process_server_private
+{
+  std::vector<std::string> gs_argv;
+
+  pid_t pid;
+  int fd_in;
+  int fd_out;
+  int fd_err;
+
+  unsigned long job_counter;
+
+  std::chrono::milliseconds job_timeout;
+
+  static void set_nonblock(int fd)
+  {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+      throw std::system_error{errno, std::generic_category()};
+    }
+  }
+
+  // Our file descriptors must never leak into processes started by other
+  // threads, or a dead server's output would never reach end-of-stream.  Where
+  // possible, they're created close-on-exec atomically; otherwise there's a
+  // small window before we get here.
+  static int set_cloexec(int fd)
+  {
+    int fdflags = fcntl(fd, F_GETFD);
+    if (fdflags < 0 || fcntl(fd, F_SETFD, fdflags | FD_CLOEXEC) == -1) {
+      return -1;
+    }
+    return 0;
+  }
+
+  static int cloexec_socketpair(int sv[2])
+  {
+#ifdef SOCK_CLOEXEC
+    return socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv);
+#else
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+      return -1;
+    }
+    if (set_cloexec(sv[0]) != 0 || set_cloexec(sv[1]) != 0) {
+      int e = errno;
+      close(sv[0]); close(sv[1]);
+      errno = e;
+      return -1;
+    }
+    return 0;
+#endif
+  }
+
+  static int cloexec_pipe(int p[2])
+  {
+#if defined(__linux__)
+    return pipe2(p, O_CLOEXEC);
+#else
+    if (pipe(p) != 0) {
+      return -1;
+    }
+    if (set_cloexec(p[0]) != 0 || set_cloexec(p[1]) != 0) {
+      int e = errno;
+      close(p[0]); close(p[1]);
+      errno = e;
+      return -1;
+    }
+    return 0;
+#endif
+  }
+
+  void close_fds()
+  {
+    for (int * fdp : {&fd_in, &fd_out, &fd_err}) {
+      if (*fdp >= 0) {
+        close(*fdp);
+        *fdp = -1;
+      }
+    }
+  }
+
+  // wait for the process to exit, killing it if it takes too long
+  void reap(std::chrono::milliseconds grace_period)
+  {
+    if (pid <= 0) {
+      return;
+    }
+    const auto deadline = std::chrono::steady_clock::now() + grace_period;
+    int status = 0;
+    for (;;) {
+      pid_t r = waitpid(pid, &status, WNOHANG);
+      if (r == pid || (r == -1 && errno != EINTR)) {
+        break;
+      }
+      if (std::chrono::steady_clock::now() >= deadline) {
+        kill(pid, SIGKILL);
+        while (waitpid(pid, &status, 0) == -1 && errno == EINTR)
+          ;
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    pid = -1;
+  }
+
+  [[noreturn]] void died(const std::string & msg, const binary_data & err_buf)
+  {
+    close_fds();
+    reap(std::chrono::milliseconds(0));
+    throw gs_process_server_died{
+      "Ghostscript server process died " + msg
+      + (err_buf.empty() ? std::string{}
+                         : (":\n" + std::string{err_buf.begin(), err_buf.end()}))
+    };
+  }
+
+  ssize_t send_data(const char * buf, std::size_t len)
+  {
+#ifdef MSG_NOSIGNAL
+    return send(fd_in, buf, len, MSG_NOSIGNAL);
+#else
+    return send(fd_in, buf, len, 0); // SO_NOSIGPIPE was set on the socket
+#endif
+  }
+};
+
+
+_KLFENGINE_INLINE
+gs_process_server::gs_process_server(std::vector<std::string> gs_argv,
+                                     std::chrono::milliseconds job_timeout)
+{
+  d = new gs_process_server_private{std::move(gs_argv), -1, -1, -1, -1, 0, job_timeout};
+}
+
+_KLFENGINE_INLINE
+gs_process_server::~gs_process_server()
+{
+  if (d != nullptr) {
+    stop();
+    delete d;
+  }
+  d = nullptr;
+}
+
+_KLFENGINE_INLINE
+bool gs_process_server::running() const
+{
+  return d->pid > 0;
+}
+
+_KLFENGINE_INLINE
+void gs_process_server::start()
+{
+  if (running()) {
+    return;
+  }
+  if (d->gs_argv.empty()) {
+    throw std::invalid_argument("gs_process_server: empty gs_argv");
+  }
+
+  // Use a socket pair rather than a pipe for the process' stdin, so that we can
+  // get EPIPE instead of SIGPIPE if the process dies on us.
+  int sv_in[2];
+  if (gs_process_server_private::cloexec_socketpair(sv_in) != 0) {
+    throw std::system_error{errno, std::generic_category()};
+  }
+#if !defined(MSG_NOSIGNAL) && defined(SO_NOSIGPIPE)
+  {
+    int one = 1;
+    setsockopt(sv_in[0], SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+  }
+#endif
+  int p_out[2];
+  int p_err[2];
+  if (gs_process_server_private::cloexec_pipe(p_out) != 0) {
+    int e = errno;
+    close(sv_in[0]); close(sv_in[1]);
+    throw std::system_error{e, std::generic_category()};
+  }
+  if (gs_process_server_private::cloexec_pipe(p_err) != 0) {
+    int e = errno;
+    close(sv_in[0]); close(sv_in[1]); close(p_out[0]); close(p_out[1]);
+    throw std::system_error{e, std::generic_category()};
+  }
+
+  std::vector<char*> vc(d->gs_argv.size() + 1, nullptr);
+  for (std::size_t i = 0; i < d->gs_argv.size(); ++i) {
+    vc[i] = const_cast<char*>(d->gs_argv[i].c_str());
+  }
+
+  const pid_t pid = fork();
+  if (pid < 0) {
+    int e = errno;
+    for (int fd : {sv_in[0], sv_in[1], p_out[0], p_out[1], p_err[0], p_err[1]}) {
+      close(fd);
+    }
+    throw std::system_error{e, std::generic_category()};
+  }
+
+  if (pid == 0) {
+    // child process (dup2() clears close-on-exec on the new descriptors)
+    if (dup2(sv_in[1], 0) == -1 || dup2(p_out[1], 1) == -1 || dup2(p_err[1], 2) == -1) {
+      _exit(127);
+    }
+    for (int fd : {sv_in[0], sv_in[1], p_out[0], p_out[1], p_err[0], p_err[1]}) {
+      close(fd);
+    }
+    execv(vc[0], vc.data());
+    // execv() only returns on error
+    const char * msg = "gs_process_server: execv() failed\n";
+    ssize_t ignored = write(2, msg, strlen(msg));
+    (void)ignored;
+    _exit(127);
+  }
+
+  close(sv_in[1]);
+  close(p_out[1]);
+  close(p_err[1]);
+
+  d->pid = pid;
+  d->fd_in = sv_in[0];
+  d->fd_out = p_out[0];
+  d->fd_err = p_err[0];
+
+  gs_process_server_private::set_nonblock(d->fd_in);
+  gs_process_server_private::set_nonblock(d->fd_out);
+  gs_process_server_private::set_nonblock(d->fd_err);
+}
+
+_KLFENGINE_INLINE
+void gs_process_server::stop()
+{
+  if (!running()) {
+    d->close_fds();
+    return;
+  }
+  // politely ask Ghostscript to quit; any error here just means that the
+  // process is gone already
+  const char quit_cmd[] = "\nquit\n";
+  (void) d->send_data(quit_cmd, sizeof(quit_cmd) - 1);
+  d->close_fds();
+  d->reap(std::chrono::milliseconds(2000));
+}
+
+
+namespace detail_gs_server {
+
+// look for the job sentinel in buf, starting at search_from.  Returns true if
+// found, and sets data_end (where the job output ends) and job_ok.
+inline bool find_sentinel(const binary_data & buf, const std::string & sentinel_prefix,
+                          std::size_t & search_from, std::size_t & data_end, bool & job_ok)
+{
+  const std::string sentinel_suffix{"]%%"};
+  auto it = std::search(buf.begin() + search_from, buf.end(),
+                        sentinel_prefix.begin(), sentinel_prefix.end());
+  if (it == buf.end()) {
+    // next time, only search the part that might still contain the sentinel
+    search_from = (buf.size() > sentinel_prefix.size())
+      ? buf.size() - sentinel_prefix.size() : 0;
+    return false;
+  }
+  auto it_end = std::search(it + sentinel_prefix.size(), buf.end(),
+                            sentinel_suffix.begin(), sentinel_suffix.end());
+  if (it_end == buf.end()) {
+    search_from = std::size_t(it - buf.begin());
+    return false;
+  }
+  std::string status{it + sentinel_prefix.size(), it_end};
+  job_ok = (status == "ok");
+  data_end = std::size_t(it - buf.begin());
+  // the sentinel is preceded by a newline that we emitted ourselves
+  if (data_end > 0 && buf[data_end-1] == '\n') {
+    --data_end;
+  }
+  return true;
+}
+
+} // namespace detail_gs_server
+
+
+_KLFENGINE_INLINE
+bool gs_process_server::run_job(const std::string & ps_code,
+                                binary_data * capture_stdout,
+                                binary_data * capture_stderr)
+{
+  if (!running()) {
+    start();
+  }
+
+  const std::string job_id{std::to_string(++d->job_counter)};
+  const std::string sentinel_prefix{"%%[klfengine-gs-server job " + job_id + " "};
+  auto write_sentinel = [&sentinel_prefix](const char * status) {
+    std::string s;
+    for (const char * f : {"(%stdout)", "(%stderr)"}) {
+      s += std::string{f} + " (w) file dup "
+        + "(\\n" + sentinel_prefix + status + "]%%\\n)"
+        + " writestring flushfile ";
+    }
+    return s;
+  };
+
+  // Run the job inside save/restore so that it doesn't leave any traces in the
+  // interpreter state, and inside "stopped" so that errors don't terminate
+  // the server.  After an error, clear the operand stack (except for the
+  // result of "stopped"), report the error and restore the initial state.
+  std::string job;
+  job += "/klfengine_job_save save def\n";
+  job += "{\n" + ps_code + "\n} stopped\n";
+  job += "count 1 gt { count 1 roll count 1 sub { pop } repeat } if\n";
+  job += "dup { handleerror } if\n";
+  job += "cleardictstack\n";
+  job += "klfengine_job_save restore\n";
+  job += "{ " + write_sentinel("error") + "} { " + write_sentinel("ok") + "} ifelse\n";
+
+  binary_data out_buf;
+  binary_data err_buf;
+  std::size_t out_search_from = 0, err_search_from = 0;
+  std::size_t out_end = 0, err_end = 0;
+  bool out_done = false, err_done = false;
+  bool out_ok = false, err_ok = false;
+
+  std::size_t in_pos = 0;
+
+  constexpr std::size_t read_buf_size = 4096;
+  char read_buf[read_buf_size];
+
+  auto read_available = [&](int fd, binary_data & buf) {
+    for (;;) {
+      ssize_t r = read(fd, read_buf, read_buf_size);
+      if (r > 0) {
+        buf.insert(buf.end(), read_buf, read_buf + r);
+        continue;
+      }
+      if (r == 0) {
+        d->died("while running a job (end of stream)", err_buf);
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return;
+      }
+      d->died(std::string{"while running a job ("} + strerror(errno) + ")", err_buf);
+    }
+  };
+
+  const bool has_deadline = (d->job_timeout.count() > 0);
+  const auto deadline = std::chrono::steady_clock::now() + d->job_timeout;
+
+  while (!out_done || !err_done) {
+    int poll_timeout = -1;
+    if (has_deadline) {
+      const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now()
+      ).count();
+      if (remaining <= 0) {
+        // the job is stuck (e.g. its code never returns, or waits for input);
+        // kill the server, a new one is started for the next job
+        d->close_fds();
+        d->reap(std::chrono::milliseconds(0));
+        throw gs_process_server_job_timeout{
+          "Ghostscript server job did not finish within "
+          + std::to_string(d->job_timeout.count()) + " ms, server process killed"
+        };
+      }
+      poll_timeout = int(std::min<long long>(remaining, 1000*1000));
+    }
+
+    struct pollfd pfds[3];
+    nfds_t npfds = 0;
+    int idx_in = -1, idx_out = -1, idx_err = -1;
+    if (in_pos < job.size()) {
+      idx_in = int(npfds);
+      pfds[npfds++] = pollfd{d->fd_in, POLLOUT, 0};
+    }
+    if (!out_done) {
+      idx_out = int(npfds);
+      pfds[npfds++] = pollfd{d->fd_out, POLLIN, 0};
+    }
+    if (!err_done) {
+      idx_err = int(npfds);
+      pfds[npfds++] = pollfd{d->fd_err, POLLIN, 0};
+    }
+
+    int pr = poll(pfds, npfds, poll_timeout);
+    if (pr < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error{errno, std::generic_category()};
+    }
+
+    if (idx_in >= 0 && pfds[idx_in].revents != 0) {
+      if (pfds[idx_in].revents & (POLLERR | POLLHUP)) {
+        d->died("while we were sending it a job", err_buf);
+      }
+      ssize_t w = d->send_data(job.data() + in_pos, job.size() - in_pos);
+      if (w >= 0) {
+        in_pos += std::size_t(w);
+      } else if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) {
+        d->died(std::string{"while we were sending it a job ("} + strerror(errno) + ")",
+                err_buf);
+      }
+    }
+    if (idx_out >= 0 && pfds[idx_out].revents != 0) {
+      read_available(d->fd_out, out_buf);
+      out_done = detail_gs_server::find_sentinel(out_buf, sentinel_prefix, out_search_from,
+                                                 out_end, out_ok);
+    }
+    if (idx_err >= 0 && pfds[idx_err].revents != 0) {
+      read_available(d->fd_err, err_buf);
+      err_done = detail_gs_server::find_sentinel(err_buf, sentinel_prefix, err_search_from,
+                                                 err_end, err_ok);
+    }
+  }
+
+  if (capture_stdout != nullptr) {
+    *capture_stdout = binary_data{out_buf.begin(), out_buf.begin() + out_end};
+  }
+  if (capture_stderr != nullptr) {
+    *capture_stderr = binary_data{err_buf.begin(), err_buf.begin() + err_end};
+  }
+
+  return out_ok && err_ok;
+}
+
+
+} // namespace detail
+
+} // namespace klfengine
+
+
+#else // not POSIX
+
+
+namespace klfengine {
+
+namespace detail {
+
+struct gs_process_server_private
+{
+  std::vector<std::string> gs_argv;
+};
+
+_KLFENGINE_INLINE
+gs_process_server::gs_process_server(std::vector<std::string> gs_argv,
+                                     std::chrono::milliseconds )
+{
+  d = new gs_process_server_private{std::move(gs_argv)};
+}
+
+_KLFENGINE_INLINE
+gs_process_server::~gs_process_server()
+{
+  delete d;
+  d = nullptr;
+}
+
+_KLFENGINE_INLINE
+bool gs_process_server::running() const
+{
+  return false;
+}
+
+_KLFENGINE_INLINE
+void gs_process_server::start()
+{
+  throw std::runtime_error("gs_process_server is not available on this platform");
+}
+
+_KLFENGINE_INLINE
+void gs_process_server::stop()
+{
+}
+
+_KLFENGINE_INLINE
+bool gs_process_server::run_job(const std::string & ,
+                                binary_data * ,
+                                binary_data * )
+{
+  start(); // throws
+  return false;
+}
+
+} // namespace detail
+
+} // namespace klfengine
+
+#endif
+
+
+
+
+// -----------------------------------------------------------------------------
+
+
+namespace klfengine {
+
+namespace detail {
+
+
+_KLFENGINE_INLINE
+gs_process_server_pool::gs_process_server_pool(std::vector<std::string> gs_argv,
+                                               int pool_size,
+                                               std::chrono::milliseconds job_timeout)
+  : _gs_argv(std::move(gs_argv)),
+    _pool_size(pool_size > 0 ? pool_size : 1),
+    _job_timeout(job_timeout),
+    _num_servers(0)
+{
+}
+
+_KLFENGINE_INLINE
+gs_process_server_pool::~gs_process_server_pool()
+{
+  // idle servers are stopped by their destructors
+}
+
+_KLFENGINE_INLINE
+std::unique_ptr<gs_process_server> gs_process_server_pool::acquire_server()
+{
+  std::unique_lock<std::mutex> lock{_mutex};
+  for (;;) {
+    if (!_idle_servers.empty()) {
+      std::unique_ptr<gs_process_server> server{std::move(_idle_servers.back())};
+      _idle_servers.pop_back();
+      return server;
+    }
+    if (_num_servers < _pool_size) {
+      ++_num_servers;
+      lock.unlock();
+      try {
+        std::unique_ptr<gs_process_server> server{new gs_process_server{_gs_argv, _job_timeout}};
+        server->start();
+        return server;
+      } catch (...) {
+        lock.lock();
+        --_num_servers;
+        _server_released.notify_one();
+        throw;
+      }
+    }
+    _server_released.wait(lock);
+  }
+}
+
+_KLFENGINE_INLINE
+void gs_process_server_pool::release_server(std::unique_ptr<gs_process_server> server)
+{
+  std::lock_guard<std::mutex> lock{_mutex};
+  if (server && server->running()) {
+    _idle_servers.push_back(std::move(server));
+  } else {
+    --_num_servers;
+  }
+  _server_released.notify_one();
+}
+
+_KLFENGINE_INLINE
+bool gs_process_server_pool::run_job(const std::string & ps_code,
+                                     binary_data * capture_stdout,
+                                     binary_data * capture_stderr)
+{
+  for (int attempt = 0; ; ++attempt) {
+    std::unique_ptr<gs_process_server> server{acquire_server()};
+    try {
+      bool ok = server->run_job(ps_code, capture_stdout, capture_stderr);
+      release_server(std::move(server));
+      return ok;
+    } catch (gs_process_server_job_timeout & ) {
+      // the server was killed; the job would only time out again, don't retry
+      release_server(std::move(server));
+      throw;
+    } catch (gs_process_server_died & e) {
+      // the dead server is discarded, and a new one will be started
+      release_server(std::move(server));
+      if (attempt >= 1) {
+        throw;
+      }
+      warn("klfengine::detail::gs_process_server_pool",
+           std::string{e.what()} + "\nRestarting Ghostscript server and retrying job.");
+    } catch (...) {
+      // we don't know what state the server is in, so don't reuse it
+      server->stop();
+      release_server(std::move(server));
+      throw;
+    }
+  }
+}
+
+
+} // namespace detail
+
+} // namespace klfengine
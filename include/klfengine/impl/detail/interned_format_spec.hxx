@@ -0,0 +1,133 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <klfengine/h/detail/interned_format_spec.h>
+
+
+namespace klfengine {
+
+namespace detail {
+
+
+struct interned_format_spec::table
+{
+  std::mutex mutex;
+  std::unordered_map<format_spec, std::weak_ptr<const node>,
+                     detail::hash<format_spec> > entries;
+};
+
+struct interned_format_spec::node_deleter
+{
+  // keep the table alive for as long as any of its nodes
+  std::shared_ptr<table> t;
+
+  void operator()(const node * n) const
+  {
+    {
+      std::lock_guard<std::mutex> lckgrd(t->mutex);
+      auto it = t->entries.find(n->spec);
+      // the entry might already have been replaced by a fresh node for the
+      // same format_spec, in which case it is not expired
+      if (it != t->entries.end() && it->second.expired()) {
+        t->entries.erase(it);
+      }
+    }
+    delete n;
+  }
+};
+
+
+_KLFENGINE_INLINE
+std::shared_ptr<interned_format_spec::table> interned_format_spec::get_table()
+{
+  static std::shared_ptr<table> t = std::make_shared<table>();
+  return t;
+}
+
+
+_KLFENGINE_INLINE
+interned_format_spec::interned_format_spec()
+  : _node(empty_node())
+{
+}
+
+// static
+_KLFENGINE_INLINE
+const std::shared_ptr<const interned_format_spec::node> &
+interned_format_spec::empty_node()
+{
+  // interned once, so that default-constructing an instance doesn't need to
+  // lock the table
+  static const std::shared_ptr<const node> n =
+    interned_format_spec(format_spec{})._node;
+  return n;
+}
+
+_KLFENGINE_INLINE
+interned_format_spec::interned_format_spec(const format_spec & format)
+  : _node()
+{
+  std::shared_ptr<table> t = get_table();
+
+  // _node must not be released while the table mutex is held, because the
+  // deleter of the last reference needs to lock it.  Only assign it once the
+  // lock is released.
+  std::shared_ptr<const node> n;
+  {
+    std::lock_guard<std::mutex> lckgrd(t->mutex);
+
+    auto it = t->entries.find(format);
+    if (it != t->entries.end()) {
+      n = it->second.lock();
+    }
+    if (!n) {
+      n = std::shared_ptr<const node>(
+          new node{format, detail::hash<format_spec>{}(format)},
+          node_deleter{t}
+      );
+      t->entries[format] = n;
+    }
+  }
+  _node = std::move(n);
+}
+
+
+_KLFENGINE_INLINE
+std::size_t interned_format_spec::num_interned()
+{
+  std::shared_ptr<table> t = get_table();
+  std::lock_guard<std::mutex> lckgrd(t->mutex);
+  return t->entries.size();
+}
+
+
+} // namespace detail
+
+} // namespace klfengine
@@ -0,0 +1,162 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <string>
+#include <system_error>
+
+#if defined(_KLFENGINE_OS_LINUX) || defined(_KLFENGINE_OS_MACOSX)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <klfengine/h/detail/mapped_file.h>
+#include <klfengine/h/detail/utils.h>
+
+
+namespace klfengine {
+
+namespace detail {
+
+
+#if defined(_KLFENGINE_OS_LINUX) || defined(_KLFENGINE_OS_MACOSX)
+
+_KLFENGINE_INLINE
+mapped_file::mapped_file(const fs::path & fname)
+  : _data{nullptr},
+    _size{0}
+{
+  int fd = ::open(fname.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::system_error{errno, std::generic_category(),
+                            "Can't open " + fname.native()};
+  }
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    int err = errno;
+    ::close(fd);
+    throw std::system_error{err, std::generic_category(),
+                            "Can't stat " + fname.native()};
+  }
+  _size = static_cast<std::size_t>(st.st_size);
+
+  if (_size > 0) {
+    void * p = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+      int err = errno;
+      ::close(fd);
+      throw std::system_error{err, std::generic_category(),
+                              "Can't map " + fname.native()};
+    }
+    _data = static_cast<const std::uint8_t *>(p);
+  }
+
+  // the mapping doesn't need the file descriptor to stay open
+  ::close(fd);
+}
+
+_KLFENGINE_INLINE
+mapped_file::~mapped_file()
+{
+  if (_data != nullptr) {
+    ::munmap(const_cast<std::uint8_t *>(_data), _size);
+  }
+}
+
+_KLFENGINE_INLINE
+std::shared_ptr<const mapped_file> map_private_copy(const fs::path & fname)
+{
+  static std::atomic<unsigned long> num_copies{0};
+
+  // next to the original, so that the copy is cheap (or a reflink) if possible
+  fs::path copy = fname;
+  copy += ".klfemap-" + std::to_string(::getpid()) + "-" + std::to_string(++num_copies);
+
+  std::error_code ec;
+  std::shared_ptr<const mapped_file> m;
+  if (fs::copy_file(fname, copy, ec) && !ec) {
+    try {
+      m = std::make_shared<mapped_file>(copy);
+    } catch (const std::system_error &) {
+      m.reset();
+    }
+  }
+  fs::remove(copy, ec);
+  return m;
+}
+
+#endif
+
+
+_KLFENGINE_INLINE
+shared_binary_data load_file_shared(const fs::path & fname, bool take_file)
+{
+  shared_binary_data result;
+
+  bool loaded = false;
+
+#if defined(_KLFENGINE_OS_LINUX) || defined(_KLFENGINE_OS_MACOSX)
+  if (fs::file_size(fname) >= load_file_shared_mmap_threshold) {
+    // Never map a file that someone might still truncate or rewrite in place.
+    // A taken file is removed right below, otherwise map a private copy.
+    std::shared_ptr<const mapped_file> m;
+    if (take_file) {
+      m = std::make_shared<mapped_file>(fname);
+    } else {
+      m = map_private_copy(fname);
+    }
+    if (m) {
+      result = shared_binary_data{ m, m->data(), m->size() };
+      loaded = true;
+    }
+  }
+#endif
+
+  if (!loaded) {
+    result = shared_binary_data{ utils::load_file_data(fname.native()) };
+  }
+
+  if (take_file) {
+    std::error_code ec;
+    fs::remove(fname, ec); // not a problem if this fails, the file just stays
+  }
+
+  return result;
+}
+
+
+
+} // namespace detail
+
+} // namespace klfengine
@@ -0,0 +1,205 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <klfengine/h/detail/temporary_directory_pool.h>
+
+
+namespace klfengine {
+
+namespace detail {
+
+
+_KLFENGINE_INLINE
+temporary_directory_pool::lease::lease(
+    std::weak_ptr<temporary_directory_pool> pool,
+    std::shared_ptr<entry> e
+    )
+  : _pool{std::move(pool)}, _entry{std::move(e)}
+{
+}
+
+_KLFENGINE_INLINE
+temporary_directory_pool::lease::~lease()
+{
+  if (!_entry) {
+    return; // moved from
+  }
+  std::weak_ptr<temporary_directory_pool> weak_pool = _pool;
+  std::shared_ptr<entry> e = std::move(_entry);
+  directory_reaper::instance().submit(
+      [weak_pool, e]() {
+        std::shared_ptr<temporary_directory_pool> pool = weak_pool.lock();
+        if (pool) {
+          pool->recycle(e);
+        } else {
+          remove_entry(e);
+        }
+      }
+  );
+}
+
+
+_KLFENGINE_INLINE
+temporary_directory_pool::temporary_directory_pool(
+    fs::path temp_dir,
+    std::string name_prefix,
+    std::size_t max_idle,
+    seed_function seed
+    )
+  : _temp_dir{std::move(temp_dir)},
+    _name_prefix{std::move(name_prefix)},
+    _max_idle{max_idle},
+    _seed{std::move(seed)},
+    _mutex{},
+    _idle{}
+{
+}
+
+_KLFENGINE_INLINE
+temporary_directory_pool::~temporary_directory_pool()
+{
+  for (auto & e_ : _idle) {
+    std::shared_ptr<entry> e = std::move(e_);
+    directory_reaper::instance().submit( [e]() { remove_entry(e); } );
+  }
+}
+
+_KLFENGINE_INLINE
+temporary_directory_pool::lease temporary_directory_pool::acquire()
+{
+  std::shared_ptr<entry> e;
+  {
+    std::lock_guard<std::mutex> lck(_mutex);
+    if (!_idle.empty()) {
+      e = std::move(_idle.back());
+      _idle.pop_back();
+    }
+  }
+  if (!e) {
+    e = create_entry();
+  }
+  return lease{ std::weak_ptr<temporary_directory_pool>{shared_from_this()},
+                std::move(e) };
+}
+
+_KLFENGINE_INLINE
+void temporary_directory_pool::prefill(std::size_t num_dirs)
+{
+  if (num_dirs > _max_idle) {
+    num_dirs = _max_idle;
+  }
+  while (num_idle() < num_dirs) {
+    std::shared_ptr<entry> e = create_entry();
+    std::lock_guard<std::mutex> lck(_mutex);
+    _idle.push_back(std::move(e));
+  }
+}
+
+_KLFENGINE_INLINE
+std::size_t temporary_directory_pool::num_idle() const
+{
+  std::lock_guard<std::mutex> lck(_mutex);
+  return _idle.size();
+}
+
+_KLFENGINE_INLINE
+std::shared_ptr<temporary_directory_pool::entry>
+temporary_directory_pool::create_entry()
+{
+  std::shared_ptr<entry> e = std::make_shared<entry>(_temp_dir, _name_prefix);
+  if (_seed) {
+    _seed(e->dir.path());
+    for (const auto & de : fs::directory_iterator(e->dir.path())) {
+      e->seeded.insert(de.path().filename());
+    }
+  }
+  return e;
+}
+
+// called from the directory_reaper thread
+_KLFENGINE_INLINE
+void temporary_directory_pool::recycle(std::shared_ptr<entry> e)
+{
+  bool pool_is_full;
+  {
+    std::lock_guard<std::mutex> lck(_mutex);
+    pool_is_full = (_idle.size() >= _max_idle);
+  }
+  if (pool_is_full) {
+    remove_entry(e);
+    return;
+  }
+
+  // clean up everything the run left behind, keeping the seeded files
+  std::error_code ec;
+  std::vector<fs::path> leftovers;
+  for (fs::directory_iterator it{e->dir.path(), ec}, end; !ec && it != end;
+       it.increment(ec)) {
+    if (e->seeded.find(it->path().filename()) == e->seeded.end()) {
+      leftovers.push_back(it->path());
+    }
+  }
+  for (const auto & p : leftovers) {
+    if (ec) {
+      break;
+    }
+    fs::remove_all(p, ec);
+  }
+  if (ec) {
+    // can't reliably clean this directory, don't reuse it
+    remove_entry(e);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lck(_mutex);
+    if (_idle.size() < _max_idle) {
+      _idle.push_back(std::move(e));
+      return;
+    }
+  }
+  // the pool filled up in the meantime
+  remove_entry(e);
+}
+
+// static
+_KLFENGINE_INLINE
+void temporary_directory_pool::remove_entry(const std::shared_ptr<entry> & e)
+{
+  // remove here, where errors can be reported, rather than in the destructor
+  e->dir.set_auto_delete(false);
+  fs::remove_all(e->dir.path());
+}
+
+
+
+} // namespace detail
+
+} // namespace klfengine
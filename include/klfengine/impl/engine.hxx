@@ -28,9 +28,14 @@
 
 #pragma once
 
+#include <stdexcept>
+
 #include <klfengine/engine>
 #include <klfengine/engine_run_implementation>
 #include <klfengine/run>
+#include <klfengine/temporary_directory>
+#include <klfengine/h/detail/utils.h>
+#include <klfengine/h/detail/run_latex.h>
 
 
 namespace klfengine {
@@ -39,7 +44,16 @@ namespace klfengine {
 
 _KLFENGINE_INLINE
 engine::engine(std::string name_)
-  : _name(std::move(name_))
+  : _name(std::move(name_)),
+    _settings(),
+    _temp_dir_pool_mutex(),
+    _temp_dir_pool(),
+    _temp_dir_pool_size(detail::temp_dir_pool_default_max_idle),
+    _temp_dir_pool_name_prefix("klfetmp"),
+    _temp_dir_pool_seed(),
+    _scheduler(std::make_shared<job_scheduler>()),
+    _shared_runs_mutex(),
+    _shared_runs()
 {
 }
 
@@ -53,7 +67,7 @@ void engine::set_settings(klfengine::settings settings_)
 
 _KLFENGINE_INLINE
 std::unique_ptr<klfengine::run>
-engine::run( input input_ )
+engine::run( input input_, job_priority priority )
 {
   std::unique_ptr<engine_run_implementation> impl_ptr{
     impl_create_engine_run_implementation(
@@ -61,6 +75,7 @@ engine::run( input input_ )
         settings()
         )
   };
+  impl_ptr->set_scheduler(_scheduler, priority);
 
   std::unique_ptr<klfengine::run> run_ptr{
     new klfengine::run{ std::move(impl_ptr) }
@@ -71,6 +86,165 @@ engine::run( input input_ )
   return run_ptr;
 }
 
+_KLFENGINE_INLINE
+std::shared_ptr<klfengine::run>
+engine::shared_run( input input_, job_priority priority )
+{
+  klfengine::settings sett = settings();
+
+  std::promise<std::shared_ptr<klfengine::run> > promise;
+  {
+    std::unique_lock<std::mutex> lck(_shared_runs_mutex);
+
+    auto it = _shared_runs.find(input_);
+    if (it != _shared_runs.end() && it->second.settings == sett) {
+      std::shared_ptr<klfengine::run> r = it->second.compiled.lock();
+      if (r) {
+        return r;
+      }
+      if (it->second.compiling.valid()) {
+        // someone is compiling this input right now, wait for them
+        std::shared_future<std::shared_ptr<klfengine::run> > f =
+          it->second.compiling;
+        lck.unlock();
+        return f.get();
+      }
+    }
+
+    // forget about the runs that nobody uses anymore
+    for (auto jt = _shared_runs.begin(); jt != _shared_runs.end(); ) {
+      if (!jt->second.compiling.valid() && jt->second.compiled.expired()) {
+        jt = _shared_runs.erase(jt);
+      } else {
+        ++jt;
+      }
+    }
+
+    detail::engine_shared_run_entry & entry = _shared_runs[input_];
+    entry.settings = sett;
+    entry.compiling = promise.get_future().share();
+    entry.compiled.reset();
+  }
+
+  std::shared_ptr<klfengine::run> r;
+  try {
+    r = std::shared_ptr<klfengine::run>{ run(input_, priority) };
+    r->compile();
+  } catch (...) {
+    {
+      std::lock_guard<std::mutex> lck(_shared_runs_mutex);
+      auto it = _shared_runs.find(input_);
+      // (the entry was replaced if the settings changed in the meantime)
+      if (it != _shared_runs.end() && it->second.settings == sett) {
+        _shared_runs.erase(it);
+      }
+    }
+    promise.set_exception(std::current_exception());
+    throw;
+  }
+
+  {
+    std::lock_guard<std::mutex> lck(_shared_runs_mutex);
+    auto it = _shared_runs.find(input_);
+    if (it != _shared_runs.end() && it->second.settings == sett) {
+      it->second.compiling = std::shared_future<std::shared_ptr<klfengine::run> >{};
+      it->second.compiled = r;
+    }
+  }
+  promise.set_value(r);
+
+  return r;
+}
+
+
+
+_KLFENGINE_INLINE
+void engine::set_scheduler(std::shared_ptr<job_scheduler> scheduler)
+{
+  if (!scheduler) {
+    throw std::invalid_argument("Null pointer passed to klfengine::engine::set_scheduler()");
+  }
+  _scheduler = std::move(scheduler);
+}
+
+
+_KLFENGINE_INLINE
+void engine::warm_up_font_caches(const std::vector<std::string> & latex_engines)
+{
+  const klfengine::settings sett = settings();
+
+  for (const auto & latex_engine : latex_engines) {
+    try {
+      (void) sett.get_tex_executable_path(latex_engine);
+    } catch (const cannot_find_executable & ) {
+      continue;
+    }
+
+    try {
+      temporary_directory tmp_dir{sett.get_temporary_directory_path(), "klfewarmup"};
+      fs::path tex_file = tmp_dir.path() / "klfewarmup.tex";
+      detail::utils::dump_cstr_to_file(
+          tex_file.native(),
+          "\\documentclass{article}\n"
+          "\\usepackage{fontspec}\n"
+          "\\begin{document}\n"
+          "Font cache warm-up: $x^2$\n"
+          "\\end{document}\n"
+      );
+      (void) detail::run_latex(sett, latex_engine, tex_file, tmp_dir.path());
+    } catch (const std::exception & e) {
+      warn("klfengine::engine::warm_up_font_caches",
+           "Couldn't warm up font caches with " + latex_engine + ": " + e.what());
+    }
+  }
+}
+
+
+_KLFENGINE_INLINE
+void engine::set_temporary_directory_pool_size(std::size_t max_idle)
+{
+  std::lock_guard<std::mutex> lck(_temp_dir_pool_mutex);
+  _temp_dir_pool_size = max_idle;
+  // existing runs return their directories to the old pool, if it is still
+  // alive; otherwise their directories are simply removed
+  _temp_dir_pool.reset();
+}
+
+_KLFENGINE_INLINE
+void engine::prefill_temporary_directory_pool(std::size_t num_dirs)
+{
+  get_temporary_directory_pool()->prefill(num_dirs);
+}
+
+_KLFENGINE_INLINE
+void engine::set_temporary_directory_pool_options(
+    std::string name_prefix,
+    detail::temporary_directory_pool::seed_function seed
+    )
+{
+  std::lock_guard<std::mutex> lck(_temp_dir_pool_mutex);
+  _temp_dir_pool_name_prefix = std::move(name_prefix);
+  _temp_dir_pool_seed = std::move(seed);
+  _temp_dir_pool.reset();
+}
+
+_KLFENGINE_INLINE
+std::shared_ptr<detail::temporary_directory_pool>
+engine::get_temporary_directory_pool()
+{
+  fs::path base{ settings().get_temporary_directory_path() };
+
+  std::lock_guard<std::mutex> lck(_temp_dir_pool_mutex);
+  if (!_temp_dir_pool || _temp_dir_pool->base_directory() != base) {
+    _temp_dir_pool = std::make_shared<detail::temporary_directory_pool>(
+        std::move(base),
+        _temp_dir_pool_name_prefix,
+        _temp_dir_pool_size,
+        _temp_dir_pool_seed
+    );
+  }
+  return _temp_dir_pool;
+}
 
 
 _KLFENGINE_INLINE
@@ -30,8 +30,12 @@
 
 #include <klfengine/engine_run_implementation>
 
+#include <limits>
+
 #include <nlohmann/json.hpp>
 
+#include <klfengine/h/detail/mapped_file.h>
+
 
 namespace klfengine {
 
@@ -49,6 +53,18 @@ struct cache_entry_already_exists
   }
 };
 
+struct recursive_format_request
+  : klfengine::exception
+{
+  recursive_format_request(const std::string & format)
+    : klfengine::exception(
+        "Implementation error: format " + format + " was requested while producing "
+        "that same format"
+        )
+  {
+  }
+};
+
 // /*---* \brief Get the cache key for the given format
 //  *
 //  * \internal
@@ -90,12 +106,19 @@ _KLFENGINE_INLINE engine_run_implementation::engine_run_implementation(
     klfengine::settings settings_
     )
   : _input(std::move(input_)),
-    _settings(std::move(settings_))
+    _settings(std::move(settings_)),
+    _bytes_held(0),
+    _scheduler(),
+    _priority(job_priority::interactive)
 {
+  cache_budget::instance().register_cache(this);
 }
 
 _KLFENGINE_INLINE engine_run_implementation::~engine_run_implementation()
 {
+  cache_budget & budget = cache_budget::instance();
+  budget.unregister_cache(this);
+  budget.remove_bytes(_bytes_held);
 }
 
 
@@ -105,7 +128,35 @@ void engine_run_implementation::compile()
   // note: klfengine::run::compile() already checks that compile() isn't called
   // twice.
 
-  impl_compile();
+  try {
+    impl_compile();
+  } catch (const latex_compile_error & e) {
+    _diagnostics = e.diagnostics();
+    throw;
+  }
+}
+
+_KLFENGINE_INLINE
+void engine_run_implementation::set_diagnostics(latex_diagnostics diagnostics_)
+{
+  _diagnostics = std::move(diagnostics_);
+}
+
+_KLFENGINE_INLINE
+void engine_run_implementation::set_scheduler(std::shared_ptr<job_scheduler> scheduler,
+                                              job_priority priority)
+{
+  _scheduler = std::move(scheduler);
+  _priority = priority;
+}
+
+_KLFENGINE_INLINE job_scheduler::slot
+engine_run_implementation::acquire_stage(job_stage stage)
+{
+  if (!_scheduler) {
+    return job_scheduler::slot{};
+  }
+  return _scheduler->acquire(stage, _priority);
 }
 
 
@@ -113,33 +164,197 @@ void engine_run_implementation::compile()
 _KLFENGINE_INLINE const binary_data &
 engine_run_implementation::get_data_cref(const format_spec & format)
 {
-  auto canon_fmt = canonical_format(format);
-  //auto ckey = detail::formatspec_cache_key(canon_fmt);
+  // the entry is pinned, so the cache keeps the data alive
+  shared_binary_data data{ get_data_impl(format, true, true) };
+  if (data.has_binary()) {
+    return data.binary();
+  }
+
+  // memory-mapped data: rather than keeping a copy made by binary() on top of
+  // the mapping, replace the cache entry by an in-memory copy of the same size,
+  // which is what cache_budget accounts for
+  shared_binary_data copy{ binary_data{data.begin(), data.end()} };
+
+  std::lock_guard<std::mutex> lckgrd(_cache_mutex);
+  shared_binary_data & entry_data = _cache.find(memoized_canonical_format(format))->second.data;
+  if (!entry_data.has_binary()) {
+    entry_data = std::move(copy);
+  }
+  return entry_data.binary();
+}
+
+_KLFENGINE_INLINE shared_binary_data
+engine_run_implementation::get_data_shared(const format_spec & format,
+                                           bool store_in_cache)
+{
+  return get_data_impl(format, store_in_cache, false);
+}
 
-  auto cache_it = _cache.find(canon_fmt); //ckey);
+_KLFENGINE_INLINE shared_binary_data
+engine_run_implementation::get_data_impl(const format_spec & format,
+                                         bool store_in_cache, bool pin)
+{
+  cache_budget & budget = cache_budget::instance();
+
+  std::shared_ptr<detail::run_impl_production> production;
+  std::shared_future<shared_binary_data> pending;
+  fs::path source_file;
+
+  std::unique_lock<std::mutex> lck(_cache_mutex);
+
+  const detail::fmtspec_cache_key_type canon_fmt = memoized_canonical_format(format);
+
+  auto cache_it = _cache.find(canon_fmt);
   if (cache_it != _cache.end()) {
     // format exists in cache
-    return cache_it->second;
+    cache_it->second.last_use = budget.next_tick();
+    if (pin) {
+      cache_it->second.kind = detail::cache_entry_kind::pinned;
+    }
+    return cache_it->second.data;
+  }
+
+  auto flight_it = _in_flight.find(canon_fmt);
+  if (flight_it != _in_flight.end()) {
+    if (flight_it->second->thread == std::this_thread::get_id()) {
+      // we would wait for ourselves forever
+      throw detail::recursive_format_request(canon_fmt->as_string());
+    }
+    // someone else is producing this format already, we'll wait for them
+    pending = flight_it->second->result;
+  } else {
+    production = std::make_shared<detail::run_impl_production>();
+    production->thread = std::this_thread::get_id();
+    production->result = production->promise.get_future().share();
+    _in_flight.insert(
+        detail::run_impl_in_flight_type::value_type(canon_fmt, production)
+    );
+    // an intermediate format that was evicted, see store_file_to_cache()
+    auto source_it = _source_files.find(canon_fmt);
+    if (source_it != _source_files.end()) {
+      source_file = source_it->second;
+    }
   }
 
-  // format does not yet exist, we need to produce it
-  binary_data data = impl_produce_data(canon_fmt);
+  lck.unlock();
+
+  const detail::cache_entry_kind default_kind = (
+      pin ? detail::cache_entry_kind::pinned : detail::cache_entry_kind::produced
+  );
+  std::size_t added_bytes = 0;
+
+  if (!production) {
+    // rethrows the producing thread's exception, if any
+    shared_binary_data data{ pending.get() };
+    if (store_in_cache) {
+      // the other thread might not have stored its result
+      {
+        std::lock_guard<std::mutex> lckgrd(_cache_mutex);
+        detail::run_impl_cache_entry & entry =
+          cache_insert(canon_fmt, std::move(data), default_kind, added_bytes);
+        if (pin) {
+          entry.kind = detail::cache_entry_kind::pinned;
+        }
+        data = entry.data;
+      }
+      budget.add_bytes(added_bytes);
+    }
+    return data;
+  }
+
+  // format does not yet exist, we need to produce it (without holding the
+  // lock, so that other formats can be produced at the same time)
+  shared_binary_data data;
+  detail::cache_entry_kind kind = default_kind;
+  try {
+    std::error_code ec;
+    if (!source_file.empty() && fs::exists(source_file, ec)) {
+      data = detail::load_file_shared(source_file);
+      if (!pin) {
+        kind = detail::cache_entry_kind::from_file;
+      }
+    } else {
+      data = impl_produce_shared_data(canon_fmt.get());
+    }
+  } catch (...) {
+    {
+      std::lock_guard<std::mutex> lckgrd(_cache_mutex);
+      _in_flight.erase(canon_fmt);
+    }
+    production->promise.set_exception(std::current_exception());
+    throw;
+  }
+
+  {
+    std::lock_guard<std::mutex> lckgrd(_cache_mutex);
+    _in_flight.erase(canon_fmt);
+    if (store_in_cache) {
+      detail::run_impl_cache_entry & entry =
+        cache_insert(canon_fmt, std::move(data), kind, added_bytes);
+      if (pin) {
+        entry.kind = detail::cache_entry_kind::pinned;
+      }
+      // if a waiting thread got here first, keep the data it stored
+      data = entry.data;
+    }
+  }
+  production->promise.set_value(data);
+
+  budget.add_bytes(added_bytes);
+
+  return data;
+}
+
 
+_KLFENGINE_INLINE detail::run_impl_cache_entry &
+engine_run_implementation::cache_insert(const detail::fmtspec_cache_key_type & key,
+                                        shared_binary_data data,
+                                        detail::cache_entry_kind kind,
+                                        std::size_t & added_bytes)
+{
+  std::size_t size = data.size();
   auto result = _cache.insert(
-      std::pair<detail::fmtspec_cache_key_type,binary_data>(canon_fmt, //std::move(ckey),
-                                                            std::move(data))
-      );
+      detail::run_impl_cache_type::value_type(
+          key,
+          detail::run_impl_cache_entry{ std::move(data), kind,
+                                        cache_budget::instance().next_tick() }
+      )
+  );
+  if (result.second) {
+    _bytes_held += size;
+    added_bytes += size;
+  }
+  return result.first->second;
+}
 
-  // NOTE: ckey is invalidated by the above std::move(), use result.first->first
 
-  if (!result.second) {
-    // It is a error if the subclass registered the data for canon_fmt already.
-    // This should not happen.
-    throw detail::cache_entry_already_exists();
+_KLFENGINE_INLINE detail::fmtspec_cache_key_type
+engine_run_implementation::memoized_canonical_format(const format_spec & format)
+{
+  auto memo_it = _canonical_memo.find(format);
+  if (memo_it != _canonical_memo.end()) {
+    return memo_it->second;
   }
 
-  const binary_data & dref = result.first->second;
-  return dref;
+  detail::fmtspec_cache_key_type canon_fmt{ canonical_format(format) };
+
+  _canonical_memo.insert(
+      detail::run_impl_canonical_memo_type::value_type(format, canon_fmt)
+  );
+  // the canonical form is its own canonical form; this way a later request
+  // with the canonical format_spec doesn't need impl_make_canonical() either
+  _canonical_memo.insert(
+      detail::run_impl_canonical_memo_type::value_type(canon_fmt.get(), canon_fmt)
+  );
+
+  return canon_fmt;
+}
+
+
+_KLFENGINE_INLINE shared_binary_data
+engine_run_implementation::impl_produce_shared_data(const format_spec & canon_format)
+{
+  return shared_binary_data{ impl_produce_data(canon_format) };
 }
 
 
@@ -156,26 +371,121 @@ engine_run_implementation::store_to_cache(
     binary_data && data
     )
 {
-  //auto ckey = detail::formatspec_cache_key(canon_fmt);
+  return store_to_cache(canon_fmt, shared_binary_data{std::move(data)});
+}
 
-  auto result = _cache.insert(
-      // `data` is already an rvalue-reference, so no std::move(data) here:
-      std::pair<detail::fmtspec_cache_key_type,binary_data>(
-          canon_fmt, //std::move(ckey),
-          data
-      )
-  );
+_KLFENGINE_INLINE const binary_data &
+engine_run_implementation::store_to_cache(
+    const format_spec & canon_fmt,
+    shared_binary_data data
+    )
+{
+  detail::fmtspec_cache_key_type key{canon_fmt};
+  std::size_t added_bytes = 0;
+  const binary_data * stored;
 
-  if (!result.second) {
-    // insert() failed, entry already exists. This should not happen.
-    throw detail::cache_entry_already_exists();
+  {
+    std::lock_guard<std::mutex> lckgrd(_cache_mutex);
+
+    auto flight_it = _in_flight.find(key);
+    if (flight_it != _in_flight.end() &&
+        flight_it->second->thread == std::this_thread::get_id()) {
+      // the format we're producing is stored by get_data_shared() when we're
+      // done.  This should not happen.
+      throw detail::cache_entry_already_exists();
+    }
+
+    // If the entry already exists, keep the existing data.  This can happen if
+    // the same intermediate format was stored while producing another format
+    // in a different thread.  We hand out a reference, so the entry can't be
+    // evicted.
+    detail::run_impl_cache_entry & entry =
+      cache_insert(key, std::move(data), detail::cache_entry_kind::pinned, added_bytes);
+    entry.kind = detail::cache_entry_kind::pinned;
+    stored = & entry.data.binary();
   }
 
-  const binary_data & dref = result.first->second;
-  return dref;
+  cache_budget::instance().add_bytes(added_bytes);
+
+  return *stored;
+}
+
+_KLFENGINE_INLINE void
+engine_run_implementation::store_file_to_cache(
+    const format_spec & canon_fmt,
+    const fs::path & fname
+    )
+{
+  detail::fmtspec_cache_key_type key{canon_fmt};
+  shared_binary_data data{ detail::load_file_shared(fname) };
+  std::size_t added_bytes = 0;
+
+  {
+    std::lock_guard<std::mutex> lckgrd(_cache_mutex);
+
+    auto flight_it = _in_flight.find(key);
+    if (flight_it != _in_flight.end() &&
+        flight_it->second->thread == std::this_thread::get_id()) {
+      throw detail::cache_entry_already_exists();
+    }
+
+    _source_files.insert(detail::run_impl_source_files_type::value_type(key, fname));
+
+    (void) cache_insert(key, std::move(data), detail::cache_entry_kind::from_file,
+                        added_bytes);
+  }
+
+  cache_budget::instance().add_bytes(added_bytes);
 }
 
 
+_KLFENGINE_INLINE std::uint64_t
+engine_run_implementation::oldest_entry_tick(detail::cache_entry_kind kind)
+{
+  std::lock_guard<std::mutex> lckgrd(_cache_mutex);
+
+  std::uint64_t oldest = std::numeric_limits<std::uint64_t>::max();
+  for (const auto & x : _cache) {
+    if (x.second.kind == kind && x.second.last_use < oldest) {
+      oldest = x.second.last_use;
+    }
+  }
+  return oldest;
+}
+
+_KLFENGINE_INLINE std::size_t
+engine_run_implementation::evict_oldest_entry(detail::cache_entry_kind kind)
+{
+  std::lock_guard<std::mutex> lckgrd(_cache_mutex);
+
+  auto oldest_it = _cache.end();
+  for (auto it = _cache.begin(); it != _cache.end(); ++it) {
+    if (it->second.kind == kind &&
+        (oldest_it == _cache.end() || it->second.last_use < oldest_it->second.last_use)) {
+      oldest_it = it;
+    }
+  }
+  if (oldest_it == _cache.end()) {
+    return 0;
+  }
+
+  if (kind == detail::cache_entry_kind::from_file) {
+    auto source_it = _source_files.find(oldest_it->first);
+    std::error_code ec;
+    if (source_it == _source_files.end() || !fs::exists(source_it->second, ec)) {
+      // can't load it again after all, keep it
+      oldest_it->second.kind = detail::cache_entry_kind::pinned;
+      return 0;
+    }
+  }
+
+  std::size_t size = oldest_it->second.data.size();
+  _cache.erase(oldest_it);
+  _bytes_held -= size;
+  // (we're called by the budget itself, this doesn't lock anything)
+  cache_budget::instance().remove_bytes(size);
+  return size;
+}
 
 
 
@@ -30,6 +30,8 @@
 
 #include <klfengine/engines/klflatexpackage>
 #include <klfengine/ghostscript_interface>
+#include <klfengine/version>
+#include <klfengine/h/detail/engine_workspace.h>
 
 
 namespace klfengine {
@@ -40,6 +42,16 @@ _KLFENGINE_INLINE
 engine::engine()
   : klfengine::engine("klflatexpackage")
 {
+  set_temporary_directory_pool_options(
+      std::string{"klfeimplpkgtmp"} +
+          _KLFENGINE_CONCAT_VER_3_j(
+            KLFENGINE_VERSION_MAJOR,
+            KLFENGINE_VERSION_MINOR,
+            KLFENGINE_VERSION_RELEASE,
+            "x"
+          )
+  );
+
   _gs_iface_tool = std::shared_ptr<klfengine::ghostscript_interface_engine_tool>{
     new klfengine::ghostscript_interface_engine_tool{}
   };
@@ -54,6 +66,11 @@ _KLFENGINE_INLINE
 void engine::adjust_for_new_settings(klfengine::settings & settings_)
 {
   _gs_iface_tool->set_settings(settings_);
+
+  // the workspace might have to be in a different temporary directory -- the
+  // next run will create a new one (existing runs keep the old one alive)
+  std::lock_guard<std::mutex> lck(_workspace_mutex);
+  _workspace.reset();
 }
 
 // reimplemented from klfengine::engine
@@ -62,7 +79,27 @@ klfengine::engine_run_implementation *
 engine::impl_create_engine_run_implementation( klfengine::input input_,
                                                klfengine::settings settings_ )
 {
-  return new run_implementation(_gs_iface_tool, std::move(input_), std::move(settings_));
+  std::shared_ptr<klfengine::detail::engine_workspace> workspace;
+  {
+    std::lock_guard<std::mutex> lck(_workspace_mutex);
+    if (!_workspace) {
+      _workspace = std::make_shared<klfengine::detail::engine_workspace>(
+          settings_.get_temporary_directory_path(),
+          std::string{"klfeimplpkgws"} +
+              _KLFENGINE_CONCAT_VER_3_j(
+                KLFENGINE_VERSION_MAJOR,
+                KLFENGINE_VERSION_MINOR,
+                KLFENGINE_VERSION_RELEASE,
+                "x"
+              )
+      );
+    }
+    workspace = _workspace;
+  }
+
+  return new run_implementation(_gs_iface_tool, std::move(workspace),
+                                get_temporary_directory_pool(),
+                                std::move(input_), std::move(settings_));
 }
 
 
@@ -28,9 +28,15 @@
 
 #pragma once
 
+#include <atomic>
+
 #include <klfengine/engines/klflatexpackage>
-#include <klfengine/temporary_directory>
+#include <klfengine/h/detail/temporary_directory_pool.h>
 #include <klfengine/h/detail/utils.h>
+#include <klfengine/h/detail/dvisvgm.h>
+#include <klfengine/h/detail/engine_workspace.h>
+#include <klfengine/h/detail/run_latex.h>
+#include <klfengine/h/detail/mapped_file.h>
 #include <klfengine/ghostscript_interface>
 #include <klfengine/version>
 
@@ -52,33 +58,32 @@ static
 
 struct run_implementation_private
 {
-  temporary_directory temp_dir;
+  klfengine::detail::temporary_directory_pool::lease temp_dir;
 
   std::shared_ptr<klfengine::ghostscript_interface_engine_tool> gs_iface_tool;
 
   klfengine::gs_device_args_format_provider gs_args_provider;
 
+  std::shared_ptr<klfengine::detail::engine_workspace> workspace;
+
   bool via_dvi;
 
   fs::path fn_base;
   fs::path fn_tex;
   fs::path fn_pdfout;
 
+  // number of Ghostscript output files produced so far; numbering them keeps
+  // formats that are produced concurrently from writing to the same file
+  std::atomic<unsigned int> num_output_files{0};
+
   inline run_implementation_private(
-      const klfengine::input & in, const klfengine::settings & sett,
-      std::shared_ptr<klfengine::ghostscript_interface_engine_tool> gs_iface_tool_
+      const klfengine::input & in,
+      std::shared_ptr<klfengine::ghostscript_interface_engine_tool> gs_iface_tool_,
+      std::shared_ptr<klfengine::detail::engine_workspace> workspace_,
+      klfengine::detail::temporary_directory_pool & temp_dir_pool
   )
     :
-    temp_dir{
-      sett.temporary_directory,
-      std::string{"klfeimplpkgtmp"} +
-          _KLFENGINE_CONCAT_VER_3_j(
-            KLFENGINE_VERSION_MAJOR,
-            KLFENGINE_VERSION_MINOR,
-            KLFENGINE_VERSION_RELEASE,
-            "x"
-          )
-    },
+    temp_dir{ temp_dir_pool.acquire() },
     gs_iface_tool{ std::move(gs_iface_tool_) },
     gs_args_provider{
       gs_iface_tool.get(),
@@ -88,7 +93,8 @@ struct run_implementation_private
         {"dpi", value{in.dpi}},
         {"antialiasing", value{true}}
       }
-    }
+    },
+    workspace{ std::move(workspace_) }
   {
 
     via_dvi = ((in.latex_engine == "latex") ? true : false);
@@ -105,13 +111,16 @@ struct run_implementation_private
 _KLFENGINE_INLINE
 run_implementation::run_implementation(
     std::shared_ptr<klfengine::ghostscript_interface_engine_tool> gs_iface_tool_,
+    std::shared_ptr<klfengine::detail::engine_workspace> workspace_,
+    std::shared_ptr<klfengine::detail::temporary_directory_pool> temp_dir_pool_,
     klfengine::input input_,
     klfengine::settings settings_
     )
   : klfengine::engine_run_implementation(std::move(input_), std::move(settings_))
 {
 
-  d = new run_implementation_private{input(), settings(), std::move(gs_iface_tool_)};
+  d = new run_implementation_private{input(), std::move(gs_iface_tool_),
+                                     std::move(workspace_), *temp_dir_pool_};
 }
 _KLFENGINE_INLINE
 run_implementation::~run_implementation()
@@ -406,14 +415,9 @@ void run_implementation::impl_compile()
         "Running latex->DVI with klflatexpackage engine is not yet implemented!");
   }
 
-  // write our style file into the temp dir (TODO: maybe we could have a fixed
-  // temp dir per engine instance, so we only do this once?) (OR TODO: maybe we
-  // could have another different engine-wide temp dir to store the klfimpl.sty
-  // file and use a TEXINPUTS=... when invoking latex) (OR TODO: We could inject
-  // the code into the LaTeX template with some minimal boilerplate top/bottom
-  // code as I do in my side project styexpress)
-  std::string klfimplsty_fname{ (d->temp_dir.path() / "klfimpl.sty").native() };
-  dump_cstr_to_file(klfimplsty_fname, detail::klfimpl_sty_data);
+  // our style file lives in the engine-wide workspace; it is only written once
+  // and is found by latex through TEXINPUTS
+  d->workspace->provide_file("klfimpl.sty", detail::klfimpl_sty_data);
 
   // prepare latex template
 
@@ -429,28 +433,21 @@ void run_implementation::impl_compile()
   // TODO: add meta-information to latex string!
 
 
-  binary_data out;
-  binary_data err;
-
   // run {|pdf|xe|lua}latex
-  process::run_and_wait(
-      { // argv
-        sett.get_tex_executable_path(in.latex_engine),
-        "-file-line-error",
-        "-interaction=nonstopmode",
-        d->fn_tex.native()
-      },
-      process::run_in_directory{ d->temp_dir.path().native() },
-      process::capture_stdout_data{&out},
-      process::capture_stderr_data{&err}
-      );
-
+  {
+    job_scheduler::slot stage_slot = acquire_stage(job_stage::latex);
+    set_diagnostics(
+        klfengine::detail::run_latex(
+            sett, in.latex_engine, d->fn_tex, d->temp_dir.path(),
+            provide_environment_variables{ {{"TEXINPUTS", ""}} },
+            d->workspace->texinputs_environment()
+        )
+    );
+  }
 
-  binary_data pdf_data_obj;
-  pdf_data_obj = load_file_data( d->fn_pdfout );
 
-  (void) store_to_cache(format_spec{"PDF", value::dict{{"latex_raw", value{true}}}},
-                        std::move(pdf_data_obj));
+  store_file_to_cache(format_spec{"PDF", value::dict{{"latex_raw", value{true}}}},
+                      d->fn_pdfout);
 
 }
 
@@ -478,6 +475,18 @@ std::vector<format_description> run_implementation::impl_available_formats()
     }
   }
 
+  // SVG is produced by dvisvgm, directly from the PDF file
+  fmtlist.push_back({
+      { "SVG", value::dict{
+          {"outline_fonts", value{value::dict{
+              {"type", value{std::string{"bool"}}},
+              {"default", value{input().outline_fonts}}
+            }}}
+        } },
+      "SVG Image",
+      "Scalable Vector Graphics, produced with dvisvgm"
+  });
+
   // Add LATEX.  Don't even offer latex_raw option, cause it's not an option :) 
   fmtlist.push_back({
       { "LATEX", {} },
@@ -527,6 +536,14 @@ klfengine::format_spec run_implementation::impl_make_canonical(
     }
   }
 
+  if (format.format == "SVG") {
+    canon_format.format = "SVG";
+    canon_format.parameters["outline_fonts"] =
+      value{param.take<bool>("outline_fonts", input().outline_fonts)};
+    param.finished();
+    return canon_format;
+  }
+
   if (format.format == "PDF" || format.format == "PS") {
     // these formats can be the latex raw versions, enabled with latex_raw=true.
     bool want_latex_raw = param.take("latex_raw", false);
@@ -555,9 +572,8 @@ klfengine::format_spec run_implementation::impl_make_canonical(
 
     // get Ghostscript's canonical format
     
-    format_spec gs_format{ format.format, param.take_remaining() };
+    canon_format = d->gs_args_provider.take_canonical_format( format.format, param );
     param.finished();
-    canon_format = d->gs_args_provider.canonical_format( std::move(gs_format) );
     // fix canonical format to have this key regardless of whether raw version is available
     canon_format.parameters["latex_raw"] = value{false};
     return canon_format;
@@ -580,6 +596,14 @@ _KLFENGINE_INLINE
 klfengine::binary_data run_implementation::impl_produce_data(
     const klfengine::format_spec & format
     )
+{
+  return impl_produce_shared_data(format).binary();
+}
+
+_KLFENGINE_INLINE
+klfengine::shared_binary_data run_implementation::impl_produce_shared_data(
+    const klfengine::format_spec & format
+    )
 {
   using namespace klfengine::detail::utils;
   using namespace klfengine::detail;
@@ -601,30 +625,37 @@ klfengine::binary_data run_implementation::impl_produce_data(
         "No RAW format available for \"" + format.format + "\""};
   }
 
+  if (format.format == "SVG") {
+    // The PDF page already has the right size, margins and background (all
+    // taken care of by klfimpl.sty), so use the page box as is.
+    bool outline_fonts = param.take<bool>("outline_fonts");
+    param.finished();
+    job_scheduler::slot stage_slot = acquire_stage(job_stage::gs_render);
+    return shared_binary_data{
+      run_dvisvgm(settings(), d->fn_pdfout, dvisvgm_options{ true, outline_fonts, false })
+    };
+  }
+
   if ( format.format == "PDF" && ! in.outline_fonts ) {
-    // no further processing is needed.  We can use the raw PDF directly.
-    auto raw_pdf_data = get_data_cref(format_spec{"PDF",
-                                                  value::dict{{"latex_raw", value{true}}}});
-    return raw_pdf_data;
+    // no further processing is needed.  We can share the raw PDF directly.
+    return get_data_shared(format_spec{"PDF", value::dict{{"latex_raw", value{true}}}});
   }
 
+  // the remaining (canonical) parameters are Ghostscript's
+  std::vector<std::string> gs_process_args{
+    d->gs_args_provider.take_device_args_for_format(format.format, param)
+  };
+  param.finished();
+
   auto gs_iface = d->gs_iface_tool->gs_interface();
 
   // don't use ghostscript STDOUT so that we can also use libgs-based methods in
   // ghostscript_interface
   fs::path outf = d->fn_base;
-  outf.replace_filename(d->fn_base.filename().generic_string() + "-gs."
+  outf.replace_filename(d->fn_base.filename().generic_string() + "-"
+                        + std::to_string(++d->num_output_files) + "-gs."
                         + to_lowercase(format.format));
 
-  auto param_remaining = param.take_remaining();
-  param.finished();
-
-  std::vector<std::string> gs_process_args{
-    d->gs_args_provider.get_device_args_for_format(
-      format_spec{format.format, param_remaining}
-    )
-  };
-
   gs_process_args.push_back("-sOutputFile="+outf.native());
 
   // finally, the input file
@@ -633,6 +664,7 @@ klfengine::binary_data run_implementation::impl_produce_data(
   // now, run the full ghostscript command.
   //binary_data gs_stderr;
   //binary_data gs_stdout;
+  job_scheduler::slot stage_slot = acquire_stage(job_stage::gs_render);
   gs_iface->run_gs(
     gs_process_args,
     ghostscript_interface::add_standard_batch_flags{true}
@@ -640,9 +672,8 @@ klfengine::binary_data run_implementation::impl_produce_data(
     //ghostscript_interface::capture_stderr_data{&gs_stderr}
   );
 
-  binary_data gs_result_data{ load_file_data(outf.native()) };
-
-  return gs_result_data;
+  // take the output file, it's not needed anymore once its data is loaded
+  return load_file_shared(outf, true);
 }
 
 
@@ -1,2 +1,3 @@
 #include <klfengine/impl/engines/latextoimage/engine.hxx>
 #include <klfengine/impl/engines/latextoimage/run_implementation.hxx>
+#include <klfengine/impl/engines/latextoimage/batcher.hxx>
@@ -0,0 +1,367 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <regex>
+#include <stdexcept>
+
+#include <klfengine/h/engines/latextoimage/batcher.h>
+#include <klfengine/h/detail/utils.h>
+#include <klfengine/h/detail/run_latex.h>
+
+
+namespace klfengine {
+namespace engines {
+namespace latextoimage {
+
+namespace detail {
+
+
+_KLFENGINE_INLINE
+latex_template_parts make_latex_template_parts(const klfengine::input & in, bool for_batch)
+{
+  using namespace klfengine::detail::utils;
+
+  std::string docclass{ dict_get<std::string>(in.parameters, "document_class", "article") };
+  // note, docoptions don't include [] argument wrapper
+  std::string docoptions{ dict_get<std::string>(in.parameters, "document_class_options", "") };
+
+  std::string ltxcolorpkg{ dict_get<std::string>(in.parameters, "latex_color_package", "color") };
+
+  bool need_fg_color = (in.fg_color != color{0,0,0,255});
+
+  std::string fg_color_def;
+  if (need_fg_color) {
+    fg_color_def = "\\definecolor{klffgcolor}{rgb}{" + dbl_to_string(in.fg_color.red/255.0) + "," +
+      dbl_to_string(in.fg_color.green/255.0) + "," + dbl_to_string(in.fg_color.blue/255.0) + "}";
+  }
+
+  latex_template_parts parts;
+
+  // tape together latex document
+  std::string & head = parts.head;
+
+  head += "\\documentclass";
+  if (docoptions.size()) {
+    head += "[";
+    head += docoptions;
+    head += "]";
+  }
+  head += "{";
+  head += docclass;
+  head += "}\n";
+
+  if (need_fg_color || for_batch) {
+    head += "\\usepackage{";
+    head += ltxcolorpkg;
+    head += "}\n";
+  }
+  if (need_fg_color && !for_batch) {
+    head += fg_color_def;
+    head += "\n";
+  }
+
+  head += in.preamble;
+  head += "\n";
+
+  std::string & body = parts.body;
+
+  body += "\\thispagestyle{empty}";
+  if (need_fg_color && for_batch) {
+    // same line, so that line numbers in the body don't depend on for_batch
+    body += fg_color_def;
+  }
+  body += "\n";
+
+  if (in.font_size > 0) {
+    body += "\\fontsize{" + dbl_to_string(in.font_size) + "}{"
+      + dbl_to_string(in.font_size*1.25) + "}\\selectfont\n";
+  }
+
+  if (need_fg_color) {
+    body += "{\\color{klffgcolor}%\n";
+  }
+
+  // begin math mode
+  body += in.math_mode.first;
+  body += "%\n";
+
+  // main latex content to compile
+  body += in.latex;
+  body += "%\n";
+
+  // end math mode
+  body += in.math_mode.second;
+  body += "%\n";
+
+  if (need_fg_color) {
+    body += "}%\n";
+  }
+
+  return parts;
+}
+
+
+
+// Shift the input line numbers quoted in a log message ("... on input line 12",
+// "... in paragraph at lines 5--6") by offset
+_KLFENGINE_INLINE
+std::string shift_log_message_lines(const std::string & message, int offset)
+{
+  static const std::regex rx_line{"( on input line | at lines? )([0-9]+)(--([0-9]+))?"};
+
+  std::string result;
+  std::string::const_iterator last = message.cbegin();
+  for (std::sregex_iterator it{message.cbegin(), message.cend(), rx_line}, end;
+       it != end; ++it) {
+    const std::smatch & m = *it;
+    result.append(last, m[0].first);
+    result += m[1].str();
+    result += std::to_string(std::stoi(m[2].str()) + offset);
+    if (m[3].matched) {
+      result += "--";
+      result += std::to_string(std::stoi(m[4].str()) + offset);
+    }
+    last = m[0].second;
+  }
+  result.append(last, message.cend());
+  return result;
+}
+
+_KLFENGINE_INLINE
+latex_diagnostics batch_output::page_diagnostics(int page, int body_first_line) const
+{
+  latex_diagnostics result;
+  if (page < 1 || static_cast<std::size_t>(page) > page_lines.size()) {
+    return result;
+  }
+  const std::pair<int, int> & lines = page_lines[page - 1];
+  const int offset = body_first_line - lines.first;
+
+  for (const latex_diagnostic & diag : diagnostics.entries) {
+    if (diag.line < lines.first || diag.line > lines.second) {
+      continue;
+    }
+    latex_diagnostic d = diag;
+    d.line += offset;
+    d.message = shift_log_message_lines(d.message, offset);
+    result.entries.push_back(std::move(d));
+  }
+  return result;
+}
+
+
+
+_KLFENGINE_INLINE
+bool may_have_global_effects(const klfengine::input & in)
+{
+  // Each input is compiled in a group, which undoes its local assignments;
+  // look for commands that make global ones (or read code from elsewhere)
+  static const std::regex rx_global{
+    "\\\\(global|gdef|xdef|globaldefs|setcounter|addtocounter|stepcounter"
+    "|refstepcounter|newcounter|newtheorem|pagenumbering|input|include"
+    "|AtBeginDocument|AtEndDocument|AtBeginShipout|AddToHook)(?![a-zA-Z])"
+  };
+  for (const std::string * s : {&in.latex, &in.math_mode.first, &in.math_mode.second}) {
+    if (std::regex_search(*s, rx_global)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+
+_KLFENGINE_INLINE
+batcher::batcher(std::size_t max_batch_size, std::chrono::milliseconds max_delay)
+  : _max_batch_size(max_batch_size),
+    _max_delay(max_delay),
+    _mutex(),
+    _cond(),
+    _open_batches()
+{
+}
+
+
+_KLFENGINE_INLINE
+batcher::placement batcher::compile(
+    const klfengine::input & in,
+    const klfengine::settings & sett,
+    klfengine::detail::temporary_directory_pool & temp_dir_pool,
+    const std::function<job_scheduler::slot()> & acquire_latex_stage
+    )
+{
+  using namespace klfengine::detail::utils;
+
+  if (_max_batch_size < 2 || !dict_get<bool>(in.parameters, "use_latex_template", true)
+      || may_have_global_effects(in)) {
+    return placement{nullptr, 0};
+  }
+
+  latex_template_parts parts = make_latex_template_parts(in, true);
+
+  std::unique_lock<std::mutex> lck(_mutex);
+
+  // join an open batch, if there's a compatible one
+  for (auto it = _open_batches.begin(); it != _open_batches.end(); ++it) {
+    pending_batch & b = **it;
+    if (b.latex_engine != in.latex_engine || b.head != parts.head || !(b.settings == sett)) {
+      continue;
+    }
+    b.pages.push_back(std::move(parts.body));
+    const int page = static_cast<int>(b.pages.size());
+    std::shared_future<std::shared_ptr<const batch_output> > result = b.result;
+    if (b.pages.size() >= _max_batch_size) {
+      // batch is full, the run that opened it can go ahead
+      b.closed = true;
+      _open_batches.erase(it);
+      _cond.notify_all();
+    }
+    lck.unlock();
+
+    std::shared_ptr<const batch_output> output = result.get();
+    if (!output) {
+      return placement{nullptr, 0};
+    }
+    return placement{std::move(output), page};
+  }
+
+  // open a new batch and wait for other runs to join
+  std::shared_ptr<pending_batch> batch = std::make_shared<pending_batch>();
+  batch->latex_engine = in.latex_engine;
+  batch->head = std::move(parts.head);
+  batch->settings = sett;
+  batch->pages.push_back(std::move(parts.body));
+  batch->closed = false;
+  batch->result = batch->promise.get_future().share();
+  _open_batches.push_back(batch);
+
+  _cond.wait_for(lck, _max_delay, [&batch]() { return batch->closed; });
+  if (!batch->closed) {
+    batch->closed = true;
+    _open_batches.erase(std::find(_open_batches.begin(), _open_batches.end(), batch));
+  }
+  std::vector<std::string> pages = std::move(batch->pages);
+  lck.unlock();
+
+  if (pages.size() < 2) {
+    // nobody joined
+    batch->promise.set_value(nullptr);
+    return placement{nullptr, 0};
+  }
+
+  std::shared_ptr<const batch_output> output;
+  try {
+    output = compile_batch(*batch, std::move(pages), temp_dir_pool, acquire_latex_stage);
+  } catch (...) {
+    // all runs of the batch compile their input on their own instead, so that
+    // the errors are reported for the input that caused them
+    output.reset();
+  }
+  batch->promise.set_value(output);
+
+  if (!output) {
+    return placement{nullptr, 0};
+  }
+  return placement{std::move(output), 1};
+}
+
+
+_KLFENGINE_INLINE
+std::shared_ptr<const batch_output> batcher::compile_batch(
+    const pending_batch & batch,
+    std::vector<std::string> pages,
+    klfengine::detail::temporary_directory_pool & temp_dir_pool,
+    const std::function<job_scheduler::slot()> & acquire_latex_stage
+    )
+{
+  using namespace klfengine::detail::utils;
+
+  std::shared_ptr<batch_output> output =
+    std::make_shared<batch_output>(temp_dir_pool.acquire());
+
+  const fs::path base = output->temp_dir.path() / "klfebatch";
+  output->tex = base; output->tex.replace_extension(".tex");
+  output->dvi = base; output->dvi.replace_extension(".dvi");
+  output->pdf = base; output->pdf.replace_extension(".pdf");
+  fs::path log = base; log.replace_extension(".log");
+
+  std::string latex_str = batch.head;
+  latex_str += "\\begin{document}\n";
+  for (std::size_t j = 0; j < pages.size(); ++j) {
+    if (j > 0) {
+      latex_str += "\\newpage\n";
+    }
+    // \null makes sure that each input gets a page even if it doesn't output
+    // anything.  Don't let page and equation numbers carry over to the next
+    // input.
+    latex_str += "\\begingroup\\null\n"
+      "\\setcounter{page}{1}"
+      "\\makeatletter\\@ifundefined{c@equation}{}{\\setcounter{equation}{0}}\\makeatother\n";
+    const int first_line =
+      static_cast<int>(std::count(latex_str.begin(), latex_str.end(), '\n')) + 1;
+    const int num_lines = static_cast<int>(std::count(pages[j].begin(), pages[j].end(), '\n'));
+    output->page_lines.push_back(std::make_pair(first_line, first_line + num_lines - 1));
+    latex_str += pages[j];
+    latex_str += "\\endgroup\n";
+  }
+  latex_str += "\\end{document}\n";
+
+  dump_cstr_to_file(output->tex.native(), latex_str.c_str());
+
+  {
+    job_scheduler::slot stage_slot = acquire_latex_stage();
+    output->diagnostics = klfengine::detail::run_latex(
+        batch.settings, batch.latex_engine, output->tex, output->temp_dir.path()
+    );
+  }
+
+  // An input that spills over onto a second page would shift all the following
+  // ones, so check that there's exactly one page per input
+  binary_data log_data = load_file_data(log.native());
+  std::string log_str{log_data.begin(), log_data.end()};
+  static const std::regex rx_output_written{
+    "Output written on [^\\n]*\\(([0-9]+) pages?"
+  };
+  std::smatch m;
+  if (!std::regex_search(log_str, m, rx_output_written) ||
+      std::stoul(m[1].str()) != pages.size()) {
+    throw std::runtime_error("Batch output doesn't have exactly one page per input");
+  }
+
+  return output;
+}
+
+
+} // namespace detail
+
+} // namespace latextoimage
+} // namespace engines
+} // namespace klfengine
@@ -30,6 +30,7 @@
 
 #include <klfengine/engines/latextoimage>
 #include <klfengine/ghostscript_interface>
+#include <klfengine/version>
 
 
 namespace klfengine {
@@ -38,8 +39,22 @@ namespace latextoimage {
 
 _KLFENGINE_INLINE
 engine::engine()
-  : klfengine::engine("latextoimage")
+  : klfengine::engine("latextoimage"),
+    _use_dvipng(false),
+    _batch_max_size(0),
+    _batch_max_delay(std::chrono::milliseconds{5}),
+    _batcher()
 {
+  set_temporary_directory_pool_options(
+      std::string{"klfelatextoimgtmp"} +
+          _KLFENGINE_CONCAT_VER_3_j(
+            KLFENGINE_VERSION_MAJOR,
+            KLFENGINE_VERSION_MINOR,
+            KLFENGINE_VERSION_RELEASE,
+            "x"
+          )
+  );
+
   _gs_iface_tool = std::shared_ptr<klfengine::ghostscript_interface_engine_tool>{
     new klfengine::ghostscript_interface_engine_tool{}
   };
@@ -50,6 +65,25 @@ engine::~engine()
 {
 }
 
+_KLFENGINE_INLINE
+void engine::set_use_dvipng(bool use_dvipng)
+{
+  _use_dvipng = use_dvipng;
+}
+
+_KLFENGINE_INLINE
+void engine::set_batching(std::size_t max_batch_size, std::chrono::milliseconds max_delay)
+{
+  _batch_max_size = max_batch_size;
+  _batch_max_delay = max_delay;
+  // runs that were already created keep using the previous batcher
+  if (max_batch_size < 2) {
+    _batcher.reset();
+  } else {
+    _batcher = std::make_shared<detail::batcher>(max_batch_size, max_delay);
+  }
+}
+
 _KLFENGINE_INLINE
 void engine::adjust_for_new_settings(klfengine::settings & settings_)
 {
@@ -62,7 +96,9 @@ klfengine::engine_run_implementation *
 engine::impl_create_engine_run_implementation( klfengine::input input_,
                                                klfengine::settings settings_ )
 {
-  return new run_implementation(_gs_iface_tool, std::move(input_), std::move(settings_));
+  return new run_implementation(_gs_iface_tool, get_temporary_directory_pool(),
+                                std::move(input_), std::move(settings_),
+                                _use_dvipng, _batcher);
 }
 
 
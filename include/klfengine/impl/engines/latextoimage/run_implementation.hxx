@@ -28,11 +28,19 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <regex>
+#include <mutex>
+#include <atomic>
 
 #include <klfengine/engines/latextoimage>
-#include <klfengine/temporary_directory>
+#include <klfengine/h/engines/latextoimage/batcher.h>
+#include <klfengine/h/detail/temporary_directory_pool.h>
 #include <klfengine/h/detail/utils.h>
+#include <klfengine/h/detail/dvisvgm.h>
+#include <klfengine/h/detail/run_latex.h>
+#include <klfengine/h/detail/mapped_file.h>
 #include <klfengine/ghostscript_interface>
 #include <klfengine/version>
 
@@ -65,7 +73,7 @@ struct bbox {
 
 struct run_implementation_private
 {
-  temporary_directory temp_dir;
+  klfengine::detail::temporary_directory_pool::lease temp_dir;
 
   std::shared_ptr<klfengine::ghostscript_interface_engine_tool> gs_iface_tool;
 
@@ -80,7 +88,7 @@ struct run_implementation_private
       base = base_;
       tex = base_; tex.replace_extension(".tex");
       dvi = base_; dvi.replace_extension(".dvi");
-      ps = base_; ps.replace_extension(".dvi");
+      ps = base_; ps.replace_extension(".ps");
       pdf = base_; pdf.replace_extension(".pdf");
 
       gs_input = (via_dvi ? ps : pdf);
@@ -94,14 +102,48 @@ struct run_implementation_private
   detail::bbox rawbbox;
 
   detail::bbox bbox;
+
+  // if set, PNG images may be produced directly from the DVI with dvipng (see
+  // engine::set_use_dvipng())
+  std::atomic<bool> use_dvipng{false};
+  // dvips & the gs bbox computation are run lazily if use_dvipng is set.
+  // Formats may be produced concurrently, so these are protected by
+  // prepare_mutex.
+  std::mutex prepare_mutex{};
+  bool dvips_done = false;
+  bool gs_bbox_done = false;
+
+  // number of output files produced so far
+  std::atomic<unsigned int> num_output_files{0};
+
+  // see engine::set_batching()
+  std::shared_ptr<detail::batcher> batcher{};
+  std::shared_ptr<klfengine::detail::temporary_directory_pool> temp_dir_pool{};
+  // if this run was compiled in a batch, the batch's output and the page
+  // (starting at 1) of our input; page is zero otherwise
+  std::shared_ptr<const detail::batch_output> batch{};
+  int page{0};
+
+  // A new file name for the output of a single data production.  Different
+  // formats might be produced at the same time, so they can't share a name.
+  inline fs::path new_output_file(const std::string & suffix)
+  {
+    fs::path outf = fn.base;
+    outf.replace_filename(fn.base.filename().generic_string() + "-"
+                          + std::to_string(++num_output_files) + suffix);
+    return outf;
+  }
 };
 
 
 _KLFENGINE_INLINE
 run_implementation::run_implementation(
     std::shared_ptr<klfengine::ghostscript_interface_engine_tool> gs_iface_tool_,
+    std::shared_ptr<klfengine::detail::temporary_directory_pool> temp_dir_pool_,
     klfengine::input input_,
-    klfengine::settings settings_
+    klfengine::settings settings_,
+    bool use_dvipng_,
+    std::shared_ptr<detail::batcher> batcher_
     )
   : klfengine::engine_run_implementation(std::move(input_), std::move(settings_))
 {
@@ -118,24 +160,15 @@ run_implementation::run_implementation(
 
   d = new run_implementation_private{
     // temp_dir
-    temporary_directory{
-      settings().temporary_directory,
-      std::string{"klfelatextoimgtmp"} +
-      _KLFENGINE_CONCAT_VER_3_j(
-          KLFENGINE_VERSION_MAJOR,
-          KLFENGINE_VERSION_MINOR,
-          KLFENGINE_VERSION_RELEASE,
-          "x"
-          )
-    },
+    temp_dir_pool_->acquire(),
     // gs_iface_tool
     std::move(gs_iface_tool_), // move the shared pointer, not the actual object (!)
     // gs_args_provider
     { gs_iface_tool_ptr, std::move(fmt_param_defaults_) },
     // fn
     {},
-    // via_dvi
-    (input_.latex_engine == "latex"),
+    // via_dvi (input_ was moved into the base class already)
+    (input().latex_engine == "latex"),
     // rawbbox
     {},
     // bbox
@@ -143,7 +176,13 @@ run_implementation::run_implementation(
   };
   
   d->fn.set(d->temp_dir.path() / "klfetemp", d->via_dvi);
-  
+
+  d->use_dvipng = use_dvipng_ && d->via_dvi;
+
+  if (batcher_) {
+    d->batcher = std::move(batcher_);
+    d->temp_dir_pool = std::move(temp_dir_pool_);
+  }
 }
 _KLFENGINE_INLINE
 run_implementation::~run_implementation()
@@ -167,162 +206,159 @@ std::string run_implementation::assemble_latex_template(const klfengine::input &
     return in.latex;
   }
 
-  std::string docclass{ dict_get<std::string>(in.parameters, "document_class", "article") };
-  // note, docoptions don't include [] argument wrapper
-  std::string docoptions{ dict_get<std::string>(in.parameters, "document_class_options", "") };
+  detail::latex_template_parts parts = detail::make_latex_template_parts(in, false);
 
-  std::string ltxcolorpkg{ dict_get<std::string>(in.parameters, "latex_color_package", "color") };
+  return parts.head + "\\begin{document}\n" + parts.body + "\\end{document}\n";
+};
 
-  // tape together latex document
-  std::string latex_str;
 
-  latex_str += "\\documentclass";
-  if (docoptions.size()) {
-    latex_str += "[";
-    latex_str += docoptions;
-    latex_str += "]";
-  }
-  latex_str += "{";
-  latex_str += docclass;
-  latex_str += "}\n";
-
-  bool need_fg_color = (in.fg_color != color{0,0,0,255});
-
-  if (need_fg_color) {
-    latex_str += "\\usepackage{";
-    latex_str += ltxcolorpkg;
-    latex_str += "}\n";
-    latex_str += "\\definecolor{klffgcolor}{rgb}{" + dbl_to_string(in.fg_color.red/255.0) + "," +
-      dbl_to_string(in.fg_color.green/255.0) + "," + dbl_to_string(in.fg_color.blue/255.0) + "}\n";
+_KLFENGINE_INLINE
+void run_implementation::impl_compile()
+{
+  using namespace klfengine::detail::utils;
+  using namespace klfengine::detail;
+
+  const klfengine::input & in = input();
+  const klfengine::settings & sett = settings();
+
+  bool batched = false;
+  if (d->batcher) {
+    detail::batcher::placement placement = d->batcher->compile(
+        in, sett, *d->temp_dir_pool,
+        [this]() { return acquire_stage(job_stage::latex); }
+    );
+    if (placement.output) {
+      // our input was compiled on a page of a batch document, see
+      // engine::set_batching().  Subsequent steps take the input files from
+      // the batch's working directory.
+      d->batch = std::move(placement.output);
+      d->page = placement.page;
+      d->fn.dvi = d->batch->dvi;
+      d->fn.pdf = d->batch->pdf;
+      // (dvips extracts our page to our own PS file)
+      d->fn.gs_input = (d->via_dvi ? d->fn.ps : d->fn.pdf);
+
+      // The batch's LaTeX document and raw output contain the other inputs of
+      // the batch as well.  Only expose our own document, as it would have
+      // been compiled on its own (the body is the same, line by line), along
+      // with the diagnostics for our page.
+      detail::latex_template_parts parts = detail::make_latex_template_parts(in, false);
+      std::string latex_str = parts.head + "\\begin{document}\n" + parts.body
+        + "\\end{document}\n";
+      (void) store_to_cache(format_spec{"LATEX", value::dict{{"latex_raw", value{true}}}},
+                            binary_data{latex_str.begin(), latex_str.end()});
+      const int body_first_line =
+        static_cast<int>(std::count(parts.head.begin(), parts.head.end(), '\n')) + 2;
+      set_diagnostics(d->batch->page_diagnostics(d->page, body_first_line));
+      batched = true;
+    }
   }
 
-  latex_str += in.preamble;
-  latex_str += "\n";
+  if (!batched) {
+    std::string latex_str = assemble_latex_template(in);
 
-  latex_str += "\\begin{document}\n"
-    "\\thispagestyle{empty}\n";
+    dump_cstr_to_file(d->fn.tex.native(), latex_str.c_str());
 
-  if (in.font_size > 0) {
-    latex_str += "\\fontsize{" + dbl_to_string(in.font_size) + "}{"
-      + dbl_to_string(in.font_size*1.25) + "}\\selectfont\n";
-  }
+    //fprintf(stderr, "LATEX DOCUMENT IS =\n%s\n", latex_str.c_str());
+    (void) store_to_cache(format_spec{"LATEX", value::dict{{"latex_raw", value{true}}}},
+                          binary_data{latex_str.begin(), latex_str.end()});
 
-  if (need_fg_color) {
-    latex_str += "{\\color{klffgcolor}%\n";
+    // run {|pdf|xe|lua}latex
+    job_scheduler::slot stage_slot = acquire_stage(job_stage::latex);
+    set_diagnostics(
+        run_latex(sett, in.latex_engine, d->fn.tex, d->temp_dir.path())
+    );
   }
 
-  // begin math mode
-  latex_str += in.math_mode.first;
-  latex_str += "%\n";
 
-  // main latex content to compile
-  latex_str += in.latex;
-  latex_str += "%\n";
+  if (d->via_dvi) {
 
-  // end math mode
-  latex_str += in.math_mode.second;
-  latex_str += "%\n";
+    if (!batched) {
+      store_file_to_cache(format_spec{"DVI", value::dict{{"latex_raw", value{true}}}},
+                          d->fn.dvi);
+    }
 
-  if (need_fg_color) {
-    latex_str += "}%\n";
-  }
+    if (d->use_dvipng) {
+      // dvips & gs bbox will be run only if we need them, see
+      // ensure_gs_input_ready().  The raw PS is produced on demand in
+      // impl_produce_data().
+      return;
+    }
 
-  latex_str += "\\end{document}\n";
+    run_dvips();
 
-  return latex_str;
-};
+    store_file_to_cache(format_spec{"PS", value::dict{{"latex_raw", value{true}}}},
+                        d->fn.ps);
+
+  } else if (!batched) {
+    store_file_to_cache(format_spec{"PDF", value::dict{{"latex_raw", value{true}}}},
+                        d->fn.pdf);
+  }
 
+  // in either case, we read out the (hi res) bounding box using ghostscript
+  compute_gs_bbox();
+}
 
 _KLFENGINE_INLINE
-void run_implementation::impl_compile()
+void run_implementation::run_dvips()
 {
-  using namespace klfengine::detail::utils;
-  using namespace klfengine::detail;
-
-  const klfengine::input & in = input();
   const klfengine::settings & sett = settings();
 
-  std::string latex_str = assemble_latex_template(in);
-  
-  dump_cstr_to_file(d->fn.tex.native(), latex_str.c_str());
-
-  //fprintf(stderr, "LATEX DOCUMENT IS =\n%s\n", latex_str.c_str());
-  (void) store_to_cache(format_spec{"LATEX", value::dict{{"latex_raw", value{true}}}},
-                        binary_data{latex_str.begin(), latex_str.end()});
+  binary_data dvips_out;
+  binary_data dvips_err;
 
+  std::vector<std::string> argv{
+    sett.get_tex_executable_path("dvips"),
+    "-o",
+    d->fn.ps.native()
+  };
+  if (d->page > 0) {
+    // only our page of the batch document; "=N" selects the N-th physical
+    // page rather than by TeX page number
+    argv.push_back("-p");
+    argv.push_back("=" + std::to_string(d->page));
+    argv.push_back("-l");
+    argv.push_back("=" + std::to_string(d->page));
+  }
+  argv.push_back(d->fn.dvi.native());
 
-  binary_data latex_out;
-  binary_data latex_err;
+  job_scheduler::slot stage_slot = acquire_stage(job_stage::dvips);
 
-  // run {|pdf|xe|lua}latex
+  // run dvips
   process::run_and_wait(
-      { // argv
-        sett.get_tex_executable_path(in.latex_engine),
-        "-file-line-error",
-        "-interaction=nonstopmode",
-        d->fn.tex
-      },
-      process::run_in_directory{ d->temp_dir.path().native() },
-      process::capture_stdout_data{&latex_out},
-      process::capture_stderr_data{&latex_err}
-      );
-
+    std::move(argv),
+    process::run_in_directory{ d->temp_dir.path().native() },
+    process::capture_stdout_data{&dvips_out},
+    process::capture_stderr_data{&dvips_err}
+    );
 
-  if (d->via_dvi) {
+  d->dvips_done = true;
+}
 
-    binary_data dvi_data_obj;
-    dvi_data_obj = load_file_data( d->fn.dvi.native() );
-    //  const binary_data & dvi_data =
-      store_to_cache(format_spec{"DVI", value::dict{{"latex_raw", value{true}}}},
-                     std::move(dvi_data_obj));
-
-    binary_data dvips_out;
-    binary_data dvips_err;
-
-    // run dvips
-    process::run_and_wait(
-      { // argv
-        sett.get_tex_executable_path("dvips"),
-        d->fn.dvi
-      },
-      process::run_in_directory{ d->temp_dir.path().native() },
-      process::capture_stdout_data{&dvips_out},
-      process::capture_stderr_data{&dvips_err}
-      );
-
-    binary_data ps_data_obj;
-    ps_data_obj = load_file_data( d->fn.ps.native() );
-    //  const binary_data & dvi_data =
-      store_to_cache(format_spec{"PS", value::dict{{"latex_raw", value{true}}}},
-                     std::move(ps_data_obj));
-      
-  } else {
-    binary_data pdf_data_obj;
-    pdf_data_obj = load_file_data( d->fn.pdf.native() );
-    ;
-    //  const binary_data & pdf_data =
-      store_to_cache(format_spec{"PDF", value::dict{{"latex_raw", value{true}}}},
-                     std::move(pdf_data_obj));
-  }
+_KLFENGINE_INLINE
+void run_implementation::compute_gs_bbox()
+{
+  const klfengine::input & in = input();
 
-  // in either case, we read out the (hi res) bounding box using ghostscript
-  
   binary_data gsbbox_err_data;
 
   auto gs_iface = d->gs_iface_tool->gs_interface();
 
+  std::vector<std::string> gs_args{ gs_page_args() };
+  gs_args.push_back("-sDEVICE=bbox");
+  gs_args.push_back(d->fn.gs_input.native());
+
+  job_scheduler::slot stage_slot = acquire_stage(job_stage::gs_bbox);
+
   gs_iface->run_gs(
-    {
-      "-sDEVICE=bbox",
-      d->fn.gs_input.native()
-    },
+    std::move(gs_args),
     ghostscript_interface::add_standard_batch_flags{true},
     ghostscript_interface::capture_stderr_data{&gsbbox_err_data}
   );
 
   std::string gsbbox_err{gsbbox_err_data.begin(), gsbbox_err_data.end()};
 
-  std::regex rxgsbbox{
+  static const std::regex rxgsbbox{
     "(?:^|\n)\\%\\%\\s*HiResBoundingBox\\s*:\\s*"
       "([0-9.e+-]+)\\s+([0-9.e+-]+)\\s+([0-9.e+-]+)\\s+([0-9.e+-]+)\\s*(\\n|$)"
   };
@@ -348,6 +384,32 @@ void run_implementation::impl_compile()
   d->bbox.y2 += in.margins.top.to_value_as_bp();
   // also apply scale to margins
   d->bbox = d->bbox.scaled_by(in.scale);
+
+  d->gs_bbox_done = true;
+}
+
+_KLFENGINE_INLINE
+std::vector<std::string> run_implementation::gs_page_args() const
+{
+  if (d->page == 0 || d->via_dvi) {
+    // our PS or PDF file has a single page
+    return {};
+  }
+  const std::string page = std::to_string(d->page);
+  return { "-dFirstPage=" + page, "-dLastPage=" + page };
+}
+
+_KLFENGINE_INLINE
+void run_implementation::ensure_gs_input_ready()
+{
+  std::lock_guard<std::mutex> lckgrd(d->prepare_mutex);
+
+  if (d->via_dvi && !d->dvips_done) {
+    run_dvips();
+  }
+  if (!d->gs_bbox_done) {
+    compute_gs_bbox();
+  }
 }
 
 _KLFENGINE_INLINE
@@ -362,9 +424,10 @@ std::vector<klfengine::format_description> run_implementation::impl_available_fo
     { "type", value{std::string{"bool"}} }
   }};
 
-  // find PDF, PS and add latex_raw parameter
+  // find PDF, PS and add latex_raw parameter.  (The raw DVI and PDF of a batch
+  // contain the other inputs of the batch as well, so they aren't offered.)
   for (auto & x : fmtlist) {
-    if (x.format_spec.format == "PDF" && !d->via_dvi) {
+    if (x.format_spec.format == "PDF" && !d->via_dvi && !d->batch) {
       x.format_spec.parameters["latex_raw"] = want_raw_spec;
       continue;
     }
@@ -374,13 +437,25 @@ std::vector<klfengine::format_description> run_implementation::impl_available_fo
     }
   }
 
+  // SVG is produced by dvisvgm, directly from the DVI or PDF file
+  fmtlist.push_back({
+      { "SVG", value::dict{
+          {"outline_fonts", value{value::dict{
+              {"type", value{std::string{"bool"}}},
+              {"default", value{input().outline_fonts}}
+            }}}
+        } },
+      "SVG Image",
+      "Scalable Vector Graphics, produced with dvisvgm"
+  });
+
   // Add LATEX, DVI.  Don't even offer latex_raw option, cause it's not an option :) 
   fmtlist.push_back({
       { "LATEX", {} },
       "LaTeX document",
       "The full LaTeX document used to compile the equation",
   });
-  if ( d->via_dvi ) {
+  if ( d->via_dvi && !d->batch ) {
     fmtlist.push_back({
       { "DVI", {} },
       "Latex DVI output",
@@ -411,6 +486,12 @@ klfengine::format_spec run_implementation::impl_make_canonical(
     return canon_format;
   }
   if (format.format == "DVI") {
+    if (d->batch) {
+      param.disable_check();
+      throw no_such_format{
+        "There is no \"latex_raw\" DVI because the input was compiled in a batch"
+      };
+    }
     if (d->via_dvi) {
       bool latex_raw = param.take("latex_raw", true);
       if (latex_raw == false) {
@@ -430,6 +511,14 @@ klfengine::format_spec run_implementation::impl_make_canonical(
     }
   }
 
+  if (format.format == "SVG") {
+    canon_format.format = "SVG";
+    canon_format.parameters["outline_fonts"] =
+      value{param.take<bool>("outline_fonts", input().outline_fonts)};
+    param.finished();
+    return canon_format;
+  }
+
   if (format.format == "PDF" || format.format == "PS") {
     // these formats can be the latex raw versions, enabled with latex_raw=true.
     bool want_latex_raw = param.take("latex_raw", false);
@@ -441,6 +530,12 @@ klfengine::format_spec run_implementation::impl_make_canonical(
           "There is no \"latex_raw\" PDF because the latex engine doesn't directly generate PDF"
         };
       }
+      if (format.format == "PDF" && d->batch) {
+        param.disable_check();
+        throw no_such_format{
+          "There is no \"latex_raw\" PDF because the input was compiled in a batch"
+        };
+      }
       if (format.format == "PS" && !d->via_dvi) {
         param.disable_check();
         throw no_such_format{
@@ -457,9 +552,8 @@ klfengine::format_spec run_implementation::impl_make_canonical(
 
     // get Ghostscript's canonical format
     
-    format_spec gs_format{ format.format, param.take_remaining() };
+    canon_format = d->gs_args_provider.take_canonical_format( format.format, param );
     param.finished();
-    canon_format = d->gs_args_provider.canonical_format( std::move(gs_format) );
     // fix canonical format to have this key regardless of whether raw version is available
     canon_format.parameters["latex_raw"] = value{false};
     return canon_format;
@@ -480,6 +574,13 @@ klfengine::format_spec run_implementation::impl_make_canonical(
 _KLFENGINE_INLINE
 klfengine::binary_data
 run_implementation::impl_produce_data(const klfengine::format_spec & format)
+{
+  return impl_produce_shared_data(format).binary();
+}
+
+_KLFENGINE_INLINE
+klfengine::shared_binary_data
+run_implementation::impl_produce_shared_data(const klfengine::format_spec & format)
 {
   using namespace klfengine::detail::utils;
   using namespace klfengine::detail;
@@ -495,7 +596,19 @@ run_implementation::impl_produce_data(const klfengine::format_spec & format)
   // 
   bool latex_raw = param.take("latex_raw", false);
   if (latex_raw == true) {
-    // All available RAW formats have all been stored in the cache at
+    if (format.format == "PS" && d->via_dvi && d->use_dvipng) {
+      // dvips was deferred at compile-time, run it now
+      param.finished();
+      {
+        std::lock_guard<std::mutex> lckgrd(d->prepare_mutex);
+        if (!d->dvips_done) {
+          run_dvips();
+        }
+      }
+      // the PS file is still needed as Ghostscript input, don't take it
+      return load_file_shared(d->fn.ps);
+    }
+    // All other available RAW formats have all been stored in the cache at
     // compile-time.  If this function was called with a latex_raw=true
     // parameter, it means that there is no corresponding raw data.
     param.disable_check();
@@ -504,10 +617,45 @@ run_implementation::impl_produce_data(const klfengine::format_spec & format)
   }
 
 
-  auto param_remaining = param.take_remaining();
+  if (format.format == "SVG") {
+    // dvisvgm doesn't need Ghostscript for DVI input.  Crop to the exact
+    // bounding box and add margins, scale and background ourselves.
+    bool outline_fonts = param.take<bool>("outline_fonts");
+    param.finished();
+
+    job_scheduler::slot stage_slot = acquire_stage(job_stage::gs_render);
+    binary_data svg_data = run_dvisvgm(
+        settings(),
+        d->via_dvi ? d->fn.dvi : d->fn.pdf,
+        dvisvgm_options{ !d->via_dvi, outline_fonts, true },
+        (d->page > 0) ? d->page : 1
+    );
+    stage_slot.release();
+    std::string svg = svg_adjust_canvas(
+        std::string{svg_data.begin(), svg_data.end()},
+        in.margins.left.to_value_as_bp(),
+        in.margins.top.to_value_as_bp(),
+        in.margins.right.to_value_as_bp(),
+        in.margins.bottom.to_value_as_bp(),
+        in.scale,
+        in.bg_color
+    );
+    return shared_binary_data{ binary_data{svg.begin(), svg.end()} };
+  }
+
+  if (can_use_dvipng(format)) {
+    return produce_png_with_dvipng(param);
+  }
+
+  // the remaining (canonical) parameters are Ghostscript's
+  std::vector<std::string> gs_process_args{
+    d->gs_args_provider.take_device_args_for_format(format.format, param)
+  };
   param.finished();
   // -----
 
+  ensure_gs_input_ready();
+
 
   const double bg_bleed_pt = 1.0; // draw bg rectangle extending 1 pt outside each margin side
 
@@ -529,16 +677,10 @@ run_implementation::impl_produce_data(const klfengine::format_spec & format)
 
   // don't use ghostscript STDOUT so that we can also use libgs-based methods in
   // ghostscript_interface
-  fs::path outf = d->fn.base;
-  outf.replace_filename(d->fn.base.filename().generic_string() + "-gs."
-                        + to_lowercase(format.format));
-
-  std::vector<std::string> gs_process_args{
-    d->gs_args_provider.get_device_args_for_format(
-      format_spec{format.format, param_remaining}
-    )
-  };
+  fs::path outf = d->new_output_file("-gs." + to_lowercase(format.format));
 
+  // output file, size, page, PostScript init code and input file (see below)
+  gs_process_args.reserve(gs_process_args.size() + 10);
   gs_process_args.push_back("-sOutputFile="+outf.native());
 
   const double widthpt  = d->bbox.x2 - d->bbox.x1;
@@ -551,12 +693,22 @@ run_implementation::impl_produce_data(const klfengine::format_spec & format)
   gs_process_args.push_back("-dDEVICEHEIGHTPOINTS=" + dbl_to_string(heightpt));
   gs_process_args.push_back("-dFIXEDMEDIA");
 
+  // our page of the input file, if it is a batch document
+  for (std::string & arg : gs_page_args()) {
+    gs_process_args.push_back(std::move(arg));
+  }
+
 
   // PostScript page initialization code -- draw background color rectangle,
   // then apply translation & scaling
   std::string gs_ps_cmds;
-  gs_ps_cmds +=
-    "<< /BeginPage { ";
+  gs_ps_cmds.reserve(512);
+  auto ps_num = [&gs_ps_cmds](double x) {
+    gs_ps_cmds += dbl_to_string(x);
+    gs_ps_cmds += ' ';
+  };
+
+  gs_ps_cmds += "<< /BeginPage { ";
 
   if (!bg_is_fully_transparent) {
 
@@ -567,33 +719,41 @@ run_implementation::impl_produce_data(const klfengine::format_spec & format)
            "color, alpha component is ignored.");
     }
 
-    gs_ps_cmds +=
-      "newpath " +
-      dbl_to_string(-bg_bleed_pt) +  " " + dbl_to_string(-bg_bleed_pt) + " moveto " +
-      dbl_to_string(widthpt+2*bg_bleed_pt) + " " + dbl_to_string(-bg_bleed_pt) + " lineto " +
-      dbl_to_string(widthpt+2*bg_bleed_pt) + " "
-          + dbl_to_string(heightpt+2*bg_bleed_pt) + " lineto " +
-      dbl_to_string(-bg_bleed_pt) + " " + dbl_to_string(heightpt+2*bg_bleed_pt)+ " lineto " +
+    gs_ps_cmds += "newpath ";
+    ps_num(-bg_bleed_pt);
+    ps_num(-bg_bleed_pt);
+    gs_ps_cmds += "moveto ";
+    ps_num(widthpt+2*bg_bleed_pt);
+    ps_num(-bg_bleed_pt);
+    gs_ps_cmds += "lineto ";
+    ps_num(widthpt+2*bg_bleed_pt);
+    ps_num(heightpt+2*bg_bleed_pt);
+    gs_ps_cmds += "lineto ";
+    ps_num(-bg_bleed_pt);
+    ps_num(heightpt+2*bg_bleed_pt);
+    gs_ps_cmds += "lineto "
       "closepath "
-      "gsave " +
-      dbl_to_string(in.bg_color.red/255.0) + " " + dbl_to_string(in.bg_color.green/255.0)
-          + " " + dbl_to_string(in.bg_color.blue/255.0) + " setrgbcolor "
+      "gsave ";
+    ps_num(in.bg_color.red/255.0);
+    ps_num(in.bg_color.green/255.0);
+    ps_num(in.bg_color.blue/255.0);
+    gs_ps_cmds += "setrgbcolor "
       "fill "
-      "grestore "
-      ;
+      "grestore ";
   }
 
-  gs_ps_cmds += dbl_to_string(-d->bbox.x1) + " " + dbl_to_string(-d->bbox.y1)
-    + " translate ";
-  gs_ps_cmds += dbl_to_string(in.scale) + " " + dbl_to_string(in.scale) + " scale ";
+  ps_num(-d->bbox.x1);
+  ps_num(-d->bbox.y1);
+  gs_ps_cmds += "translate ";
+  ps_num(in.scale);
+  ps_num(in.scale);
+  gs_ps_cmds += "scale ";
   
   gs_ps_cmds +=
     "} >> setpagedevice ";
   
   gs_process_args.push_back("-c");
-  gs_process_args.push_back(gs_ps_cmds);
-
-  //fprintf(stderr, "DEBUG: gs_ps_cmds = %s\n", gs_ps_cmds.c_str());
+  gs_process_args.push_back(std::move(gs_ps_cmds));
 
   // finally, the input file
   gs_process_args.push_back("-f");
@@ -602,6 +762,7 @@ run_implementation::impl_produce_data(const klfengine::format_spec & format)
   // now, run the full ghostscript command.
   //binary_data gs_stderr;
   //binary_data gs_stdout;
+  job_scheduler::slot stage_slot = acquire_stage(job_stage::gs_render);
   gs_iface->run_gs(
     gs_process_args,
     ghostscript_interface::add_standard_batch_flags{true}
@@ -609,9 +770,106 @@ run_implementation::impl_produce_data(const klfengine::format_spec & format)
     //ghostscript_interface::capture_stderr_data{&gs_stderr}
   );
 
-  binary_data gs_result_data{ load_file_data(outf.native()) };
+  // take the output file, it's not needed anymore once its data is loaded
+  return load_file_shared(outf, true);
+}
+
+_KLFENGINE_INLINE
+bool run_implementation::can_use_dvipng(const klfengine::format_spec & format)
+{
+  if (!d->use_dvipng || format.format != "PNG") {
+    return false;
+  }
+
+  const klfengine::input & in = input();
+
+  // dvipng crops to the tight bounding box of the ink, but it can't add any
+  // margins around it
+  if (in.margins.left.to_value_as_bp() != 0 || in.margins.right.to_value_as_bp() != 0 ||
+      in.margins.top.to_value_as_bp() != 0 || in.margins.bottom.to_value_as_bp() != 0) {
+    return false;
+  }
+
+  try {
+    (void) settings().get_tex_executable_path("dvipng");
+  } catch (const cannot_find_executable & e) {
+    warn("klfengine::engines::latextoimage",
+         std::string{"Cannot use dvipng, falling back to Ghostscript: "} + e.what());
+    d->use_dvipng = false;
+    return false;
+  }
+
+  return true;
+}
+
+_KLFENGINE_INLINE
+klfengine::shared_binary_data
+run_implementation::produce_png_with_dvipng(parameter_taker & param)
+{
+  using namespace klfengine::detail::utils;
+
+  const klfengine::input & in = input();
+
+  bool transparency = param.take<bool>("transparency");
+  int dpi = param.take<int>("dpi");
+  const value::dict & antialiasing_dic = param.take<value::dict>("antialiasing");
+  param.finished();
+
+  // dvipng uses N x N subsamples for each pixel; map gs's alpha bits (1, 2 or
+  // 4) to the same number of subsamples
+  const int quality = dict_get<int>(antialiasing_dic, "text_alpha_bits", 4);
+
+  std::string bg;
+  if (in.bg_color.alpha > 0) {
+    if (in.bg_color.alpha < 255) {
+      // no support for partially transparent background -- warn user
+      warn("latextoimage_engine::engine_run_implementation",
+           "This engine does not support a partially transparent background "
+           "color, alpha component is ignored.");
+    }
+    bg = "rgb " + dbl_to_string(in.bg_color.red/255.0) + " "
+      + dbl_to_string(in.bg_color.green/255.0) + " "
+      + dbl_to_string(in.bg_color.blue/255.0);
+  } else if (transparency) {
+    bg = "Transparent";
+  } else {
+    bg = "rgb 1 1 1";
+  }
+
+  fs::path outf = d->new_output_file("-dvipng.png");
+
+  binary_data dvipng_out;
+  binary_data dvipng_err;
+
+  std::vector<std::string> argv{
+    settings().get_tex_executable_path("dvipng"),
+    "-q",
+    "-T", "tight",
+    "-D", std::to_string(static_cast<int>(std::lround(dpi * in.scale))),
+    "-Q", std::to_string(quality),
+    "-bg", bg,
+    "-o", outf.native()
+  };
+  if (d->page > 0) {
+    // only our page of the batch document; "=N" selects the N-th physical
+    // page rather than by TeX page number
+    argv.push_back("-p");
+    argv.push_back("=" + std::to_string(d->page));
+    argv.push_back("-l");
+    argv.push_back("=" + std::to_string(d->page));
+  }
+  argv.push_back(d->fn.dvi.native());
+
+  job_scheduler::slot stage_slot = acquire_stage(job_stage::gs_render);
+
+  process::run_and_wait(
+    std::move(argv),
+    process::run_in_directory{ d->temp_dir.path().native() },
+    process::capture_stdout_data{&dvipng_out},
+    process::capture_stderr_data{&dvipng_err}
+    );
 
-  return gs_result_data;
+  return klfengine::detail::load_file_shared(outf, true);
 }
 
 
@@ -28,8 +28,11 @@
 
 #pragma once
 
+#include <mutex>
 #include <regex>
 #include <string>
+#include <iterator>
+#include <algorithm>
 
 #include <klfengine/process>
 #include <klfengine/h/detail/utils.h>
@@ -59,9 +62,31 @@ ghostscript_error::~ghostscript_error()
 
 struct ghostscript_interface_private
 {
+  ghostscript_interface_private(ghostscript_interface::method method_,
+                                std::string gs_path_,
+                                ghostscript_interface::process_server_options server_options_)
+    : method(method_),
+      gs_path(std::move(gs_path_)),
+      server_options(std::move(server_options_)),
+      server_mutex(),
+      server_initialized(false),
+      server_pool()
+  {}
+
   ghostscript_interface::method method;
   std::string gs_path;
 
+  ghostscript_interface::process_server_options server_options;
+
+  // for the "process-server" method -- the pool of resident gs processes is
+  // created on first use
+  std::mutex server_mutex;
+  bool server_initialized;
+  std::shared_ptr<detail::gs_process_server_pool> server_pool;
+
+  std::shared_ptr<detail::gs_process_server_pool>
+  get_server_pool(ghostscript_interface * iface);
+
   std::vector<std::string> construct_gs_argv(
     std::string argv0,
     std::vector<std::string> gs_args,
@@ -75,6 +100,14 @@ struct ghostscript_interface_private
     binary_data * capture_stdout,
     binary_data * capture_stderr
   );
+  void impl_run_gs_process_server(
+    std::vector<std::string> gs_argv,
+    const binary_data * stdin_data,
+    bool add_standard_batch_flags,
+    binary_data * capture_stdout,
+    binary_data * capture_stderr,
+    ghostscript_interface * iface
+  );
   void impl_run_gs_linkedlibgs(
     std::vector<std::string> gs_argv,
     const binary_data * stdin_data,
@@ -93,15 +126,19 @@ struct ghostscript_interface_private
 
 
 _KLFENGINE_INLINE
-ghostscript_interface::ghostscript_interface(method method_, std::string gs_path)
+ghostscript_interface::ghostscript_interface(method method_, std::string gs_path,
+                                             process_server_options server_options)
 {
-  d = new ghostscript_interface_private{method_, std::move(gs_path)};
+  d = new ghostscript_interface_private{method_, std::move(gs_path),
+                                        std::move(server_options)};
 }
 
 _KLFENGINE_INLINE
-ghostscript_interface::ghostscript_interface(std::string method_s, std::string gs_path)
+ghostscript_interface::ghostscript_interface(std::string method_s, std::string gs_path,
+                                             process_server_options server_options)
 {
-  d = new ghostscript_interface_private{parse_method(method_s), std::move(gs_path)};
+  d = new ghostscript_interface_private{parse_method(method_s), std::move(gs_path),
+                                        std::move(server_options)};
 }
 
 _KLFENGINE_INLINE
@@ -125,6 +162,12 @@ const std::string & ghostscript_interface::gs_path() const
 {
   return d->gs_path;
 }
+_KLFENGINE_INLINE
+const ghostscript_interface::process_server_options &
+ghostscript_interface::gs_process_server_options() const
+{
+  return d->server_options;
+}
 
 
 
@@ -137,6 +180,8 @@ ghostscript_interface::parse_method(const std::string & method_s)
     return method::None;
   } else if (method_s == "process") {
     return method::Process;
+  } else if (method_s == "process-server") {
+    return method::ProcessServer;
   } else if (method_s == "linked-libgs") {
     return method::LinkedLibgs;
   } else if (method_s == "load-libgs") {
@@ -299,6 +344,11 @@ void ghostscript_interface::impl_run_gs(
                            capture_stdout, capture_stderr);
     return;
   }
+  case method::ProcessServer: {
+    d->impl_run_gs_process_server(std::move(gs_args), stdin_data, add_standard_batch_flags,
+                                  capture_stdout, capture_stderr, this);
+    return;
+  }
   case method::LinkedLibgs: {
     d->impl_run_gs_linkedlibgs(std::move(gs_args), stdin_data, add_standard_batch_flags,
                                capture_stdout, capture_stderr);
@@ -328,20 +378,21 @@ ghostscript_interface_private::construct_gs_argv(
   bool add_standard_batch_flags
 )
 {
+  // build the argument list in a single allocation, moving the given
+  // arguments rather than shifting them to make room at the front
+  std::vector<std::string> gs_argv;
+  gs_argv.reserve(gs_args.size() + 5);
+
+  gs_argv.push_back(std::move(argv0));
   if (add_standard_batch_flags) {
-    std::vector<std::string> init_args{
-      argv0,
-      "-dNOPAUSE",
-      "-dBATCH",
-      "-dSAFER",
-      "-q"
-    };
-    gs_args.insert(gs_args.begin(), init_args.begin(), init_args.end());
-  } else {
-    gs_args.insert(gs_args.begin(), argv0);
+    gs_argv.push_back("-dNOPAUSE");
+    gs_argv.push_back("-dBATCH");
+    gs_argv.push_back("-dSAFER");
+    gs_argv.push_back("-q");
   }
+  std::move(gs_args.begin(), gs_args.end(), std::back_inserter(gs_argv));
 
-  return gs_args;
+  return gs_argv;
 }
 
 // -------------------------------------
@@ -380,6 +431,116 @@ void ghostscript_interface_private::impl_run_gs_process(
 }
 
 
+// -------------------------------------
+// run_gs - "process-server" method
+// -------------------------------------
+
+inline
+std::shared_ptr<detail::gs_process_server_pool>
+ghostscript_interface_private::get_server_pool(ghostscript_interface * iface)
+{
+  std::lock_guard<std::mutex> lock{server_mutex};
+
+  if (server_initialized) {
+    return server_pool;
+  }
+  server_initialized = true;
+
+#if defined(__unix__) || defined(__APPLE__)
+  if ( ! fs::exists(gs_path) ) {
+    throw std::runtime_error("Invalid gs path: " + gs_path) ;
+  }
+
+  // --permit-file-all= and friends appeared in gs 9.50.  (Note this doesn't
+  // recurse into the server pool because "--version" isn't a server job.)
+  ghostscript_interface::gs_version_t ver = iface->get_gs_version();
+  if (ver.major < 9 || (ver.major == 9 && ver.minor < 50)) {
+    warn("klfengine::ghostscript_interface",
+         "The \"process-server\" method requires Ghostscript >= 9.50, you have "
+         + std::to_string(ver.major) + "." + std::to_string(ver.minor)
+         + ".  Falling back to the \"process\" method.");
+    return nullptr;
+  }
+
+  std::vector<std::string> gs_argv{
+    gs_path,
+    "-q",
+    "-dNOPAUSE",
+    "-dSAFER",
+    "-dNODISPLAY"
+  };
+  for (const auto & p : server_options.permitted_paths) {
+    if (p.empty()) {
+      continue;
+    }
+    fs::path pp = fs::absolute(fs::path{p});
+    gs_argv.push_back("--permit-file-all=" + (pp / "*").generic_string());
+  }
+  gs_argv.push_back("-");
+
+  server_pool = std::make_shared<detail::gs_process_server_pool>(
+    std::move(gs_argv), server_options.pool_size,
+    std::chrono::milliseconds(std::max(server_options.job_timeout_ms, 0))
+  );
+  return server_pool;
+#else
+  (void)iface;
+  return nullptr;
+#endif
+}
+
+inline
+void ghostscript_interface_private::impl_run_gs_process_server(
+  std::vector<std::string> gs_args,
+  const binary_data * stdin_data,
+  bool add_standard_batch_flags,
+  binary_data * capture_stdout,
+  binary_data * capture_stderr,
+  ghostscript_interface * iface
+)
+{
+  // Only jobs with the standard batch flags and without any stdin data can be
+  // sent to a server process.  Anything else gets its own process.
+  std::string ps_code;
+  std::shared_ptr<detail::gs_process_server_pool> pool;
+  if (add_standard_batch_flags
+      && (stdin_data == nullptr || stdin_data->empty())
+      && detail::gs_process_server_job_from_args(gs_args, &ps_code)) {
+    pool = get_server_pool(iface);
+  }
+  if (pool == nullptr) {
+    impl_run_gs_process(std::move(gs_args), stdin_data, add_standard_batch_flags,
+                        capture_stdout, capture_stderr);
+    return;
+  }
+
+  bool ok = false;
+  try {
+    ok = pool->run_job(ps_code, capture_stdout, capture_stderr);
+  } catch (detail::gs_process_server_died & e) {
+    throw ghostscript_error(e.what());
+  } catch (detail::gs_process_server_job_timeout & e) {
+    throw ghostscript_error(e.what());
+  }
+  if (ok) {
+    return;
+  }
+
+  // Ghostscript reported an error.  Run the same command in a separate process
+  // to get the exact same error behavior as with the "process" method.  If
+  // that process succeeds, then the server environment is at fault -- stop
+  // using it.
+  impl_run_gs_process(std::move(gs_args), stdin_data, add_standard_batch_flags,
+                      capture_stdout, capture_stderr);
+
+  warn("klfengine::ghostscript_interface",
+       "A Ghostscript job failed in the resident server process but succeeded "
+       "in a separate process.  Disabling the \"process-server\" method.");
+  std::lock_guard<std::mutex> lock{server_mutex};
+  server_pool.reset();
+}
+
+
 // -------------------------------------
 
 
@@ -475,6 +636,15 @@ static int _klfengine_gs_callback_stderr_fn(void * caller_handle, const char * b
   //(void)caller_handle; (void)buf; return 0;
 }
 
+// Unless it was built with GS_THREADSAFE, libgs supports only a single
+// instance at a time in the whole process.  Formats of a run may be produced
+// from different threads, so we serialize the library calls.
+inline std::mutex & libgs_instance_mutex()
+{
+  static std::mutex m;
+  return m;
+}
+
 } // namespace detail
 
 #endif
@@ -533,6 +703,8 @@ void ghostscript_interface_private::impl_run_gs_linkedlibgs(
   void *gs_minst = NULL;
   int gs_ret_code = 0;
   int gs_ret_code_2 = 0;
+
+  std::unique_lock<std::mutex> libgs_lock{detail::libgs_instance_mutex()};
   
   // second argument is our "custom callback handle"
   gs_ret_code = gsapi_new_instance(&gs_minst, reinterpret_cast<void*>(&gs_cb));
@@ -562,6 +734,8 @@ void ghostscript_interface_private::impl_run_gs_linkedlibgs(
 
   gsapi_delete_instance(gs_minst);
 
+  libgs_lock.unlock();
+
   if ((gs_ret_code == 0) || (gs_ret_code == gs_error_Quit) || (gs_ret_code == gs_error_Info)) {
     // all ok
     return;
@@ -631,18 +805,39 @@ void ghostscript_interface_engine_tool::set_settings(const settings & settings)
 
   const std::string emptystr;
   gs_sett_pair_t newsett{ghostscript_interface::parse_method(settings.gs_method), &emptystr};
-  if (newsett.method == ghostscript_interface::method::Process) {
+  if (newsett.method == ghostscript_interface::method::Process
+      || newsett.method == ghostscript_interface::method::ProcessServer) {
     newsett.gs_path_ptr = & settings.gs_executable_path;
   } else if (newsett.method == ghostscript_interface::method::LoadLibgs) {
     newsett.gs_path_ptr = & settings.gs_libgs_path;
   }
 
+  // server processes may only access files in our temporary directory, or in
+  // the system temporary directory that we fall back to if it runs out of
+  // space (see settings::get_temporary_directory_path())
+  ghostscript_interface::process_server_options new_server_options{
+    settings.gs_process_server_pool_size,
+    { fs::temp_directory_path().generic_string() },
+    settings.gs_process_server_job_timeout_ms
+  };
+  if (settings.temporary_directory.size()) {
+    new_server_options.permitted_paths.push_back(settings.temporary_directory);
+  }
+
   if (_gs_interface) {
     if (cursett.method == newsett.method) {
       if (cursett.method == ghostscript_interface::method::Process) {
         if (settings.gs_executable_path == *cursett.gs_path_ptr) {
           return; // no changes to gs method / path
         }
+      } else if (cursett.method == ghostscript_interface::method::ProcessServer) {
+        const auto & cur_server_options = _gs_interface->gs_process_server_options();
+        if (settings.gs_executable_path == *cursett.gs_path_ptr
+            && cur_server_options.pool_size == new_server_options.pool_size
+            && cur_server_options.permitted_paths == new_server_options.permitted_paths
+            && cur_server_options.job_timeout_ms == new_server_options.job_timeout_ms) {
+          return; // no changes to gs method / path / server options
+        }
       } else if (cursett.method == ghostscript_interface::method::LoadLibgs) {
         if (settings.gs_libgs_path == *cursett.gs_path_ptr) {
           return; // no changes to gs method / path
@@ -657,7 +852,8 @@ void ghostscript_interface_engine_tool::set_settings(const settings & settings)
   // changes, need to create new ghostscript_interface object.  Being a
   // std::unique_ptr, this will delete any old instance, if any.
   _gs_interface = std::unique_ptr<ghostscript_interface>{
-    new ghostscript_interface{newsett.method, *newsett.gs_path_ptr}
+    new ghostscript_interface{newsett.method, *newsett.gs_path_ptr,
+                              std::move(new_server_options)}
   };
 
   _gs_version_and_info = _gs_interface->get_gs_version_and_info();
@@ -769,23 +965,54 @@ format_spec gs_device_args_format_provider::impl_make_canonical(
     "klfengine::ghostscript_interface::impl_make_canonical"
   };
 
-  if (format.format == "PDF" || format.format == "PS" || format.format == "EPS") {
+  format_spec f = _make_canonical_taking(format.format, param);
+
+  if (f.format.empty()) {
+    // no such format
+    param.disable_check();
+    return f;
+  }
+
+  param.finished();
+  return f;
+}
+
+_KLFENGINE_INLINE
+format_spec gs_device_args_format_provider::take_canonical_format(
+  const std::string & format_name,
+  parameter_taker & param
+)
+{
+  format_spec f = _make_canonical_taking(format_name, param);
+  if (f.format.empty()) {
+    param.disable_check();
+    throw no_such_format(format_name, "format is unknown or is not available");
+  }
+  return f;
+}
+
+_KLFENGINE_INLINE
+format_spec gs_device_args_format_provider::_make_canonical_taking(
+  const std::string & format_name,
+  parameter_taker & param
+)
+{
+  if (format_name == "PDF" || format_name == "PS" || format_name == "EPS") {
 
-    format_spec f{format.format, {}};
+    format_spec f{format_name, {}};
 
     bool outline_fonts = dict_get<bool>(_param_defaults, "outline_fonts", true);
     f.parameters["outline_fonts"] = value{param.take<bool>("outline_fonts", outline_fonts)};
 
-    param.finished();
     return f;
   }
 
-  if (format.format == "PNG" || format.format == "JPEG" || format.format == "TIFF"
-      || format.format == "BMP") {
+  if (format_name == "PNG" || format_name == "JPEG" || format_name == "TIFF"
+      || format_name == "BMP") {
 
-    format_spec f{format.format, {}};
+    format_spec f{format_name, {}};
     
-    if (format.format == "PNG") {
+    if (format_name == "PNG") {
       bool transparency = dict_get<bool>(_param_defaults, "transparency", true);
       transparency = param.take("transparency", transparency);
       f.parameters["transparency"] = value{transparency};
@@ -795,8 +1022,9 @@ format_spec gs_device_args_format_provider::impl_make_canonical(
     f.parameters["dpi"] = value{param.take<int>("dpi", dpi)};
     
     value::dict aadic;
-    value antialiasing = dict_get<value>(_param_defaults, "antialiasing", value{true});
-    antialiasing = param.take("antialiasing", antialiasing);
+    const value default_antialiasing =
+      dict_get<value>(_param_defaults, "antialiasing", value{true});
+    const value & antialiasing = param.take("antialiasing", default_antialiasing);
     if (antialiasing.has_type<bool>()) {
       if (antialiasing.get<bool>()) {
         aadic["graphics_alpha_bits"] = value{4};
@@ -818,14 +1046,11 @@ format_spec gs_device_args_format_provider::impl_make_canonical(
       param.disable_check();
       throw invalid_parameter{param.what(), "invalid value for antialiasing="};
     }
-    f.parameters["antialiasing"] = value{aadic};
+    f.parameters["antialiasing"] = value{std::move(aadic)};
     
-    param.finished();
     return f;
   }
 
-  param.disable_check();
-
   // no such format
   return format_spec{};
 }
@@ -836,18 +1061,28 @@ gs_device_args_format_provider::get_device_args_for_format( const format_spec &
 {
   format_spec format = canonical_format(fmt);
 
-  std::vector<std::string> gs_args;
-
   parameter_taker param{
     format.parameters,
     "klfengine::ghostscript_interface::gs_args_set_device_for_format"
   };
   param.disable_check();
 
+  return take_device_args_for_format(format.format, param);
+}
+
+_KLFENGINE_INLINE
+std::vector<std::string>
+gs_device_args_format_provider::take_device_args_for_format(
+  const std::string & format_name,
+  parameter_taker & param
+)
+{
+  std::vector<std::string> gs_args;
+
   bool is_vector_format = true;
 
   // choose correct device
-  if (format.format == "PNG") {
+  if (format_name == "PNG") {
     is_vector_format = false;
     bool transparency = param.take<bool>("transparency");
     if (transparency) {
@@ -858,27 +1093,27 @@ gs_device_args_format_provider::get_device_args_for_format( const format_spec &
     } else {
       gs_args.push_back("-sDEVICE=png16m");
     }
-  } else if (format.format == "JPEG") {
+  } else if (format_name == "JPEG") {
     is_vector_format = false;
     gs_args.push_back("-sDEVICE=jpeg");
     // TODO : parameter to set JPEG quality
-  } else if (format.format == "TIFF") {
+  } else if (format_name == "TIFF") {
     is_vector_format = false;
     gs_args.push_back("-sDEVICE=tiff24nc");
-  } else if (format.format == "BMP") {
+  } else if (format_name == "BMP") {
     is_vector_format = false;
     gs_args.push_back("-sDEVICE=bmp16m");
-  } else if (format.format == "PDF") {
+  } else if (format_name == "PDF") {
     is_vector_format = true;
     gs_args.push_back("-sDEVICE=pdfwrite");
-  } else if (format.format == "PS") {
+  } else if (format_name == "PS") {
     is_vector_format = true;
     gs_args.push_back("-sDEVICE=ps2write");
-  } else if (format.format == "EPS") {
+  } else if (format_name == "EPS") {
     is_vector_format = true;
     gs_args.push_back("-sDEVICE=eps2write");
   } else {
-    throw std::invalid_argument{"Cannot produce Ghostscript flags for format "+format.format};
+    throw std::invalid_argument{"Cannot produce Ghostscript flags for format "+format_name};
   }
 
   // outline fonts, if applicable
@@ -905,7 +1140,7 @@ gs_device_args_format_provider::get_device_args_for_format( const format_spec &
     int dpi = param.take<int>("dpi");
     gs_args.push_back("-r" + std::to_string(dpi));
 
-    value::dict antialiasing_dic = param.take<value::dict>("antialiasing");
+    const value::dict & antialiasing_dic = param.take<value::dict>("antialiasing");
 
     const int graphics_alpha_bits = dict_get<int>(antialiasing_dic, "graphics_alpha_bits");
     const int text_alpha_bits = dict_get<int>(antialiasing_dic, "text_alpha_bits");
@@ -0,0 +1,158 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <klfengine/job_scheduler>
+
+
+namespace klfengine {
+
+
+
+_KLFENGINE_INLINE
+job_scheduler::slot & job_scheduler::slot::operator=(slot && other) noexcept
+{
+  if (this != &other) {
+    release();
+    _s = other._s;
+    _stage = other._stage;
+    other._s = nullptr;
+  }
+  return *this;
+}
+
+_KLFENGINE_INLINE
+void job_scheduler::slot::release() noexcept
+{
+  if (_s != nullptr) {
+    _s->release_slot(_stage);
+    _s = nullptr;
+  }
+}
+
+
+
+_KLFENGINE_INLINE
+job_scheduler::job_scheduler()
+  : _mutex()
+{
+  for (auto & st : _stages) {
+    st.max_concurrent = 0;
+    st.num_running = 0;
+    for (int p = 0; p < 2; ++p) {
+      st.next_ticket[p] = 0;
+      st.now_serving[p] = 0;
+    }
+  }
+}
+
+_KLFENGINE_INLINE
+void job_scheduler::set_max_concurrent(job_stage stage, std::size_t max_concurrent)
+{
+  stage_state & st = _stages[static_cast<std::size_t>(stage)];
+  {
+    std::lock_guard<std::mutex> lck(_mutex);
+    st.max_concurrent = max_concurrent;
+  }
+  // a raised limit might let some waiting jobs start
+  st.cond.notify_all();
+}
+
+_KLFENGINE_INLINE
+std::size_t job_scheduler::max_concurrent(job_stage stage) const
+{
+  std::lock_guard<std::mutex> lck(_mutex);
+  return _stages[static_cast<std::size_t>(stage)].max_concurrent;
+}
+
+_KLFENGINE_INLINE
+job_scheduler::slot job_scheduler::acquire(job_stage stage, job_priority priority)
+{
+  stage_state & st = _stages[static_cast<std::size_t>(stage)];
+  const std::size_t p = static_cast<std::size_t>(priority);
+  const std::size_t p_interactive = static_cast<std::size_t>(job_priority::interactive);
+
+  std::unique_lock<std::mutex> lck(_mutex);
+
+  const std::uint64_t ticket = st.next_ticket[p]++;
+
+  st.cond.wait(lck, [&]() {
+    if (ticket != st.now_serving[p]) {
+      return false; // others of the same priority were here first
+    }
+    if (p != p_interactive &&
+        st.next_ticket[p_interactive] != st.now_serving[p_interactive]) {
+      return false; // interactive jobs are waiting
+    }
+    return (st.max_concurrent == 0 || st.num_running < st.max_concurrent);
+  });
+
+  ++st.now_serving[p];
+  ++st.num_running;
+
+  lck.unlock();
+  // the next job in line might be able to start, too
+  st.cond.notify_all();
+
+  return slot{this, stage};
+}
+
+_KLFENGINE_INLINE
+void job_scheduler::release_slot(job_stage stage)
+{
+  stage_state & st = _stages[static_cast<std::size_t>(stage)];
+  {
+    std::lock_guard<std::mutex> lck(_mutex);
+    --st.num_running;
+  }
+  st.cond.notify_all();
+}
+
+_KLFENGINE_INLINE
+std::size_t job_scheduler::num_running(job_stage stage) const
+{
+  std::lock_guard<std::mutex> lck(_mutex);
+  return _stages[static_cast<std::size_t>(stage)].num_running;
+}
+
+_KLFENGINE_INLINE
+std::size_t job_scheduler::num_waiting(job_stage stage) const
+{
+  std::lock_guard<std::mutex> lck(_mutex);
+  const stage_state & st = _stages[static_cast<std::size_t>(stage)];
+  std::size_t n = 0;
+  for (int p = 0; p < 2; ++p) {
+    n += static_cast<std::size_t>(st.next_ticket[p] - st.now_serving[p]);
+  }
+  return n;
+}
+
+
+
+} // namespace klfengine
@@ -0,0 +1,350 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstring>
+
+#include <klfengine/latex_log>
+
+
+namespace klfengine {
+
+
+namespace detail {
+
+inline bool log_starts_with(const char * b, const char * e, const char * prefix)
+{
+  const std::size_t n = std::strlen(prefix);
+  return (static_cast<std::size_t>(e - b) >= n) && (std::memcmp(b, prefix, n) == 0);
+}
+
+inline const char * log_find(const char * b, const char * e, const char * needle)
+{
+  const std::size_t n = std::strlen(needle);
+  if (n == 0) {
+    return b;
+  }
+  while (static_cast<std::size_t>(e - b) >= n) {
+    const char * p = static_cast<const char *>(std::memchr(b, needle[0], (e - b) - n + 1));
+    if (p == nullptr) {
+      return nullptr;
+    }
+    if (std::memcmp(p, needle, n) == 0) {
+      return p;
+    }
+    b = p + 1;
+  }
+  return nullptr;
+}
+
+inline bool log_is_digit(char c)
+{
+  return (c >= '0' && c <= '9');
+}
+
+// parse the decimal integer at b; returns -1 if there is no digit at b.
+// *endptr is set to the first character after the number.
+inline int log_parse_int(const char * b, const char * e, const char ** endptr = nullptr)
+{
+  int val = -1;
+  const char * p = b;
+  for ( ; p < e && log_is_digit(*p); ++p) {
+    val = (val < 0 ? 0 : val*10) + (*p - '0');
+  }
+  if (endptr != nullptr) {
+    *endptr = p;
+  }
+  return val;
+}
+
+// Find the file name in messages like "File `foo.sty' not found." or "I can't
+// find file `foo'."  Returns false if the message isn't about a missing file.
+inline bool log_missing_file_name(const char * b, const char * e, std::string * fname)
+{
+  const char * q = nullptr;
+  if (log_starts_with(b, e, "LaTeX Error: File `")) {
+    q = b + std::strlen("LaTeX Error: File `");
+  } else if (log_starts_with(b, e, "I can't find file `")) {
+    q = b + std::strlen("I can't find file `");
+  } else {
+    return false;
+  }
+  const char * qe = static_cast<const char *>(std::memchr(q, '\'', e - q));
+  if (qe == nullptr) {
+    return false;
+  }
+  fname->assign(q, qe);
+  return true;
+}
+
+// Recognize "<file>:<line>: <message>" as printed with -file-line-error.
+inline bool log_parse_file_line_error(const char * b, const char * e,
+                                      const char ** file_end, int * line,
+                                      const char ** msg_begin)
+{
+  if (b == e || *b == ' ' || *b == '(' || *b == '[') {
+    return false;
+  }
+  const bool may_contain_spaces =
+    (*b == '/' || *b == '.' || *b == '\\' ||
+     ((e - b) > 2 && b[1] == ':' && (b[2] == '/' || b[2] == '\\')));
+
+  for (const char * p = b + 1; p < e; ++p) {
+    if (*p == ' ' && !may_contain_spaces) {
+      return false;
+    }
+    if (*p != ':') {
+      continue;
+    }
+    const char * q = nullptr;
+    int n = log_parse_int(p + 1, e, &q);
+    if (n >= 0 && (e - q) >= 2 && q[0] == ':' && q[1] == ' ') {
+      *file_end = p;
+      *line = n;
+      *msg_begin = q + 2;
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace detail
+
+
+
+_KLFENGINE_INLINE
+bool operator==(const latex_diagnostic & a, const latex_diagnostic & b)
+{
+  return a.kind == b.kind && a.file == b.file && a.line == b.line && a.message == b.message;
+}
+_KLFENGINE_INLINE
+bool operator!=(const latex_diagnostic & a, const latex_diagnostic & b)
+{
+  return ! (a == b);
+}
+
+
+_KLFENGINE_INLINE
+bool latex_diagnostics::has_errors() const
+{
+  return first_error() != nullptr;
+}
+
+_KLFENGINE_INLINE
+const latex_diagnostic * latex_diagnostics::first_error() const
+{
+  for (const auto & x : entries) {
+    if (x.kind == latex_diagnostic_kind::Error || x.kind == latex_diagnostic_kind::MissingFile) {
+      return &x;
+    }
+  }
+  return nullptr;
+}
+
+_KLFENGINE_INLINE
+std::size_t latex_diagnostics::count(latex_diagnostic_kind kind) const
+{
+  std::size_t n = 0;
+  for (const auto & x : entries) {
+    if (x.kind == kind) {
+      ++n;
+    }
+  }
+  return n;
+}
+
+
+
+_KLFENGINE_INLINE
+latex_log_parser::latex_log_parser()
+  : _diagnostics(),
+    _partial_line(),
+    _expecting_error_context(false)
+{
+}
+
+_KLFENGINE_INLINE
+void latex_log_parser::feed(const char * data, std::size_t size)
+{
+  const char * p = data;
+  const char * end = data + size;
+  while (p < end) {
+    const char * nl = static_cast<const char *>(std::memchr(p, '\n', end - p));
+    if (nl == nullptr) {
+      _partial_line.append(p, end);
+      return;
+    }
+    if (_partial_line.empty()) {
+      process_line(p, nl);
+    } else {
+      _partial_line.append(p, nl);
+      process_line(_partial_line.data(), _partial_line.data() + _partial_line.size());
+      _partial_line.clear();
+    }
+    p = nl + 1;
+  }
+}
+
+_KLFENGINE_INLINE
+void latex_log_parser::finish()
+{
+  if (!_partial_line.empty()) {
+    process_line(_partial_line.data(), _partial_line.data() + _partial_line.size());
+    _partial_line.clear();
+  }
+  _expecting_error_context = false;
+}
+
+// static
+_KLFENGINE_INLINE
+latex_diagnostics latex_log_parser::parse(const binary_data & data)
+{
+  latex_log_parser p;
+  p.feed(data);
+  p.finish();
+  return p._diagnostics;
+}
+
+_KLFENGINE_INLINE
+void latex_log_parser::process_line(const char * b, const char * e)
+{
+  using namespace detail;
+
+  if (b != e && *(e-1) == '\r') {
+    --e;
+  }
+  if (b == e) {
+    return;
+  }
+
+  auto & entries = _diagnostics.entries;
+
+  // "l.12 \foo" context line following an error message
+  if (_expecting_error_context && (e - b) > 2 && b[0] == 'l' && b[1] == '.'
+      && log_is_digit(b[2])) {
+    _expecting_error_context = false;
+    if (!entries.empty() && entries.back().line < 0) {
+      entries.back().line = log_parse_int(b + 2, e);
+    }
+    return;
+  }
+
+  std::string missing_fname;
+
+  // "! Undefined control sequence."
+  if (log_starts_with(b, e, "! ")) {
+    const char * msg = b + 2;
+    if (log_missing_file_name(msg, e, &missing_fname)) {
+      entries.push_back({latex_diagnostic_kind::MissingFile, std::move(missing_fname), -1,
+                         std::string{msg, e}});
+    } else {
+      entries.push_back({latex_diagnostic_kind::Error, std::string{}, -1,
+                         std::string{msg, e}});
+    }
+    _expecting_error_context = true;
+    return;
+  }
+
+  // "Overfull \hbox (1.2pt too wide) in paragraph at lines 5--6"
+  const bool is_overfull = log_starts_with(b, e, "Overfull \\");
+  if (is_overfull || log_starts_with(b, e, "Underfull \\")) {
+    int line = -1;
+    const char * p = log_find(b, e, " at line");
+    if (p != nullptr) {
+      p += std::strlen(" at line");
+      if (p < e && *p == 's') {
+        ++p;
+      }
+      if (p < e && *p == ' ') {
+        line = log_parse_int(p + 1, e);
+      }
+    }
+    entries.push_back({is_overfull ? latex_diagnostic_kind::OverfullBox
+                                   : latex_diagnostic_kind::UnderfullBox,
+                       std::string{}, line, std::string{b, e}});
+    return;
+  }
+
+  // "LaTeX Warning: ...", "LaTeX Font Warning: ...", "Package xyz Warning: ...",
+  // "Class xyz Warning: ...", "pdfTeX warning (ext4): ..."
+  const char * warn_msg = nullptr;
+  if (log_starts_with(b, e, "LaTeX") || log_starts_with(b, e, "Package ")
+      || log_starts_with(b, e, "Class ")) {
+    const char * p = log_find(b, e, " Warning: ");
+    if (p != nullptr && static_cast<const char *>(std::memchr(b, ':', p - b)) == nullptr) {
+      warn_msg = p + std::strlen(" Warning: ");
+    }
+  } else if (log_starts_with(b, e, "pdfTeX warning")) {
+    warn_msg = b;
+  }
+  if (warn_msg != nullptr) {
+    int line = -1;
+    const char * p = log_find(warn_msg, e, " on input line ");
+    if (p != nullptr) {
+      line = log_parse_int(p + std::strlen(" on input line "), e);
+    }
+    entries.push_back({latex_diagnostic_kind::Warning, std::string{}, line,
+                       std::string{warn_msg, e}});
+    return;
+  }
+
+  // "./file.tex:12: Undefined control sequence."
+  const char * file_end = nullptr;
+  const char * msg = nullptr;
+  int line = -1;
+  if (log_parse_file_line_error(b, e, &file_end, &line, &msg)) {
+    if (log_missing_file_name(msg, e, &missing_fname)) {
+      entries.push_back({latex_diagnostic_kind::MissingFile, std::move(missing_fname), line,
+                         std::string{msg, e}});
+    } else {
+      entries.push_back({latex_diagnostic_kind::Error, std::string{b, file_end}, line,
+                         std::string{msg, e}});
+    }
+    _expecting_error_context = true;
+    return;
+  }
+}
+
+
+
+_KLFENGINE_INLINE
+latex_compile_error::latex_compile_error(std::string msg, latex_diagnostics diagnostics_)
+  : process_exit_error(std::move(msg)),
+    _diagnostics(std::move(diagnostics_))
+{
+}
+
+_KLFENGINE_INLINE
+latex_compile_error::~latex_compile_error()
+{
+}
+
+
+
+} // namespace klfengine
@@ -32,6 +32,7 @@
 #include <algorithm>
 
 #include <klfengine/run>
+#include <klfengine/h/detail/utils.h>
 
 namespace klfengine {
 
@@ -125,15 +126,19 @@ run::canonical_format_or_empty(const format_spec & format)
 }
 
 
+// Data retrieval doesn't lock _mutex: engine_run_implementation synchronizes
+// the production of each format itself, allowing different formats to be
+// produced concurrently.
+
 _KLFENGINE_INLINE binary_data
 run::get_data(const format_spec & format)
 {
   _ensure_compiled();
 
-  std::lock_guard<std::mutex> lckgrd(_mutex);
-
-  // produces copy via copy constructor
-  return binary_data{ _e->get_data_cref(format) };
+  // copy straight from the (possibly memory-mapped) cached data -- going
+  // through get_data_cref() would keep an extra heap copy in the cache
+  shared_binary_data data{ _e->get_data_shared(format) };
+  return binary_data{ data.data(), data.data() + data.size() };
 }
 
 _KLFENGINE_INLINE const binary_data &
@@ -141,9 +146,46 @@ run::get_data_cref(const format_spec & format)
 {
   _ensure_compiled();
 
+  return _e->get_data_cref(format);
+}
+
+_KLFENGINE_INLINE shared_binary_data
+run::get_data_shared(const format_spec & format)
+{
+  _ensure_compiled();
+
+  return _e->get_data_shared(format);
+}
+
+_KLFENGINE_INLINE void
+run::write_data(const format_spec & format, const data_writer & writer,
+                bool store_in_cache)
+{
+  _ensure_compiled();
+
+  shared_binary_data data{ _e->get_data_shared(format, store_in_cache) };
+
+  writer(data.data(), data.size());
+}
+
+_KLFENGINE_INLINE void
+run::write_data(const format_spec & format, int fd, bool store_in_cache)
+{
+  write_data(
+      format,
+      [fd](const std::uint8_t * data, std::size_t size) {
+        detail::utils::write_all_to_fd(fd, data, size);
+      },
+      store_in_cache
+  );
+}
+
+_KLFENGINE_INLINE latex_diagnostics
+run::diagnostics()
+{
   std::lock_guard<std::mutex> lckgrd(_mutex);
 
-  return _e->get_data_cref(format);
+  return _e->diagnostics();
 }
 
 
@@ -29,9 +29,14 @@
 #pragma once
 
 #include <cstdlib> // getenv()
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <random>
 
 #include <klfengine/basedefs>
 #include <klfengine/settings>
+#include <klfengine/version>
 
 #include <klfengine/h/detail/filesystem.h>
 
@@ -72,6 +77,18 @@ std::string settings::get_tex_executable_path(const std::string & exe_name) cons
 }
 
 
+_KLFENGINE_INLINE
+std::string settings::get_temporary_directory_path() const
+{
+  if (temporary_directory.size() &&
+      detail::has_free_space(temporary_directory,
+                             temporary_directory_min_free_bytes)) {
+    return temporary_directory;
+  }
+  return fs::temp_directory_path().generic_string();
+}
+
+
 // static
 _KLFENGINE_INLINE
 std::vector<std::string> settings::get_wildcard_search_paths(
@@ -215,6 +232,13 @@ settings settings::detect_settings(
 #endif
 
 
+  //
+  // prefer a RAM-backed temporary directory, if there is one with enough room
+  //
+  s.temporary_directory =
+    detail::detect_ram_temporary_directory(s.temporary_directory_min_free_bytes);
+
+
   //
   // look for executable "latex" in $PATH + some hard-coded standard paths
   //
@@ -296,7 +320,12 @@ bool operator==(const settings & a, const settings & b)
       a.texbin_directory == b.texbin_directory &&
       a.gs_method == b.gs_method &&
       a.gs_executable_path == b.gs_executable_path &&
-      a.subprocess_add_environment == b.subprocess_add_environment
+      a.subprocess_add_environment == b.subprocess_add_environment &&
+      a.gs_process_server_pool_size == b.gs_process_server_pool_size &&
+      a.gs_process_server_job_timeout_ms == b.gs_process_server_job_timeout_ms &&
+      a.latex_halt_on_error == b.latex_halt_on_error &&
+      a.font_cache_directory == b.font_cache_directory &&
+      a.temporary_directory_min_free_bytes == b.temporary_directory_min_free_bytes
       );
 }
 
@@ -317,7 +346,12 @@ void to_json(nlohmann::json & j, const settings & v)
     {"gs_method", v.gs_method},
     {"gs_executable_path", v.gs_executable_path},
     {"gs_libgs_path", v.gs_libgs_path},
-    {"subprocess_add_environment", v.subprocess_add_environment}
+    {"subprocess_add_environment", v.subprocess_add_environment},
+    {"gs_process_server_pool_size", v.gs_process_server_pool_size},
+    {"gs_process_server_job_timeout_ms", v.gs_process_server_job_timeout_ms},
+    {"latex_halt_on_error", v.latex_halt_on_error},
+    {"font_cache_directory", v.font_cache_directory},
+    {"temporary_directory_min_free_bytes", v.temporary_directory_min_free_bytes}
   };
 }
 _KLFENGINE_INLINE
@@ -330,6 +364,23 @@ void from_json(const nlohmann::json & j, settings & v)
     j.at("gs_executable_path").get_to(v.gs_executable_path);
     j.at("gs_libgs_path").get_to(v.gs_libgs_path);
     j.at("subprocess_add_environment").get_to(v.subprocess_add_environment);
+    // optional, for compatibility with settings saved by earlier versions
+    if (j.contains("gs_process_server_pool_size")) {
+      j.at("gs_process_server_pool_size").get_to(v.gs_process_server_pool_size);
+    }
+    if (j.contains("gs_process_server_job_timeout_ms")) {
+      j.at("gs_process_server_job_timeout_ms").get_to(v.gs_process_server_job_timeout_ms);
+    }
+    if (j.contains("latex_halt_on_error")) {
+      j.at("latex_halt_on_error").get_to(v.latex_halt_on_error);
+    }
+    if (j.contains("font_cache_directory")) {
+      j.at("font_cache_directory").get_to(v.font_cache_directory);
+    }
+    if (j.contains("temporary_directory_min_free_bytes")) {
+      j.at("temporary_directory_min_free_bytes")
+        .get_to(v.temporary_directory_min_free_bytes);
+    }
   } catch (nlohmann::json::exception & e) {
     throw invalid_json_value{"klfengine::settings", j, e.what()};
   }
@@ -337,4 +388,130 @@ void from_json(const nlohmann::json & j, settings & v)
 
 
 
+// -------------------------------------
+
+namespace detail {
+
+inline std::int64_t settings_cache_mtime(const std::string & path)
+{
+  std::error_code ec;
+  auto t = fs::last_write_time(fs::path{path}, ec);
+  if (ec) {
+    return -1;
+  }
+  return static_cast<std::int64_t>(t.time_since_epoch().count());
+}
+
+// Collect the paths whose modification times tell us whether the detected
+// settings `s` are still valid.  Directories get a new mtime when files are
+// added to or removed from them.
+inline std::map<std::string, std::int64_t>
+settings_cache_stamps(const settings & s, const std::vector<std::string> & search_paths)
+{
+  std::map<std::string, std::int64_t> stamps;
+  for (const auto & p : search_paths) {
+    if (p.find_first_of("*<") != std::string::npos) {
+      // wildcard expression -- we only track what we found in there
+      continue;
+    }
+    stamps[p] = settings_cache_mtime(p);
+  }
+  for (const auto & p : { s.texbin_directory, s.gs_executable_path, s.gs_libgs_path }) {
+    if (!p.empty()) {
+      stamps[p] = settings_cache_mtime(p);
+    }
+  }
+  return stamps;
+}
+
+inline std::string settings_cache_env_PATH()
+{
+  const char * p = std::getenv("PATH");
+  return (p != nullptr) ? std::string{p} : std::string{};
+}
+
+} // namespace detail
+
+
+// static
+_KLFENGINE_INLINE
+settings settings::detect_settings_cached(
+    const std::string & cache_file,
+    const std::vector<std::string> & extra_paths
+    )
+{
+  const std::string klfengine_version{ KLFENGINE_VERSION_STRING };
+  const std::string env_PATH{ detail::settings_cache_env_PATH() };
+
+  // try to use the cache file
+  {
+    std::ifstream f{cache_file};
+    if (f.good()) {
+      try {
+        nlohmann::json j = nlohmann::json::parse(f);
+        bool valid =
+          j.at("klfengine_version").get<std::string>() == klfengine_version &&
+          j.at("extra_paths").get<std::vector<std::string>>() == extra_paths &&
+          j.at("PATH").get<std::string>() == env_PATH;
+        if (valid) {
+          auto stamps = j.at("stamps").get<std::map<std::string, std::int64_t>>();
+          for (const auto & x : stamps) {
+            if (detail::settings_cache_mtime(x.first) != x.second) {
+              valid = false;
+              break;
+            }
+          }
+        }
+        if (valid) {
+          return j.at("settings").get<settings>();
+        }
+      } catch (std::exception & ) {
+        // invalid/corrupt cache file, ignore it
+      }
+    }
+  }
+
+  // cache is stale, do the full detection
+  settings s = detect_settings(extra_paths);
+
+  nlohmann::json j{
+    {"klfengine_version", klfengine_version},
+    {"extra_paths", extra_paths},
+    {"PATH", env_PATH},
+    {"stamps", detail::settings_cache_stamps(s, get_wildcard_search_paths(extra_paths))},
+    {"settings", s}
+  };
+
+  // write to a temporary file and rename it, so that concurrent readers never
+  // see a half-written cache file
+  std::error_code ec;
+  fs::path cache_path{cache_file};
+  if (cache_path.has_parent_path()) {
+    fs::create_directories(cache_path.parent_path(), ec);
+  }
+  std::ostringstream tmp_suffix;
+  tmp_suffix << ".tmp" << std::hex << std::random_device{}();
+  fs::path tmp_path{cache_file + tmp_suffix.str()};
+  {
+    std::ofstream f{tmp_path.native()};
+    f << j.dump(2);
+    if (!f.good()) {
+      ec = std::make_error_code(std::errc::io_error);
+    }
+  }
+  if (!ec) {
+    fs::rename(tmp_path, cache_path, ec);
+  }
+  if (ec) {
+    std::error_code ec2;
+    fs::remove(tmp_path, ec2);
+    warn("klfengine::settings::detect_settings_cached",
+         "Couldn't write settings cache file " + cache_file + ": " + ec.message());
+  }
+
+  return s;
+}
+
+
+
 } // namespace klfengine
@@ -0,0 +1,114 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include <klfengine/shared_binary_data>
+
+
+namespace klfengine {
+
+
+_KLFENGINE_INLINE
+shared_binary_data::shared_binary_data()
+  : _owner{},
+    _lazy_copy{},
+    _vec{nullptr},
+    _data{nullptr},
+    _size{0}
+{
+}
+
+_KLFENGINE_INLINE
+shared_binary_data::shared_binary_data(binary_data data)
+  : shared_binary_data{ std::make_shared<const binary_data>(std::move(data)) }
+{
+}
+
+_KLFENGINE_INLINE
+shared_binary_data::shared_binary_data(std::shared_ptr<const binary_data> data)
+  : _owner{},
+    _lazy_copy{},
+    _vec{data.get()},
+    _data{nullptr},
+    _size{0}
+{
+  if (_vec != nullptr) {
+    _data = _vec->data();
+    _size = _vec->size();
+  }
+  _owner = std::move(data);
+}
+
+_KLFENGINE_INLINE
+shared_binary_data::shared_binary_data(
+    std::shared_ptr<const void> owner,
+    const std::uint8_t * data,
+    std::size_t size
+    )
+  : _owner{std::move(owner)},
+    _lazy_copy{std::make_shared<lazy_copy>()},
+    _vec{nullptr},
+    _data{data},
+    _size{size}
+{
+}
+
+_KLFENGINE_INLINE
+const binary_data & shared_binary_data::binary() const
+{
+  if (_vec != nullptr) {
+    return *_vec;
+  }
+  if (_lazy_copy) {
+    lazy_copy & c = *_lazy_copy;
+    std::call_once(c.once, [this, &c]() { c.data.assign(_data, _data + _size); });
+    return c.data;
+  }
+  static const binary_data empty_data{};
+  return empty_data;
+}
+
+
+_KLFENGINE_INLINE
+bool operator==(const shared_binary_data & a, const shared_binary_data & b)
+{
+  return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+_KLFENGINE_INLINE
+bool operator!=(const shared_binary_data & a, const shared_binary_data & b)
+{
+  return ! (a == b);
+}
+
+
+
+} // namespace klfengine
@@ -0,0 +1,241 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// header we are testing gets included first (helps detect missing #include's)
+#include <klfengine/cache_budget>
+
+#include <klfengine/engine_run_implementation>
+#include <klfengine/run>
+#include <klfengine/temporary_directory>
+#include <klfengine/h/detail/utils.h>
+
+#include <catch2/catch.hpp>
+
+
+namespace {
+
+// a run that stores a "RAW" intermediate format from a file and a "NOTE" that
+// can't be obtained again, and produces "OUT" on request
+class budget_test_run_impl : public klfengine::engine_run_implementation
+{
+public:
+  budget_test_run_impl(klfengine::fs::path dir, std::size_t raw_size = 1000)
+    : klfengine::engine_run_implementation(klfengine::input{}, klfengine::settings{}),
+      _dir(std::move(dir)),
+      _raw_size(raw_size)
+  {
+  }
+
+  int num_produced{0};
+
+private:
+  klfengine::fs::path _dir;
+  std::size_t _raw_size;
+
+  void impl_compile()
+  {
+    klfengine::fs::path raw = _dir / "raw.dat";
+    klfengine::detail::utils::dump_binary_data_to_file(
+        raw.native(), klfengine::binary_data(_raw_size, 'r')
+    );
+    store_file_to_cache(klfengine::format_spec{"RAW"}, raw);
+    (void) store_to_cache(klfengine::format_spec{"NOTE"}, klfengine::binary_data(100, 'n'));
+  }
+
+  std::vector<klfengine::format_description> impl_available_formats()
+  {
+    return {
+      {{"RAW", {}}, "RAW format", "RAW format description"},
+      {{"NOTE", {}}, "NOTE format", "NOTE format description"},
+      {{"OUT", {}}, "OUT format", "OUT format description"}
+    };
+  }
+
+  klfengine::format_spec impl_make_canonical(const klfengine::format_spec & format,
+                                             bool )
+  {
+    if (format.format != "RAW" && format.format != "NOTE" && format.format != "OUT") {
+      throw klfengine::no_such_format(format.format);
+    }
+    return klfengine::format_spec{format.format};
+  }
+
+  klfengine::binary_data impl_produce_data(const klfengine::format_spec & format)
+  {
+    if (format.format != "OUT") {
+      throw klfengine::no_such_format(format.format, "can't produce this again");
+    }
+    ++num_produced;
+    return klfengine::binary_data(1000, 'o');
+  }
+};
+
+// make sure the budget is reset even if a test fails
+struct budget_resetter {
+  ~budget_resetter() { klfengine::cache_budget::instance().set_max_bytes(0); }
+};
+
+} // namespace
+
+
+
+TEST_CASE( "cache_budget accounts for the bytes held by all runs", "[cache_budget]" )
+{
+  klfengine::cache_budget & budget = klfengine::cache_budget::instance();
+  const std::size_t b0 = budget.bytes_held();
+
+  klfengine::temporary_directory tmp;
+  {
+    budget_test_run_impl r{tmp.path()};
+    r.compile();
+    REQUIRE( budget.bytes_held() == b0 + 1100 ) ;
+
+    (void) r.get_data_shared(klfengine::format_spec{"OUT"});
+    REQUIRE( budget.bytes_held() == b0 + 2100 ) ;
+
+    // not stored, not accounted for
+    klfengine::temporary_directory tmp2;
+    budget_test_run_impl r2{tmp2.path()};
+    r2.compile();
+    (void) r2.get_data_shared(klfengine::format_spec{"OUT"}, false);
+    REQUIRE( budget.bytes_held() == b0 + 3200 ) ;
+  }
+  REQUIRE( budget.bytes_held() == b0 ) ;
+}
+
+
+TEST_CASE( "cache_budget evicts intermediates first, then least recently used data",
+           "[cache_budget]" )
+{
+  budget_resetter resetter;
+  klfengine::cache_budget & budget = klfengine::cache_budget::instance();
+  const std::size_t b0 = budget.bytes_held();
+  const std::size_t n0 = budget.num_evictions();
+
+  klfengine::temporary_directory tmp_a;
+  klfengine::temporary_directory tmp_b;
+  budget_test_run_impl a{tmp_a.path()};
+  budget_test_run_impl b{tmp_b.path()};
+  a.compile();
+  b.compile();
+  klfengine::shared_binary_data a_out = a.get_data_shared(klfengine::format_spec{"OUT"});
+  (void) b.get_data_shared(klfengine::format_spec{"OUT"});
+  (void) a.get_data_shared(klfengine::format_spec{"OUT"});
+  REQUIRE( budget.bytes_held() == b0 + 4200 ) ;
+
+  // the RAW intermediates go first
+  budget.set_max_bytes(b0 + 2500);
+  REQUIRE( budget.bytes_held() == b0 + 2200 ) ;
+  REQUIRE( budget.num_evictions() == n0 + 2 ) ;
+  REQUIRE( budget.bytes_evicted() >= 2000 ) ;
+  (void) a.get_data_shared(klfengine::format_spec{"OUT"});
+  (void) b.get_data_shared(klfengine::format_spec{"OUT"});
+  REQUIRE( a.num_produced == 1 ) ;
+  REQUIRE( b.num_produced == 1 ) ;
+
+  // ... and are loaded again from their file when requested
+  budget.set_max_bytes(0);
+  klfengine::shared_binary_data a_raw = a.get_data_shared(klfengine::format_spec{"RAW"});
+  REQUIRE( a_raw.binary() == klfengine::binary_data(1000, 'r') ) ;
+  REQUIRE( budget.bytes_held() == b0 + 3200 ) ;
+
+  // then the least recently used data that can be produced again
+  (void) b.get_data_shared(klfengine::format_spec{"OUT"});
+  budget.set_max_bytes(b0 + 1300);
+  REQUIRE( budget.bytes_held() == b0 + 1200 ) ;
+  budget.set_max_bytes(0);
+  (void) b.get_data_shared(klfengine::format_spec{"OUT"});
+  REQUIRE( b.num_produced == 1 ) ;
+  (void) a.get_data_shared(klfengine::format_spec{"OUT"});
+  REQUIRE( a.num_produced == 2 ) ;
+
+  // data handed out before remains valid
+  REQUIRE( a_out.binary() == klfengine::binary_data(1000, 'o') ) ;
+
+  // NOTE can't be obtained again and a reference to B's OUT is handed out, so
+  // these entries stay
+  const klfengine::binary_data & b_out_ref =
+    b.get_data_cref(klfengine::format_spec{"OUT"});
+  budget.set_max_bytes(1);
+  REQUIRE( budget.bytes_held() == b0 + 1200 ) ;
+  REQUIRE( b_out_ref == klfengine::binary_data(1000, 'o') ) ;
+  REQUIRE( a.get_data_shared(klfengine::format_spec{"NOTE"}).binary()
+           == klfengine::binary_data(100, 'n') ) ;
+  REQUIRE( b.num_produced == 1 ) ;
+}
+
+
+TEST_CASE( "cache_budget evicts data obtained with run::get_data()", "[cache_budget]" )
+{
+  budget_resetter resetter;
+  klfengine::cache_budget & budget = klfengine::cache_budget::instance();
+  const std::size_t b0 = budget.bytes_held();
+
+  klfengine::temporary_directory tmp;
+  budget_test_run_impl * impl = new budget_test_run_impl{tmp.path()};
+  klfengine::run r{std::unique_ptr<klfengine::engine_run_implementation>(impl)};
+  r.compile();
+  REQUIRE( r.get_data(klfengine::format_spec{"OUT"}) == klfengine::binary_data(1000, 'o') ) ;
+  REQUIRE( budget.bytes_held() == b0 + 2100 ) ;
+
+  // only NOTE, which can't be obtained again, stays
+  budget.set_max_bytes(b0 + 150);
+  REQUIRE( budget.bytes_held() == b0 + 100 ) ;
+
+  budget.set_max_bytes(0);
+  REQUIRE( r.get_data(klfengine::format_spec{"OUT"}) == klfengine::binary_data(1000, 'o') ) ;
+  REQUIRE( impl->num_produced == 2 ) ;
+}
+
+
+TEST_CASE( "get_data_cref() doesn't keep memory-mapped data twice", "[cache_budget]" )
+{
+  klfengine::cache_budget & budget = klfengine::cache_budget::instance();
+  const std::size_t b0 = budget.bytes_held();
+
+  // large enough to be memory-mapped
+  const std::size_t raw_size = 1024*1024;
+
+  klfengine::temporary_directory tmp;
+  budget_test_run_impl r{tmp.path(), raw_size};
+  r.compile();
+  REQUIRE( budget.bytes_held() == b0 + raw_size + 100 ) ;
+
+  klfengine::shared_binary_data mapped = r.get_data_shared(klfengine::format_spec{"RAW"});
+  REQUIRE( !mapped.has_binary() ) ;
+
+  // the cache entry is replaced by an in-memory copy of the same size
+  const klfengine::binary_data & ref = r.get_data_cref(klfengine::format_spec{"RAW"});
+  REQUIRE( ref == klfengine::binary_data(raw_size, 'r') ) ;
+  REQUIRE( budget.bytes_held() == b0 + raw_size + 100 ) ;
+  REQUIRE( r.get_data_shared(klfengine::format_spec{"RAW"}).has_binary() ) ;
+  REQUIRE( &r.get_data_cref(klfengine::format_spec{"RAW"}) == &ref ) ;
+
+  // data handed out before remains valid
+  REQUIRE( mapped == klfengine::shared_binary_data{ref} ) ;
+}
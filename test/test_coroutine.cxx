@@ -0,0 +1,187 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// header we are testing gets included first (helps detect missing #include's)
+#include <klfengine/coroutine>
+
+#include <catch2/catch.hpp>
+
+#ifdef KLFENGINE_HAS_COROUTINES
+
+#include <thread>
+#include <mutex>
+#include <future>
+#include <vector>
+
+#include <klfengine/run>
+#include <klfengine/engine>
+
+#include "dummy_engine/dummy_engine.hxx"
+
+
+namespace {
+
+// fire-and-forget coroutine type, enough to co_await our awaitables
+struct test_task {
+  struct promise_type {
+    test_task get_return_object() { return test_task{}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() { }
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+// runs each task in a new thread
+struct thread_executor {
+  std::mutex mutex;
+  std::vector<std::thread> threads;
+
+  klfengine::executor get()
+  {
+    return [this](std::function<void()> task) {
+      std::lock_guard<std::mutex> lckgrd(mutex);
+      threads.push_back(std::thread(std::move(task)));
+    };
+  }
+  ~thread_executor()
+  {
+    std::lock_guard<std::mutex> lckgrd(mutex);
+    for (auto & t : threads) {
+      t.join();
+    }
+  }
+};
+
+inline std::unique_ptr<klfengine::run> make_dummy_run(std::string latex)
+{
+  klfengine::input in;
+  in.latex = std::move(latex);
+  return std::unique_ptr<klfengine::run>{new klfengine::run{
+    std::unique_ptr<klfengine::engine_run_implementation>{
+      new dummy_engine::dummy_run_impl{in, klfengine::settings{}}
+    }
+  }};
+}
+
+test_task compile_and_get_data(klfengine::run & r, klfengine::executor exec,
+                               std::thread::id caller,
+                               std::promise<std::string> & done)
+{
+  try {
+    co_await klfengine::async_compile(r, exec);
+    klfengine::shared_binary_data d =
+      co_await klfengine::async_get_data(r, klfengine::format_spec{"TEX"}, exec);
+    if (std::this_thread::get_id() == caller) {
+      throw std::runtime_error("coroutine was not resumed by the executor");
+    }
+    done.set_value(std::string(d.begin(), d.end()));
+  } catch (...) {
+    done.set_exception(std::current_exception());
+  }
+}
+
+test_task get_data_only(klfengine::run & r, klfengine::executor exec,
+                        std::promise<std::string> & done)
+{
+  try {
+    klfengine::shared_binary_data d =
+      co_await klfengine::async_get_data(r, klfengine::format_spec{"TEX"}, exec);
+    done.set_value(std::string(d.begin(), d.end()));
+  } catch (...) {
+    done.set_exception(std::current_exception());
+  }
+}
+
+test_task get_shared_run(klfengine::engine & e, klfengine::input in,
+                         klfengine::executor exec,
+                         std::shared_ptr<klfengine::run> & result)
+{
+  result = co_await klfengine::async_shared_run(e, in, exec);
+}
+
+} // namespace
+
+
+
+TEST_CASE( "co_await compiles a run and produces data on the executor", "[coroutine]" )
+{
+  std::unique_ptr<klfengine::run> r = make_dummy_run("a+b=c");
+  std::promise<std::string> done;
+  std::future<std::string> result = done.get_future();
+  {
+    thread_executor exec;
+    compile_and_get_data(*r, exec.get(), std::this_thread::get_id(), done);
+    REQUIRE( result.get() == "<compiled data! input was `a+b=c'>" ) ;
+  }
+  REQUIRE( r->compiled() ) ;
+}
+
+TEST_CASE( "exceptions are rethrown in the awaiting coroutine", "[coroutine]" )
+{
+  std::unique_ptr<klfengine::run> r = make_dummy_run("a+b=c");
+  std::promise<std::string> done;
+  std::future<std::string> result = done.get_future();
+  {
+    thread_executor exec;
+    get_data_only(*r, exec.get(), done);
+    CHECK_THROWS_AS( result.get(), klfengine::forgot_to_call_compile ) ;
+  }
+}
+
+TEST_CASE( "co_await works with an executor that runs tasks inline", "[coroutine]" )
+{
+  dummy_engine::dummy_engine x{};
+  klfengine::input in;
+  in.latex = "a+b=c";
+
+  klfengine::executor inline_exec = [](std::function<void()> task) { task(); };
+
+  std::shared_ptr<klfengine::run> r;
+  get_shared_run(x, in, inline_exec, r);
+  REQUIRE( r != nullptr ) ;
+  REQUIRE( r->compiled() ) ;
+  REQUIRE( x.shared_run(in) == r ) ;
+}
+
+TEST_CASE( "awaitable requires an executor", "[coroutine]" )
+{
+  std::unique_ptr<klfengine::run> r = make_dummy_run("a+b=c");
+  CHECK_THROWS_AS( klfengine::async_compile(*r, klfengine::executor{}),
+                   std::invalid_argument ) ;
+}
+
+#else
+
+TEST_CASE( "coroutine interface is not available before C++20", "[coroutine]" )
+{
+  // nothing to test, but the header must compile in C++11/14/17 too
+  SUCCEED( "no C++20 coroutine support" );
+}
+
+#endif
@@ -0,0 +1,114 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// header we are testing gets included first (helps detect missing #include's)
+#include <klfengine/h/detail/directory_reaper.h>
+
+#include <atomic>
+#include <chrono>
+
+#include <catch2/catch.hpp>
+
+
+
+TEST_CASE( "directory_reaper runs jobs in the background", "[detail-directory_reaper]" )
+{
+  using namespace klfengine;
+
+  std::atomic<int> num_done{0};
+  std::thread::id caller_id = std::this_thread::get_id();
+  std::atomic<bool> ran_elsewhere{true};
+
+  detail::directory_reaper reaper;
+  for (int i = 0; i < 10; ++i) {
+    reaper.submit([&]() {
+      if (std::this_thread::get_id() == caller_id) {
+        ran_elsewhere = false;
+      }
+      ++num_done;
+    });
+  }
+  reaper.flush();
+  REQUIRE( num_done == 10 ) ;
+  REQUIRE( ran_elsewhere ) ;
+  REQUIRE( reaper.backlog() == 0 ) ;
+}
+
+TEST_CASE( "directory_reaper runs jobs inline when the backlog is full",
+           "[detail-directory_reaper]" )
+{
+  using namespace klfengine;
+
+  std::atomic<bool> blocking_job_started{false};
+  std::atomic<bool> release_blocking_job{false};
+  std::atomic<bool> queued_job_done{false};
+  std::thread::id ran_in;
+
+  {
+    detail::directory_reaper reaper{1};
+
+    // this job blocks the worker thread until we release it
+    reaper.submit([&]() {
+      blocking_job_started = true;
+      while (!release_blocking_job) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    });
+    // wait until the worker picked it up, so that the queue is empty
+    while (!blocking_job_started) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    // fills the queue
+    reaper.submit([&]() { queued_job_done = true; });
+
+    // backlog is full -- runs right here
+    reaper.submit([&]() { ran_in = std::this_thread::get_id(); });
+
+    release_blocking_job = true;
+    reaper.flush();
+  }
+
+  REQUIRE( ran_in == std::this_thread::get_id() ) ;
+  REQUIRE( queued_job_done ) ;
+}
+
+TEST_CASE( "directory_reaper reports errors and runs pending jobs at destruction",
+           "[detail-directory_reaper]" )
+{
+  using namespace klfengine;
+
+  std::atomic<int> num_done{0};
+  {
+    detail::directory_reaper reaper;
+    reaper.submit([]() { throw std::runtime_error("test error, please ignore"); });
+    for (int i = 0; i < 5; ++i) {
+      reaper.submit([&]() { ++num_done; });
+    }
+  }
+  REQUIRE( num_done == 5 ) ;
+}
@@ -0,0 +1,100 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2020 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// header we are testing gets included first (helps detect missing #include's)
+#include <klfengine/h/detail/dvisvgm.h>
+
+
+#include <catch2/catch.hpp>
+
+
+
+static const std::string test_svg_data{
+  "<?xml version='1.0' encoding='UTF-8'?>\n"
+  "<!-- This file was generated by dvisvgm 2.11.1 -->\n"
+  "<svg version='1.1' xmlns='http://www.w3.org/2000/svg' width='20pt' height='10pt'"
+  " viewBox='56 -62 20 10'>\n"
+  "<g id='page1'>\n"
+  "<use x='56' y='-52' xlink:href='#g0-120'/>\n"
+  "</g>\n"
+  "</svg>"
+};
+
+TEST_CASE( "svg_adjust_canvas adds margins and scales", "[detail-dvisvgm]" )
+{
+  using namespace klfengine;
+
+  std::string s = detail::svg_adjust_canvas(
+      test_svg_data, 1, 2, 3, 4, 2.0, color{255,255,255,0}
+  );
+
+  REQUIRE( s ==
+           "<?xml version='1.0' encoding='UTF-8'?>\n"
+           "<!-- This file was generated by dvisvgm 2.11.1 -->\n"
+           "<svg version='1.1' xmlns='http://www.w3.org/2000/svg'"
+           " viewBox='55 -64 24 16' width='48pt' height='32pt'>\n"
+           "<g id='page1'>\n"
+           "<use x='56' y='-52' xlink:href='#g0-120'/>\n"
+           "</g>\n"
+           "</svg>" );
+}
+
+TEST_CASE( "svg_adjust_canvas inserts background rectangle", "[detail-dvisvgm]" )
+{
+  using namespace klfengine;
+
+  std::string s = detail::svg_adjust_canvas(
+      test_svg_data, 0, 0, 0, 0, 1.0, color{255,0,0,255}
+  );
+  REQUIRE( s.find("viewBox='56 -62 20 10' width='20pt' height='10pt'>"
+                  "<rect x='56' y='-62' width='20' height='10' fill='rgb(255,0,0)'/>\n"
+                  "<g id='page1'>")
+           != std::string::npos );
+
+  std::string s2 = detail::svg_adjust_canvas(
+      test_svg_data, 0, 0, 0, 0, 1.0, color{0,0,255,51}
+  );
+  REQUIRE( s2.find("<rect x='56' y='-62' width='20' height='10' fill='rgb(0,0,255)'"
+                   " fill-opacity='0.2'/>")
+           != std::string::npos );
+}
+
+TEST_CASE( "svg_adjust_canvas fails without viewBox", "[detail-dvisvgm]" )
+{
+  using namespace klfengine;
+
+  REQUIRE_THROWS_AS(
+      detail::svg_adjust_canvas("<svg width='1pt' height='1pt'></svg>", 0, 0, 0, 0, 1.0,
+                                color{0,0,0,0}),
+      std::runtime_error
+  );
+  REQUIRE_THROWS_AS(
+      detail::svg_adjust_canvas("not SVG data", 0, 0, 0, 0, 1.0, color{0,0,0,0}),
+      std::runtime_error
+  );
+}
@@ -0,0 +1,83 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2020 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// header we are testing gets included first (helps detect missing #include's)
+#include <klfengine/h/detail/engine_workspace.h>
+
+#include <klfengine/h/detail/utils.h>
+
+#include <catch2/catch.hpp>
+
+
+
+TEST_CASE( "engine_workspace writes provided files once", "[detail-engine_workspace]" )
+{
+  using namespace klfengine;
+
+  fs::path ws_path;
+  {
+    detail::engine_workspace ws{fs::path{}, "klfenginetestws"};
+    ws_path = ws.path();
+    REQUIRE( fs::is_directory(ws_path) ) ;
+
+    fs::path p = ws.provide_file("hello.sty", "Hello, world.\n");
+    REQUIRE( p == ws_path / "hello.sty" ) ;
+    auto data = detail::utils::load_file_data(p.native());
+    REQUIRE( std::string{data.begin(), data.end()} == "Hello, world.\n" ) ;
+
+    // the file is not overwritten by a second call
+    fs::path p2 = ws.provide_file("hello.sty", "Something else.\n");
+    REQUIRE( p2 == p ) ;
+    data = detail::utils::load_file_data(p.native());
+    REQUIRE( std::string{data.begin(), data.end()} == "Hello, world.\n" ) ;
+  }
+  // workspace is removed along with the object
+  REQUIRE( ! fs::exists(ws_path) ) ;
+}
+
+TEST_CASE( "engine_workspace exposes itself through TEXINPUTS", "[detail-engine_workspace]" )
+{
+  using namespace klfengine;
+
+  detail::engine_workspace ws{fs::path{}, "klfenginetestws"};
+
+  const std::string sep{detail::path_separator};
+
+  environment e;
+  set_environment(e,
+                  provide_environment_variables{ {{"TEXINPUTS", ""}} },
+                  ws.texinputs_environment());
+  // empty last component stands for the TeX default search path
+  REQUIRE( e["TEXINPUTS"] == ws.path().native() + sep ) ;
+
+  environment e2{ {"TEXINPUTS", "/some/path" + sep} };
+  set_environment(e2,
+                  provide_environment_variables{ {{"TEXINPUTS", ""}} },
+                  ws.texinputs_environment());
+  REQUIRE( e2["TEXINPUTS"] == ws.path().native() + sep + "/some/path" + sep ) ;
+}
@@ -29,6 +29,8 @@
 // header we are testing gets included first (helps detect missing #include's)
 #include <klfengine/h/detail/filesystem.h>
 
+#include <limits>
+
 #include <catch2/catch.hpp>
 
 
@@ -141,3 +143,20 @@ TEST_CASE( "get_environment_PATH() returns a list with /bin in it",
   auto v = klfengine::detail::get_environment_PATH();
   REQUIRE( std::find(v.begin(), v.end(), "/bin") != v.end() );
 }
+
+
+TEST_CASE( "detect_ram_temporary_directory() finds a writable tmpfs",
+           "[detail-filesystem]" )
+{
+  std::string d = klfengine::detail::detect_ram_temporary_directory(1024*1024);
+  if (d.empty()) {
+    WARN( "No RAM-backed temporary directory on this system" );
+    return;
+  }
+  REQUIRE( klfengine::detail::is_ram_backed_directory(d) );
+  REQUIRE( klfengine::detail::has_free_space(d, 1024*1024) );
+
+  // size guard
+  REQUIRE( klfengine::detail::detect_ram_temporary_directory(
+               std::numeric_limits<std::int64_t>::max() ).empty() );
+}
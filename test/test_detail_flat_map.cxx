@@ -0,0 +1,92 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+// header we are testing gets included first (helps detect missing #include's)
+#include <klfengine/h/detail/flat_map.h>
+
+#include <string>
+#include <iterator>
+#include <algorithm>
+
+#include <catch2/catch.hpp>
+
+
+
+TEST_CASE( "flat_map keeps its entries sorted by key", "[detail-flat_map]" )
+{
+  using map_type = klfengine::detail::flat_map<std::string, int>;
+
+  map_type m{ {"c", 3}, {"a", 1}, {"b", 2}, {"a", 100} };
+
+  REQUIRE( m.size() == 3 ) ;
+  // like std::map, the first entry wins when keys are repeated
+  REQUIRE( m.at("a") == 1 ) ;
+
+  std::string keys;
+  for (const auto & p : m) {
+    keys += p.first;
+  }
+  REQUIRE( keys == "abc" ) ;
+
+  m["aa"] = 11;
+  m["0"] = 0;
+  REQUIRE( m.size() == 5 ) ;
+  REQUIRE( m.begin()->first == "0" ) ;
+  REQUIRE( std::next(m.begin(), 2)->first == "aa" ) ;
+
+  REQUIRE( m.insert({"b", 20}).second == false ) ;
+  REQUIRE( m.at("b") == 2 ) ;
+  REQUIRE( m.emplace("d", 4).second == true ) ;
+  REQUIRE( m.count("d") == 1 ) ;
+
+  REQUIRE( m.erase("aa") == 1 ) ;
+  REQUIRE( m.erase("zz") == 0 ) ;
+  REQUIRE( m.find("aa") == m.end() ) ;
+  REQUIRE_THROWS_AS( m.at("aa"), std::out_of_range ) ;
+
+  auto it = m.find("c");
+  REQUIRE( it != m.end() ) ;
+  REQUIRE( it->second == 3 ) ;
+  m.erase(it);
+  REQUIRE( m == map_type{ {"0", 0}, {"a", 1}, {"b", 2}, {"d", 4} } ) ;
+  REQUIRE( m != map_type{ {"0", 0}, {"a", 1}, {"b", 2} } ) ;
+}
+
+TEST_CASE( "flat_map works with std::inserter and range insertion", "[detail-flat_map]" )
+{
+  using map_type = klfengine::detail::flat_map<std::string, int>;
+
+  map_type src{ {"x", 1}, {"y", 2}, {"z", 3} };
+
+  map_type dst{ {"a", 0}, {"y", 20} };
+  std::copy(src.begin(), src.end(), std::inserter(dst, dst.end()));
+  REQUIRE( dst == map_type{ {"a", 0}, {"x", 1}, {"y", 20}, {"z", 3} } ) ;
+
+  map_type dst2{ {"b", 0}, {"x", 10} };
+  dst2.insert(src.begin(), src.end());
+  REQUIRE( dst2 == map_type{ {"b", 0}, {"x", 10}, {"y", 2}, {"z", 3} } ) ;
+}
@@ -0,0 +1,83 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+// header we are testing gets included first (helps detect missing #include's)
+#include <klfengine/h/detail/interned_format_spec.h>
+
+#include <unordered_map>
+
+#include <catch2/catch.hpp>
+
+
+
+TEST_CASE( "interned_format_spec shares equal format_specs", "[detail-interned_format_spec]" )
+{
+  using namespace klfengine;
+  using detail::interned_format_spec;
+
+  std::size_t n0 = interned_format_spec::num_interned();
+
+  {
+    format_spec f1{"PNG", value::dict{
+        {"dpi", value{300}},
+        {"antialiasing", value{value::dict{{"text", value{4}}, {"graphics", value{4}}}}}
+      }};
+    format_spec f2{f1};
+    format_spec f3{"PNG", value::dict{{"dpi", value{600}}}};
+
+    interned_format_spec a{f1};
+    interned_format_spec b{f2};
+    interned_format_spec c{f3};
+
+    REQUIRE( a == b ) ;
+    REQUIRE( &a.get() == &b.get() ) ;
+    REQUIRE( a != c ) ;
+    REQUIRE( a.get() == f1 ) ;
+    REQUIRE( c->format == "PNG" ) ;
+    REQUIRE( a.hash() == detail::hash<format_spec>{}(f1) ) ;
+    REQUIRE( a.hash() == b.hash() ) ;
+
+    REQUIRE( interned_format_spec::num_interned() == n0 + 2 ) ;
+
+    std::unordered_map<interned_format_spec, int, detail::hash<interned_format_spec> > m;
+    m[a] = 1;
+    m[c] = 2;
+    REQUIRE( m.at(b) == 1 ) ;
+    REQUIRE( m.at(interned_format_spec{f3}) == 2 ) ;
+  }
+
+  // entries are dropped once no longer used
+  REQUIRE( interned_format_spec::num_interned() == n0 ) ;
+
+  // default-constructed instance is the empty format_spec
+  REQUIRE( interned_format_spec{} == interned_format_spec{format_spec{}} ) ;
+  REQUIRE( interned_format_spec{}.get() == format_spec{} ) ;
+  // ... which stays interned
+  const std::size_t n1 = interned_format_spec::num_interned();
+  { interned_format_spec e; }
+  REQUIRE( interned_format_spec::num_interned() == n1 ) ;
+}
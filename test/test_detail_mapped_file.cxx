@@ -0,0 +1,114 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// header we are testing gets included first (helps detect missing #include's)
+#include <klfengine/h/detail/mapped_file.h>
+
+#include <klfengine/temporary_directory>
+#include <klfengine/h/detail/utils.h>
+
+#include <catch2/catch.hpp>
+
+
+
+static void write_test_file(const klfengine::fs::path & p, std::size_t size)
+{
+  std::string s;
+  s.reserve(size);
+  for (std::size_t i = 0; i < size; ++i) {
+    s += static_cast<char>('a' + (i % 26));
+  }
+  klfengine::detail::utils::dump_cstr_to_file(p.native(), s.c_str());
+}
+
+
+TEST_CASE( "load_file_shared() loads small and large files", "[detail-mapped_file]" )
+{
+  using namespace klfengine;
+
+  temporary_directory tmp;
+
+  for (std::size_t size : { std::size_t{0}, std::size_t{100},
+                            detail::load_file_shared_mmap_threshold + 123 }) {
+    fs::path p = tmp.path() / "data.bin";
+    write_test_file(p, size);
+
+    shared_binary_data d = detail::load_file_shared(p);
+    REQUIRE( d.size() == size ) ;
+    REQUIRE( d.binary() == detail::utils::load_file_data(p.native()) ) ;
+    REQUIRE( fs::exists(p) ) ;
+  }
+}
+
+TEST_CASE( "load_file_shared() can take over the file", "[detail-mapped_file]" )
+{
+  using namespace klfengine;
+
+  temporary_directory tmp;
+  fs::path p = tmp.path() / "out.png";
+  const std::size_t size = detail::load_file_shared_mmap_threshold * 2;
+  write_test_file(p, size);
+
+  shared_binary_data d = detail::load_file_shared(p, true);
+  REQUIRE( ! fs::exists(p) ) ;
+
+  // writing a new file under the same name doesn't affect our data
+  write_test_file(p, 10);
+  REQUIRE( d.size() == size ) ;
+  REQUIRE( d.data()[0] == 'a' ) ;
+  REQUIRE( d.data()[size-1] == static_cast<std::uint8_t>('a' + ((size-1) % 26)) ) ;
+
+  // binary() provides a copy that is shared between copies of d
+  shared_binary_data d2 = d;
+  REQUIRE( &d.binary() == &d2.binary() ) ;
+  REQUIRE( d.binary().size() == size ) ;
+  REQUIRE( d.binary().data() != d.data() ) ;
+}
+
+TEST_CASE( "load_file_shared() data survives changes to the file", "[detail-mapped_file]" )
+{
+  using namespace klfengine;
+
+  temporary_directory tmp;
+  fs::path p = tmp.path() / "out.pdf";
+  const std::size_t size = detail::load_file_shared_mmap_threshold * 2;
+  write_test_file(p, size);
+
+  shared_binary_data d = detail::load_file_shared(p);
+  shared_binary_data expected{ detail::utils::load_file_data(p.native()) };
+  REQUIRE( fs::exists(p) ) ;
+  // the private copy isn't left behind
+  REQUIRE( std::distance(fs::directory_iterator{tmp.path()}, fs::directory_iterator{}) == 1 ) ;
+
+  // truncated and rewritten in place (would raise SIGBUS if p itself were
+  // mapped), then removed
+  write_test_file(p, 10);
+  REQUIRE( d == expected ) ;
+  fs::remove(p);
+  REQUIRE( d == expected ) ;
+}
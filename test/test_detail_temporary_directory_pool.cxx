@@ -0,0 +1,162 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// header we are testing gets included first (helps detect missing #include's)
+#include <klfengine/h/detail/temporary_directory_pool.h>
+
+#include <klfengine/h/detail/utils.h>
+
+#include <catch2/catch.hpp>
+
+
+// directories are cleaned up in the background
+static void wait_for_cleanup()
+{
+  klfengine::detail::directory_reaper::instance().flush();
+}
+
+
+TEST_CASE( "temporary_directory_pool recycles cleaned-up directories",
+           "[detail-temporary_directory_pool]" )
+{
+  using namespace klfengine;
+
+  auto pool = std::make_shared<detail::temporary_directory_pool>(
+      fs::path{}, "klfenginetestpool", 2
+  );
+
+  fs::path p1;
+  {
+    auto l = pool->acquire();
+    p1 = l.path();
+    REQUIRE( fs::is_directory(p1) ) ;
+    detail::utils::dump_cstr_to_file((p1 / "file.aux").native(), "aux\n");
+    fs::create_directory(p1 / "subdir");
+    detail::utils::dump_cstr_to_file((p1 / "subdir" / "x.log").native(), "log\n");
+    REQUIRE( pool->num_idle() == 0 ) ;
+  }
+  wait_for_cleanup();
+  REQUIRE( pool->num_idle() == 1 ) ;
+  REQUIRE( fs::is_directory(p1) ) ;
+  REQUIRE( fs::is_empty(p1) ) ;
+
+  {
+    auto l = pool->acquire();
+    REQUIRE( l.path() == p1 ) ;
+    REQUIRE( pool->num_idle() == 0 ) ;
+
+    // a second concurrent lease gets a new directory
+    auto l2 = pool->acquire();
+    REQUIRE( l2.path() != p1 ) ;
+
+    // a moved-from lease doesn't return anything to the pool
+    {
+      auto moved = std::move(l2);
+    }
+    wait_for_cleanup();
+    REQUIRE( pool->num_idle() == 1 ) ;
+  }
+  wait_for_cleanup();
+  REQUIRE( pool->num_idle() == 2 ) ;
+
+  // surplus directories beyond max_idle are removed
+
+  std::vector<fs::path> idle_paths;
+  {
+    auto l = pool->acquire();
+    auto l2 = pool->acquire();
+    auto l3 = pool->acquire();
+    idle_paths = {l.path(), l2.path(), l3.path()};
+  }
+  wait_for_cleanup();
+  REQUIRE( pool->num_idle() == 2 ) ;
+  int num_existing = 0;
+  for (const auto & p : idle_paths) {
+    if (fs::exists(p)) {
+      ++num_existing;
+    }
+  }
+  REQUIRE( num_existing == 2 ) ;
+
+  // all directories are removed along with the pool
+  pool.reset();
+  wait_for_cleanup();
+  for (const auto & p : idle_paths) {
+    REQUIRE( ! fs::exists(p) ) ;
+  }
+}
+
+TEST_CASE( "temporary_directory_pool preserves seeded files",
+           "[detail-temporary_directory_pool]" )
+{
+  using namespace klfengine;
+
+  int num_seeded = 0;
+  auto pool = std::make_shared<detail::temporary_directory_pool>(
+      fs::path{}, "klfenginetestpool", 4,
+      [&num_seeded](const fs::path & p) {
+        detail::utils::dump_cstr_to_file((p / "klfimpl.sty").native(), "%sty\n");
+        ++num_seeded;
+      }
+  );
+
+  pool->prefill(2);
+  REQUIRE( pool->num_idle() == 2 ) ;
+  REQUIRE( num_seeded == 2 ) ;
+
+  fs::path p;
+  {
+    auto l = pool->acquire();
+    p = l.path();
+    REQUIRE( fs::exists(p / "klfimpl.sty") ) ;
+    detail::utils::dump_cstr_to_file((p / "klfetmp.tex").native(), "tex\n");
+  }
+  wait_for_cleanup();
+  REQUIRE( fs::exists(p / "klfimpl.sty") ) ;
+  REQUIRE( ! fs::exists(p / "klfetmp.tex") ) ;
+  REQUIRE( num_seeded == 2 ) ;
+}
+
+TEST_CASE( "temporary_directory_pool leases may outlive the pool",
+           "[detail-temporary_directory_pool]" )
+{
+  using namespace klfengine;
+
+  auto pool = std::make_shared<detail::temporary_directory_pool>(
+      fs::path{}, "klfenginetestpool"
+  );
+  fs::path p;
+  {
+    auto l = pool->acquire();
+    p = l.path();
+    pool.reset();
+    REQUIRE( fs::is_directory(p) ) ;
+  }
+  wait_for_cleanup();
+  REQUIRE( ! fs::exists(p) ) ;
+}
@@ -30,6 +30,13 @@
 #include <klfengine/engine>
 
 #include <klfengine/run>
+#include <klfengine/temporary_directory>
+
+#include <cstdlib>
+#include <fstream>
+#include <atomic>
+#include <thread>
+#include <chrono>
 
 #include <catch2/catch.hpp>
 
@@ -100,3 +107,168 @@ TEST_CASE( "engine calls impl_create_engine_run_instance",
     }) ;
 }
 
+
+TEST_CASE( "engine has a job scheduler that can be shared", "[engine]" )
+{
+  dummy_engine::dummy_engine x{};
+  dummy_engine::dummy_engine y{};
+
+  REQUIRE( x.scheduler() != nullptr ) ;
+  REQUIRE( x.scheduler() != y.scheduler() ) ;
+
+  y.set_scheduler(x.scheduler());
+  REQUIRE( x.scheduler() == y.scheduler() ) ;
+
+  CHECK_THROWS_AS( x.set_scheduler(nullptr), std::invalid_argument ) ;
+}
+
+
+// engine whose runs take a while to compile, counting compilations
+class slow_engine : public klfengine::engine
+{
+public:
+  slow_engine() : klfengine::engine("slow-engine"), num_compiled(0) { }
+
+  std::atomic<int> num_compiled;
+
+private:
+  class slow_run_impl : public dummy_engine::dummy_run_impl
+  {
+  public:
+    slow_run_impl(slow_engine * e, klfengine::input input_, klfengine::settings settings_)
+      : dummy_engine::dummy_run_impl(std::move(input_), std::move(settings_)), _e(e)
+    { }
+  private:
+    slow_engine * _e;
+    void impl_compile()
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      if (input().latex == "\\fail") {
+        throw klfengine::latex_compile_error{"failed on purpose", {}};
+      }
+      ++_e->num_compiled;
+    }
+  };
+
+  klfengine::engine_run_implementation *
+  impl_create_engine_run_implementation( klfengine::input input_,
+                                         klfengine::settings settings_ )
+  {
+    return new slow_run_impl(this, std::move(input_), std::move(settings_));
+  }
+};
+
+TEST_CASE( "engine shares a single run between identical concurrent requests",
+           "[engine]" )
+{
+  slow_engine x{};
+
+  klfengine::input in;
+  in.latex = "a+b=c";
+
+  std::vector<std::shared_ptr<klfengine::run> > runs(6);
+  std::vector<std::thread> threads;
+  for (std::size_t j = 0; j < runs.size(); ++j) {
+    threads.push_back(std::thread([&x,&runs,&in,j]() {
+      runs[j] = x.shared_run(in);
+    }));
+  }
+  for (auto & t : threads) {
+    t.join();
+  }
+
+  REQUIRE( x.num_compiled == 1 ) ;
+  for (const auto & r : runs) {
+    REQUIRE( r == runs[0] ) ;
+    REQUIRE( r->compiled() ) ;
+  }
+
+  // a different input gets its own run
+  klfengine::input in2 = in;
+  in2.latex = "c=b+a";
+  std::shared_ptr<klfengine::run> r2 = x.shared_run(in2);
+  REQUIRE( r2 != runs[0] ) ;
+  REQUIRE( x.num_compiled == 2 ) ;
+
+  // the run is shared as long as someone holds on to it
+  REQUIRE( x.shared_run(in) == runs[0] ) ;
+  REQUIRE( x.num_compiled == 2 ) ;
+
+  // but not if the settings have changed
+  klfengine::settings s = x.settings();
+  s.temporary_directory = "/tmp/klfengine-some-other-dir";
+  x.set_settings(s);
+  std::shared_ptr<klfengine::run> r3 = x.shared_run(in);
+  REQUIRE( r3 != runs[0] ) ;
+  REQUIRE( x.num_compiled == 3 ) ;
+
+  // once released, a new run is created
+  runs.clear();
+  r3.reset();
+  (void) x.shared_run(in);
+  REQUIRE( x.num_compiled == 4 ) ;
+
+  // compilation errors are reported to everyone waiting, and not remembered
+  klfengine::input in_fail = in;
+  in_fail.latex = "\\fail";
+  std::atomic<int> num_failed(0);
+  threads.clear();
+  for (int j = 0; j < 3; ++j) {
+    threads.push_back(std::thread([&x,&num_failed,&in_fail]() {
+      try {
+        (void) x.shared_run(in_fail);
+      } catch (const klfengine::latex_compile_error & ) {
+        ++num_failed;
+      }
+    }));
+  }
+  for (auto & t : threads) {
+    t.join();
+  }
+  REQUIRE( num_failed == 3 ) ;
+  CHECK_THROWS_AS( x.shared_run(in_fail), klfengine::latex_compile_error ) ;
+}
+
+
+TEST_CASE( "engine warms up font caches in the font_cache_directory",
+           "[engine_run_implementation]" )
+{
+  namespace fs = klfengine::fs;
+
+  klfengine::temporary_directory tmpdir{fs::path{}, "klfenginetestwarmup"};
+
+  // fake "xelatex" which reports the environment it was run in
+  const fs::path texbin = tmpdir.path() / "texbin";
+  const fs::path env_out = tmpdir.path() / "env_out.txt";
+  fs::create_directories(texbin);
+  {
+    std::ofstream f{(texbin / "xelatex").native()};
+    f << "#!/bin/sh\n"
+      << "echo \"$TEXMFVAR|$TEXMFCACHE|$XDG_CACHE_HOME\" > '" << env_out.native() << "'\n";
+  }
+  fs::permissions(texbin / "xelatex", fs::perms::owner_all);
+
+  klfengine::settings s;
+  s.temporary_directory = tmpdir.path().native();
+  s.texbin_directory = texbin.native();
+  s.font_cache_directory = (tmpdir.path() / "fontcache").native();
+
+  dummy_engine::dummy_engine x{};
+  x.set_settings(s);
+
+  // "lualatex" doesn't exist in our fake texbin, it's skipped
+  x.warm_up_font_caches();
+
+  std::ifstream f{env_out.native()};
+  std::string line;
+  std::getline(f, line);
+
+  // TEXMFVAR is inherited unchanged, so that all TeX tools agree on it
+  const char * texmfvar_env = std::getenv("TEXMFVAR");
+  const std::string texmf_var{ texmfvar_env != nullptr ? texmfvar_env : "" };
+  const std::string texmf_cache = (tmpdir.path() / "fontcache" / "texmf-cache").native();
+  const std::string xdg_cache = (tmpdir.path() / "fontcache" / "xdg-cache").native();
+  REQUIRE( line == texmf_var + "|" + texmf_cache + "|" + xdg_cache ) ;
+  REQUIRE( fs::is_directory(texmf_cache) ) ;
+  REQUIRE( fs::is_directory(xdg_cache) ) ;
+}
@@ -29,6 +29,12 @@
 // header we are testing gets included first (helps detect missing #include's)
 #include <klfengine/engine_run_implementation>
 
+#include <map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+
 #include <catch2/catch.hpp>
 
 #include "dummy_engine/dummy_engine.hxx"
@@ -259,13 +265,12 @@ TEST_CASE( "engine_run_implementation.get_data_cref produces data and stores to
       "impl_produce_data(TEX)"
     } );
 
-  // repeated call should retrieve data from cache and not re-produce data
+  // repeated call should retrieve data from cache and not re-produce data; the
+  // canonical form is remembered as well
   x.record_calls.clear();
   REQUIRE( x.get_data_cref({"TEX", {}})
            == klfengine::binary_data(data_tex.begin(), data_tex.end()) ) ;
-  REQUIRE( x.record_calls == std::vector<std::string>{
-      "impl_make_canonical(TEX, 0)",
-    } );
+  REQUIRE( x.record_calls == std::vector<std::string>{} );
 
   // same if format is specified in non-canonical format
   x.record_calls.clear();
@@ -274,6 +279,10 @@ TEST_CASE( "engine_run_implementation.get_data_cref produces data and stores to
   REQUIRE( x.record_calls == std::vector<std::string>{
       "impl_make_canonical(TEX:{\"italic\":false}, 0)"
     } );
+  x.record_calls.clear();
+  REQUIRE( x.get_data_cref({"TEX", {{"italic", klfengine::value{false}}}})
+           == klfengine::binary_data(data_tex.begin(), data_tex.end()) ) ;
+  REQUIRE( x.record_calls == std::vector<std::string>{} );
 
   // our dummy engine produces TEX & HTML simultaneously, so again, this should
   // not trigger any data production, only a successful cache lookup.  This
@@ -296,14 +305,139 @@ TEST_CASE( "engine_run_implementation.get_data_cref produces data and stores to
       "impl_produce_data(TEX:{\"bold\":true})"
     } );
 
-  // this should find the data from the cache
+  // this should find the data from the cache (the canonical form was
+  // remembered during the recursive call)
   x.record_calls.clear();
   REQUIRE( x.get_data_cref({"TEX", {{"bold", klfengine::value{true}}}})
            == klfengine::binary_data(data_tex_b.begin(), data_tex_b.end()) ) ;
-  REQUIRE( x.record_calls == std::vector<std::string>{
-      "impl_make_canonical(TEX:{\"bold\":true}, 0)"
-    } );
+  REQUIRE( x.record_calls == std::vector<std::string>{} );
+
+}
+
+
+
+
+
+
+
+
+// Run implementation whose formats take a while to produce.  Format "A" and
+// "B" each wait for the other one to be in production.
+class slow_run_impl : public klfengine::engine_run_implementation
+{
+public:
+  slow_run_impl()
+    : klfengine::engine_run_implementation(klfengine::input{}, klfengine::settings{})
+  {
+  }
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::map<std::string,int> num_produced;
+  bool overlapped = false;
+
+private:
+  void impl_compile() { }
+
+  std::vector<klfengine::format_description> impl_available_formats()
+  {
+    return {};
+  }
+
+  klfengine::format_spec impl_make_canonical(const klfengine::format_spec & format,
+                                             bool /*check_only*/)
+  {
+    if (format.format == "A" || format.format == "B" || format.format == "C" ||
+        format.format == "FAIL") {
+      return klfengine::format_spec{format.format};
+    }
+    return klfengine::format_spec{};
+  }
+
+  klfengine::binary_data impl_produce_data(const klfengine::format_spec & format)
+  {
+    std::unique_lock<std::mutex> lck(mutex);
+    ++num_produced[format.format];
+    cond.notify_all();
+
+    if (format.format == "A" || format.format == "B") {
+      const std::string other = (format.format == "A") ? "B" : "A";
+      // give up after a while, the test fails then
+      overlapped = cond.wait_for(lck, std::chrono::seconds(5), [&]() {
+        return num_produced[other] > 0;
+      });
+    } else {
+      // let the other threads pile up on this format
+      lck.unlock();
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    if (format.format == "FAIL") {
+      throw klfengine::no_such_format(format.format, "failed on purpose");
+    }
+    return klfengine::binary_data{format.format.begin(), format.format.end()};
+  }
+};
+
+
+TEST_CASE( "engine_run_implementation produces different formats concurrently",
+           "[engine_run_implementation]" )
+{
+  slow_run_impl x;
+  x.compile();
+
+  klfengine::binary_data data_a;
+  klfengine::binary_data data_b;
+  std::thread ta([&]() { data_a = x.get_data_cref(klfengine::format_spec{"A"}); });
+  std::thread tb([&]() { data_b = x.get_data_cref(klfengine::format_spec{"B"}); });
+  ta.join();
+  tb.join();
+
+  REQUIRE( x.overlapped ) ;
+  REQUIRE( std::string(data_a.begin(), data_a.end()) == "A" ) ;
+  REQUIRE( std::string(data_b.begin(), data_b.end()) == "B" ) ;
+}
+
+TEST_CASE( "engine_run_implementation produces a format requested concurrently only once",
+           "[engine_run_implementation]" )
+{
+  slow_run_impl x;
+  x.compile();
 
+  std::vector<klfengine::shared_binary_data> results(4);
+  std::vector<std::thread> threads;
+  for (std::size_t j = 0; j < results.size(); ++j) {
+    threads.push_back(std::thread([&x,&results,j]() {
+      results[j] = x.get_data_shared(klfengine::format_spec{"C"});
+    }));
+  }
+  for (auto & t : threads) {
+    t.join();
+  }
+
+  REQUIRE( x.num_produced["C"] == 1 ) ;
+  for (const auto & r : results) {
+    REQUIRE( r.shares_buffer_with(results[0]) ) ;
+  }
+
+  // errors are reported to all waiting threads, and aren't remembered
+  std::vector<int> num_failed(4, 0);
+  threads.clear();
+  for (std::size_t j = 0; j < num_failed.size(); ++j) {
+    threads.push_back(std::thread([&x,&num_failed,j]() {
+      try {
+        (void) x.get_data_shared(klfengine::format_spec{"FAIL"});
+      } catch (const klfengine::no_such_format & ) {
+        num_failed[j] = 1;
+      }
+    }));
+  }
+  for (auto & t : threads) {
+    t.join();
+  }
+  REQUIRE( num_failed == std::vector<int>(4, 1) ) ;
+  REQUIRE( x.num_produced["FAIL"] >= 1 ) ;
+  REQUIRE( x.num_produced["FAIL"] < 4 ) ;
 }
 
 
@@ -32,6 +32,8 @@
 #include <klfengine/engines/klflatexpackage>
 #include <klfengine/h/engines/klflatexpackage/engine.h>
 
+#include <regex>
+
 #include <catch2/catch.hpp>
 
 #include "testutils.hxx"
@@ -130,3 +132,44 @@ TEST_CASE( "can get correct PNG image with engines::klflatexpackage",
                          KLFENGINE_TEST_DATA_DIR "engines_klflatexpackage_run_implementation_2.png");
 
 }
+
+
+TEST_CASE( "engines::klflatexpackage produces SVG via dvisvgm with the page size",
+           "[engines-klflatexpackage-run_implementation]" )
+{
+  klfengine::engines::klflatexpackage::engine e;
+
+  e.set_settings(klfengine::settings::detect_settings());
+
+  klfengine::input in;
+  in.latex = std::string("T = \\frac{\\hbar a}{2\\pi c k_B}");
+  in.math_mode = std::make_pair("$\\begin{aligned}", "\\end{aligned}$");
+  in.preamble = std::string("\\usepackage{amsmath}");
+  in.latex_engine = std::string("pdflatex");
+  in.font_size = -1.0;
+  in.margins = klfengine::margins{1, 1, 1, 1};
+  in.dpi = 1200;
+  in.scale = 1.0;
+  in.outline_fonts = true;
+  in.parameters = klfengine::value::dict{{
+    {"fixed_width", klfengine::value{std::string{"3cm"}}},
+    {"fixed_height", klfengine::value{std::string{"2cm"}}}
+  }};
+
+  auto r = e.run(in);
+
+  r->compile();
+
+  klfengine::binary_data svgdata = r->get_data(klfengine::format_spec{"SVG"});
+  std::string svg{svgdata.begin(), svgdata.end()};
+  CAPTURE( svg );
+
+  std::smatch m;
+  REQUIRE( std::regex_search(
+               svg, m,
+               std::regex{"viewBox=['\"][-0-9.]+ [-0-9.]+ ([0-9.]+) ([0-9.]+)['\"]"}
+           ) ) ;
+  // the page box: 3cm x 2cm in big points
+  REQUIRE( std::stod(m[1].str()) == Approx(85.04).epsilon(0.01) ) ;
+  REQUIRE( std::stod(m[2].str()) == Approx(56.69).epsilon(0.01) ) ;
+}
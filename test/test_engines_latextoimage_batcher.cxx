@@ -0,0 +1,226 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// header we are testing gets included first (helps detect missing #include's)
+#include <klfengine/h/engines/latextoimage/batcher.h>
+
+#include <algorithm>
+#include <thread>
+
+#include <klfengine/engines/latextoimage>
+#include <klfengine/temporary_directory>
+
+#include <catch2/catch.hpp>
+
+
+using klfengine::engines::latextoimage::detail::make_latex_template_parts;
+using klfengine::engines::latextoimage::detail::batcher;
+using klfengine::engines::latextoimage::detail::batch_output;
+
+
+TEST_CASE( "latex template for a batch has the same head for different colors and sizes",
+           "[engines_latextoimage_batcher]" )
+{
+  klfengine::input in1;
+  in1.latex = "a+b=c";
+  in1.preamble = "\\usepackage{amsmath}";
+  klfengine::input in2 = in1;
+  in2.latex = "\\frac{1}{2}";
+  in2.fg_color = klfengine::color{255, 0, 0, 255};
+  in2.font_size = 20;
+
+  auto p1 = make_latex_template_parts(in1, true);
+  auto p2 = make_latex_template_parts(in2, true);
+  REQUIRE( p1.head == p2.head ) ;
+  REQUIRE( p1.head.find("\\usepackage{amsmath}") != std::string::npos ) ;
+  REQUIRE( p2.body.find("\\definecolor{klffgcolor}") != std::string::npos ) ;
+  REQUIRE( p2.body.find("\\frac{1}{2}") != std::string::npos ) ;
+
+  // outside of a batch, the color is defined in the preamble
+  auto p2_single = make_latex_template_parts(in2, false);
+  REQUIRE( p2_single.head.find("\\definecolor{klffgcolor}") != std::string::npos ) ;
+  REQUIRE( p2_single.body.find("\\definecolor{klffgcolor}") == std::string::npos ) ;
+  // the body has the same lines either way, see batch_output::page_diagnostics()
+  REQUIRE( std::count(p2.body.begin(), p2.body.end(), '\n')
+           == std::count(p2_single.body.begin(), p2_single.body.end(), '\n') ) ;
+  // and no color package is loaded if no color is needed
+  REQUIRE( make_latex_template_parts(in1, false).head.find("\\usepackage{color}")
+           == std::string::npos ) ;
+
+  // a different preamble gives a different head
+  klfengine::input in3 = in1;
+  in3.preamble = "\\usepackage{amssymb}";
+  REQUIRE( make_latex_template_parts(in3, true).head != p1.head ) ;
+}
+
+
+TEST_CASE( "inputs that may make global changes are detected",
+           "[engines_latextoimage_batcher]" )
+{
+  using klfengine::engines::latextoimage::detail::may_have_global_effects;
+
+  klfengine::input in;
+  in.latex = "\\frac{a}{b} \\def\\x{1} \\includegraphics{x.png} \\inputenc";
+  REQUIRE( !may_have_global_effects(in) ) ;
+
+  for (const char * code : {"\\global\\let\\x=\\y", "\\gdef\\x{1}", "\\xdef\\x{1}",
+                            "\\setcounter{page}{3}", "\\stepcounter{equation}",
+                            "\\pagenumbering{roman}", "\\input{other}", "x\\input other"}) {
+    CAPTURE( code );
+    klfengine::input in2 = in;
+    in2.latex = code;
+    REQUIRE( may_have_global_effects(in2) ) ;
+  }
+
+  klfengine::input in3 = in;
+  in3.math_mode = std::make_pair("\\[\\stepcounter{equation}", "\\]");
+  REQUIRE( may_have_global_effects(in3) ) ;
+}
+
+
+TEST_CASE( "batch output reports the diagnostics of each page separately",
+           "[engines_latextoimage_batcher]" )
+{
+  klfengine::temporary_directory tmp;
+  auto pool_ptr = std::make_shared<klfengine::detail::temporary_directory_pool>(
+      tmp.path(), "klfebatchtest"
+      );
+
+  using klfengine::latex_diagnostic_kind;
+
+  batch_output output{pool_ptr->acquire()};
+  output.page_lines = { {10, 14}, {17, 21} };
+  output.diagnostics.entries = {
+    {latex_diagnostic_kind::OverfullBox, "", 12,
+     "Overfull \\hbox (1.2pt too wide) in paragraph at lines 12--13"},
+    {latex_diagnostic_kind::Warning, "", 18, "Reference `x' undefined on input line 18."},
+    {latex_diagnostic_kind::Warning, "", 19, "Citation `y' undefined on input line 19."},
+    {latex_diagnostic_kind::Warning, "", -1, "There were undefined references."},
+  };
+
+  klfengine::latex_diagnostics d1 = output.page_diagnostics(1, 5);
+  REQUIRE( d1.entries.size() == 1 ) ;
+  REQUIRE( d1.entries[0].line == 7 ) ;
+  REQUIRE( d1.entries[0].message
+           == "Overfull \\hbox (1.2pt too wide) in paragraph at lines 7--8" ) ;
+
+  klfengine::latex_diagnostics d2 = output.page_diagnostics(2, 5);
+  REQUIRE( d2.entries.size() == 2 ) ;
+  REQUIRE( d2.entries[0].line == 6 ) ;
+  REQUIRE( d2.entries[0].message == "Reference `x' undefined on input line 6." ) ;
+  REQUIRE( d2.entries[1].line == 7 ) ;
+
+  REQUIRE( output.page_diagnostics(3, 5).entries.empty() ) ;
+}
+
+
+TEST_CASE( "batcher compiles alone if no other run joins or input can't be batched",
+           "[engines_latextoimage_batcher]" )
+{
+  klfengine::temporary_directory tmp;
+  auto pool_ptr = std::make_shared<klfengine::detail::temporary_directory_pool>(
+      tmp.path(), "klfebatchtest"
+      );
+  klfengine::detail::temporary_directory_pool & pool = *pool_ptr;
+
+  int num_latex_stages = 0;
+  auto acquire = [&num_latex_stages]() {
+    ++num_latex_stages;
+    return klfengine::job_scheduler::slot{};
+  };
+
+  klfengine::input in;
+  in.latex = "a+b=c";
+  klfengine::settings sett;
+
+  // nobody else joins within the delay
+  batcher b{4, std::chrono::milliseconds{20}};
+  REQUIRE( b.max_batch_size() == 4 ) ;
+  batcher::placement p = b.compile(in, sett, pool, acquire);
+  REQUIRE( p.output == nullptr ) ;
+  REQUIRE( p.page == 0 ) ;
+
+  // these are never batched, don't even wait
+  klfengine::input in_notemplate = in;
+  in_notemplate.parameters["use_latex_template"] = klfengine::value{false};
+  batcher b_long{4, std::chrono::hours{1}};
+  REQUIRE( b_long.compile(in_notemplate, sett, pool, acquire).output == nullptr ) ;
+
+  klfengine::input in_global = in;
+  in_global.latex = "\\setcounter{page}{5} a+b=c";
+  REQUIRE( b_long.compile(in_global, sett, pool, acquire).output == nullptr ) ;
+
+  batcher b_disabled{1, std::chrono::hours{1}};
+  REQUIRE( b_disabled.compile(in, sett, pool, acquire).output == nullptr ) ;
+
+  REQUIRE( num_latex_stages == 0 ) ;
+}
+
+
+TEST_CASE( "batcher lets all runs compile alone if the batch fails",
+           "[engines_latextoimage_batcher]" )
+{
+  klfengine::temporary_directory tmp;
+  auto pool_ptr = std::make_shared<klfengine::detail::temporary_directory_pool>(
+      tmp.path(), "klfebatchtest"
+      );
+  klfengine::detail::temporary_directory_pool & pool = *pool_ptr;
+
+  auto acquire = []() { return klfengine::job_scheduler::slot{}; };
+
+  // a latex engine that doesn't exist makes the batch fail
+  klfengine::settings sett;
+  sett.texbin_directory = (tmp.path() / "no-such-texbin").native();
+  klfengine::input in1;
+  in1.latex = "a+b=c";
+  in1.latex_engine = "pdflatex";
+  klfengine::input in2 = in1;
+  in2.latex = "c=b+a";
+
+  // the batch is full with two inputs, so nobody waits for the delay
+  batcher b{2, std::chrono::hours{1}};
+
+  batcher::placement p1;
+  std::thread t([&]() { p1 = b.compile(in1, sett, pool, acquire); });
+  batcher::placement p2 = b.compile(in2, sett, pool, acquire);
+  t.join();
+
+  REQUIRE( p1.output == nullptr ) ;
+  REQUIRE( p2.output == nullptr ) ;
+}
+
+
+TEST_CASE( "latextoimage engine stores batching options", "[engines_latextoimage_batcher]" )
+{
+  klfengine::engines::latextoimage::engine e;
+  REQUIRE( e.batch_max_size() == 0 ) ;
+
+  e.set_batching(8, std::chrono::milliseconds{10});
+  REQUIRE( e.batch_max_size() == 8 ) ;
+  REQUIRE( e.batch_max_delay() == std::chrono::milliseconds{10} ) ;
+}
@@ -31,12 +31,69 @@
 
 #include <klfengine/engines/latextoimage>
 #include <klfengine/h/engines/latextoimage/engine.h>
+#include <klfengine/temporary_directory>
+#include <klfengine/h/detail/directory_reaper.h>
+
+#include <chrono>
+#include <thread>
 
 #include <catch2/catch.hpp>
 
 #include "testutils.hxx"
 
 
+static klfengine::input make_dvi_test_input()
+{
+  klfengine::input in;
+  in.latex = std::string("\\int \\left[a + \\frac{b}{f(x)}\\right] dx =: Z[f]");
+  in.math_mode = std::make_pair("\\[", "\\]");
+  in.latex_engine = std::string("latex");
+  in.font_size = -1.0;
+  // zero margins, so that the dvipng route can be used
+  in.margins = klfengine::margins{
+    klfengine::length{"0bp"},
+    klfengine::length{"0bp"},
+    klfengine::length{"0bp"},
+    klfengine::length{"0bp"}
+  };
+  in.dpi = 600;
+  in.scale = 1.0;
+  in.bg_color = klfengine::color{255,255,255,255};
+  return in;
+}
+
+
+TEST_CASE( "engines::latextoimage takes the DVI route with the latex engine only",
+           "[engines-latextoimage-run_implementation]" )
+{
+  klfengine::temporary_directory tmp;
+  auto temp_dir_pool = std::make_shared<klfengine::detail::temporary_directory_pool>(
+      tmp.path(), "klfetest"
+      );
+  auto gs_iface_tool = std::make_shared<klfengine::ghostscript_interface_engine_tool>();
+
+  // the raw DVI format is only available on the DVI route; this doesn't need
+  // to compile anything
+  {
+    auto in = make_dvi_test_input();
+    klfengine::engines::latextoimage::run_implementation r_dvi{
+      gs_iface_tool, temp_dir_pool, in, klfengine::settings{}, true, nullptr
+    };
+    REQUIRE( r_dvi.canonical_format(klfengine::format_spec{"DVI"}).format == "DVI" ) ;
+
+    in.latex_engine = "pdflatex";
+    klfengine::engines::latextoimage::run_implementation r_pdf{
+      gs_iface_tool, temp_dir_pool, in, klfengine::settings{}, true, nullptr
+    };
+    REQUIRE_THROWS_AS( r_pdf.canonical_format(klfengine::format_spec{"DVI"}),
+                       klfengine::no_such_format ) ;
+  }
+  // the runs' working directories are removed in the background, let that
+  // finish before tmp is removed
+  klfengine::detail::directory_reaper::instance().flush();
+}
+
+
 TEST_CASE( "simple compilation with engines::latextoimage produces correct equation image",
            "[engines-latextoimage-run_implementation]" )
 {
@@ -82,3 +139,197 @@ TEST_CASE( "simple compilation with engines::latextoimage produces correct equat
                          KLFENGINE_TEST_DATA_DIR "engines_latextoimage_run_implementation_1.png");
 
 }
+
+
+TEST_CASE( "engines::latextoimage PNG via dvipng is similar to PNG via Ghostscript",
+           "[engines-latextoimage-run_implementation]" )
+{
+  klfengine::engines::latextoimage::engine e_gs;
+  e_gs.set_settings(klfengine::settings::detect_settings());
+
+  klfengine::engines::latextoimage::engine e_dvipng;
+  e_dvipng.set_settings(klfengine::settings::detect_settings());
+  e_dvipng.set_use_dvipng(true);
+  REQUIRE( e_dvipng.use_dvipng() ) ;
+
+  auto in = make_dvi_test_input();
+
+  auto r_gs = e_gs.run(in);
+  r_gs->compile();
+  auto png_gs = r_gs->get_data(klfengine::format_spec{"PNG"});
+  klfengine::detail::utils::dump_binary_data_to_file("testoutf_xb92kd03gs.png", png_gs);
+
+  auto r_dvipng = e_dvipng.run(in);
+  r_dvipng->compile();
+  auto png_dvipng = r_dvipng->get_data(klfengine::format_spec{"PNG"});
+  klfengine::detail::utils::dump_binary_data_to_file("testoutf_xb92kd03dvipng.png", png_dvipng);
+
+  require_images_similar("testoutf_xb92kd03dvipng.png", "testoutf_xb92kd03gs.png");
+
+  // other formats still work, running dvips & gs on demand
+  auto ps_raw = r_dvipng->get_data(klfengine::format_spec{
+      "PS", klfengine::value::dict{{"latex_raw", klfengine::value{true}}}
+  });
+  REQUIRE( ps_raw.size() > 0 ) ;
+  auto pdf = r_dvipng->get_data(klfengine::format_spec{"PDF"});
+  REQUIRE( pdf.size() > 0 ) ;
+}
+
+TEST_CASE( "engines::latextoimage produces SVG via dvisvgm",
+           "[engines-latextoimage-run_implementation]" )
+{
+  klfengine::engines::latextoimage::engine e;
+  e.set_settings(klfengine::settings::detect_settings());
+
+  // DVI route (no Ghostscript) and PDF route (dvisvgm --pdf)
+  for (const char * latex_engine : {"latex", "pdflatex"}) {
+    CAPTURE( latex_engine );
+
+    auto in = make_dvi_test_input();
+    in.latex_engine = std::string(latex_engine);
+    in.margins = klfengine::margins{
+      klfengine::length{"2bp"},
+      klfengine::length{"2bp"},
+      klfengine::length{"2bp"},
+      klfengine::length{"2bp"}
+    };
+
+    auto r = e.run(in);
+    r->compile();
+
+    // make sure we're testing the route we think we are
+    if (std::string(latex_engine) == "latex") {
+      REQUIRE( r->canonical_format(klfengine::format_spec{"DVI"}).format == "DVI" ) ;
+    } else {
+      REQUIRE_THROWS_AS( r->canonical_format(klfengine::format_spec{"DVI"}),
+                         klfengine::no_such_format ) ;
+    }
+
+    for (bool outline_fonts : {false, true}) {
+      auto svg = r->get_data(klfengine::format_spec{
+          "SVG", klfengine::value::dict{{"outline_fonts", klfengine::value{outline_fonts}}}
+      });
+      std::string svg_str{svg.begin(), svg.end()};
+      CAPTURE( svg_str );
+      REQUIRE( svg_str.find("<svg") != std::string::npos ) ;
+      REQUIRE( svg_str.find("viewBox=") != std::string::npos ) ;
+      // the background rectangle that covers the canvas including margins
+      REQUIRE( svg_str.find("<rect") != std::string::npos ) ;
+      if (outline_fonts) {
+        REQUIRE( svg_str.find("<font") == std::string::npos ) ;
+      }
+    }
+  }
+}
+
+TEST_CASE( "engines::latextoimage runs compiled in a batch only expose their own input",
+           "[engines-latextoimage-run_implementation]" )
+{
+  for (const char * latex_engine : {"latex", "pdflatex"}) {
+    CAPTURE( latex_engine );
+    const bool via_dvi = (std::string(latex_engine) == "latex");
+
+    klfengine::engines::latextoimage::engine e;
+    e.set_settings(klfengine::settings::detect_settings());
+    e.set_use_dvipng(true);
+    // the batch is full with two inputs, so nobody waits for the delay
+    e.set_batching(2, std::chrono::hours{1});
+
+    // compiles each input on its own, for comparison
+    klfengine::engines::latextoimage::engine e_single;
+    e_single.set_settings(klfengine::settings::detect_settings());
+    e_single.set_use_dvipng(true);
+
+    auto in1 = make_dvi_test_input();
+    in1.latex_engine = std::string(latex_engine);
+    in1.latex = "a+b=c\\hbox to 1cm{overfull box in first input}";
+    auto in2 = in1;
+    in2.latex = "\\frac{x}{y}";
+
+    auto r1 = e.run(in1);
+    auto r2 = e.run(in2);
+    std::thread t([&r1]() { r1->compile(); });
+    r2->compile();
+    t.join();
+
+    auto latex1 = r1->get_data(klfengine::format_spec{"LATEX"});
+    auto latex2 = r2->get_data(klfengine::format_spec{"LATEX"});
+    std::string latex1_str{latex1.begin(), latex1.end()};
+    std::string latex2_str{latex2.begin(), latex2.end()};
+    CAPTURE( latex1_str );
+    CAPTURE( latex2_str );
+    REQUIRE( latex1_str.find("a+b=c") != std::string::npos ) ;
+    REQUIRE( latex1_str.find("\\frac{x}{y}") == std::string::npos ) ;
+    REQUIRE( latex2_str.find("\\frac{x}{y}") != std::string::npos ) ;
+    REQUIRE( latex2_str.find("a+b=c") == std::string::npos ) ;
+
+    // the raw DVI or PDF has all the inputs of the batch, unlike that of a run
+    // compiled on its own
+    auto r2_single = e_single.run(in2);
+    r2_single->compile();
+    if (via_dvi) {
+      REQUIRE( !r2_single->get_data(klfengine::format_spec{"DVI"}).empty() ) ;
+      REQUIRE_THROWS_AS( r2->get_data(klfengine::format_spec{"DVI"}),
+                         klfengine::no_such_format ) ;
+      // the raw PS only has our page
+      REQUIRE( !r2->get_data(klfengine::format_spec{
+            "PS", klfengine::value::dict{{"latex_raw", klfengine::value{true}}}
+          }).empty() ) ;
+    } else {
+      const klfengine::format_spec raw_pdf{
+        "PDF", klfengine::value::dict{{"latex_raw", klfengine::value{true}}}
+      };
+      REQUIRE( !r2_single->get_data(raw_pdf).empty() ) ;
+      REQUIRE_THROWS_AS( r2->get_data(raw_pdf), klfengine::no_such_format ) ;
+    }
+
+    // the overfull box is only reported for the first input
+    REQUIRE( r1->diagnostics().count(klfengine::latex_diagnostic_kind::OverfullBox) == 1 ) ;
+    REQUIRE( r2->diagnostics().count(klfengine::latex_diagnostic_kind::OverfullBox) == 0 ) ;
+
+    // each run gets the image of its own input
+    auto r1_single = e_single.run(in1);
+    r1_single->compile();
+    const std::string prefix = std::string("testoutf_batch_") + latex_engine;
+    klfengine::detail::utils::dump_binary_data_to_file(
+        prefix + "_1.png", r1->get_data(klfengine::format_spec{"PNG"}));
+    klfengine::detail::utils::dump_binary_data_to_file(
+        prefix + "_1_single.png", r1_single->get_data(klfengine::format_spec{"PNG"}));
+    klfengine::detail::utils::dump_binary_data_to_file(
+        prefix + "_2.png", r2->get_data(klfengine::format_spec{"PNG"}));
+    klfengine::detail::utils::dump_binary_data_to_file(
+        prefix + "_2_single.png", r2_single->get_data(klfengine::format_spec{"PNG"}));
+    require_images_similar(prefix + "_1.png", prefix + "_1_single.png");
+    require_images_similar(prefix + "_2.png", prefix + "_2_single.png");
+  }
+}
+
+// run with:  test_engines_latextoimage_run_implementation "[benchmark]"
+TEST_CASE( "benchmark engines::latextoimage PNG via dvipng vs Ghostscript",
+           "[.][benchmark]" )
+{
+  const int num_runs = 10;
+
+  auto time_png_runs = [num_runs](bool use_dvipng) {
+    klfengine::engines::latextoimage::engine e;
+    e.set_settings(klfengine::settings::detect_settings());
+    e.set_use_dvipng(use_dvipng);
+
+    auto in = make_dvi_test_input();
+
+    auto t_start = std::chrono::steady_clock::now();
+    for (int j = 0; j < num_runs; ++j) {
+      auto r = e.run(in);
+      r->compile();
+      (void) r->get_data(klfengine::format_spec{"PNG"});
+    }
+    auto t_end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(t_end - t_start).count() / num_runs;
+  };
+
+  const double ms_gs = time_png_runs(false);
+  const double ms_dvipng = time_png_runs(true);
+
+  WARN( "latex -> dvips -> gs bbox -> gs png: " << ms_gs << " ms/run" ) ;
+  WARN( "latex -> dvipng:                     " << ms_dvipng << " ms/run" ) ;
+}
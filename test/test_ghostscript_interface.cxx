@@ -30,6 +30,7 @@
 #include <klfengine/ghostscript_interface>
 
 #include <klfengine/process>
+#include <klfengine/temporary_directory>
 
 #include <iostream>
 
@@ -299,3 +300,157 @@ TEST_CASE( "can run gs via LoadLibgs", "[detail-simple_gs_interface][!mayfail]"
 
   do_can_run_gs( gs );
 }
+
+
+
+// -----------------------------------------------------------------------------
+// "process-server" method
+// -----------------------------------------------------------------------------
+
+
+TEST_CASE( "translate gs arguments into a server job", "[detail-gs_process_server]" )
+{
+  std::string code;
+
+  bool ok = klfengine::detail::gs_process_server_job_from_args(
+      {
+        "-sDEVICE=pngalpha",
+        "-dMaxBitmap=2147483647",
+        "-r300",
+        "-dGraphicsAlphaBits=4",
+        "-sOutputFile=/tmp/some (dir)/out.png",
+        "-dDEVICEWIDTHPOINTS=12.5",
+        "-dDEVICEHEIGHTPOINTS=20",
+        "-dFIXEDMEDIA",
+        "-c",
+        "<< /BeginPage { 1 2 translate } >> setpagedevice",
+        "-f",
+        "/tmp/some (dir)/in.pdf"
+      },
+      &code
+  );
+  CAPTURE( code );
+
+  REQUIRE( ok );
+  REQUIRE( code ==
+           "(pngalpha) selectdevice\n"
+           "<< /MaxBitmap 2147483647 /HWResolution [300 300] /GraphicsAlphaBits 4 "
+           "/OutputFile (/tmp/some \\(dir\\)/out.png) /PageSize [12.5 20] "
+           "/Policies << /PageSize 7 >> >> setpagedevice\n"
+           "/FIXEDMEDIA true def\n"
+           "<< /BeginPage { 1 2 translate } >> setpagedevice\n"
+           "(/tmp/some \\(dir\\)/in.pdf) run\n" );
+}
+
+TEST_CASE( "refuse to translate some gs arguments into a server job",
+           "[detail-gs_process_server]" )
+{
+  std::string code;
+  using klfengine::detail::gs_process_server_job_from_args;
+
+  // no device
+  REQUIRE( ! gs_process_server_job_from_args({"in.ps"}, &code) );
+  // output to stdout
+  REQUIRE( ! gs_process_server_job_from_args(
+               {"-sDEVICE=pdfwrite", "-sOutputFile=-", "in.ps"}, &code) );
+  // input from stdin
+  REQUIRE( ! gs_process_server_job_from_args({"-sDEVICE=bbox", "-"}, &code) );
+  // unknown switches
+  REQUIRE( ! gs_process_server_job_from_args({"--version"}, &code) );
+  REQUIRE( ! gs_process_server_job_from_args({"-sDEVICE=bbox", "-dNOSAFER", "in.ps"},
+                                             &code) );
+  REQUIRE( ! gs_process_server_job_from_args({"-sDEVICE=bbox", "-dTextAlphaBits=(x)",
+                                              "in.ps"}, &code) );
+
+  REQUIRE( gs_process_server_job_from_args({"-sDEVICE=bbox", "-q", "in.ps"}, &code) );
+  REQUIRE( code == "(bbox) selectdevice\n(in.ps) run\n" );
+}
+
+#if !defined(_KLFENGINE_OS_WIN)
+TEST_CASE( "a stuck server job times out and the server is killed",
+           "[detail-gs_process_server]" )
+{
+  // a "server" that never reports back
+  klfengine::detail::gs_process_server server{
+    {"/bin/sleep", "60"},
+    std::chrono::milliseconds(200)
+  };
+  server.start();
+  REQUIRE( server.running() ) ;
+
+  auto t0 = std::chrono::steady_clock::now();
+  CHECK_THROWS_AS( server.run_job("(hello) print", nullptr, nullptr),
+                   klfengine::detail::gs_process_server_job_timeout ) ;
+  REQUIRE( std::chrono::steady_clock::now() - t0 < std::chrono::seconds(10) ) ;
+  REQUIRE( ! server.running() ) ;
+
+  // the pool doesn't retry jobs that timed out
+  klfengine::detail::gs_process_server_pool pool{
+    {"/bin/sleep", "60"}, 1, std::chrono::milliseconds(200)
+  };
+  t0 = std::chrono::steady_clock::now();
+  CHECK_THROWS_AS( pool.run_job("(hello) print", nullptr, nullptr),
+                   klfengine::detail::gs_process_server_job_timeout ) ;
+  REQUIRE( std::chrono::steady_clock::now() - t0 < std::chrono::seconds(10) ) ;
+}
+#endif
+
+
+TEST_CASE( "check gs version via ProcessServer", "[detail-simple_gs_interface]" )
+{
+  klfengine::ghostscript_interface gs{
+    klfengine::ghostscript_interface::method::ProcessServer,
+    get_gs_path()
+  };
+
+  do_test_check_gs_version(gs);
+}
+
+TEST_CASE( "can run gs via ProcessServer", "[detail-simple_gs_interface]" )
+{
+  // falls back to a separate process for stdin input and stdout output
+  klfengine::ghostscript_interface gs{
+    klfengine::ghostscript_interface::method::ProcessServer,
+    get_gs_path()
+  };
+
+  do_can_run_gs( gs );
+}
+
+TEST_CASE( "can run multiple jobs in a resident gs server", "[detail-simple_gs_interface]" )
+{
+  klfengine::temporary_directory tmpdir;
+
+  klfengine::ghostscript_interface gs{
+    klfengine::ghostscript_interface::method::ProcessServer,
+    get_gs_path(),
+    klfengine::ghostscript_interface::process_server_options{
+      2,
+      { tmpdir.path().generic_string() }
+    }
+  };
+
+  const klfengine::fs::path ps_file{ tmpdir.path() / "in.ps" };
+  klfengine::detail::utils::dump_cstr_to_file(
+      ps_file.native(),
+      "%!PS\n"
+      "<< /PageSize [36 36] >> setpagedevice 0.4 setlinewidth 2 2 newpath moveto "
+      "5 5 lineto 10 0 lineto 10 10 lineto closepath 0.4 0 0 setrgbcolor stroke showpage\n"
+  );
+
+  for (int j = 0; j < 3; ++j) {
+    const klfengine::fs::path out_file{ tmpdir.path() / ("out" + std::to_string(j) + ".pdf") };
+    gs.run_gs( {"-sDEVICE=pdfwrite", "-sOutputFile=" + out_file.native(), ps_file.native()} );
+
+    klfengine::binary_data out = klfengine::detail::utils::load_file_data(out_file.native());
+    std::string out_s{out.begin(), out.end()};
+    REQUIRE( out_s.rfind("%PDF-",0) == 0 ) ;
+
+    klfengine::binary_data bbox_err;
+    gs.run_gs( {"-sDEVICE=bbox", ps_file.native()},
+               klfengine::ghostscript_interface::capture_stderr_data{&bbox_err} );
+    std::string bbox_err_s{bbox_err.begin(), bbox_err.end()};
+    CAPTURE( bbox_err_s );
+    REQUIRE( bbox_err_s.find("%%HiResBoundingBox:") != std::string::npos );
+  }
+}
@@ -0,0 +1,178 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// header we are testing gets included first (helps detect missing #include's)
+#include <klfengine/job_scheduler>
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <mutex>
+
+#include <catch2/catch.hpp>
+
+
+// wait until the condition holds (or give up after a while)
+template<typename Fn>
+static bool wait_until(Fn fn)
+{
+  for (int j = 0; j < 500; ++j) {
+    if (fn()) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return false;
+}
+
+
+TEST_CASE( "job_scheduler has no limits by default", "[job_scheduler]" )
+{
+  klfengine::job_scheduler s;
+
+  REQUIRE( s.max_concurrent(klfengine::job_stage::latex) == 0 ) ;
+  REQUIRE( s.max_concurrent(klfengine::job_stage::gs_render) == 0 ) ;
+
+  std::vector<klfengine::job_scheduler::slot> slots;
+  for (int j = 0; j < 10; ++j) {
+    slots.push_back(s.acquire(klfengine::job_stage::gs_render));
+  }
+  REQUIRE( s.num_running(klfengine::job_stage::gs_render) == 10 ) ;
+  REQUIRE( s.num_running(klfengine::job_stage::latex) == 0 ) ;
+
+  slots[0].release();
+  REQUIRE( ! slots[0].held() ) ;
+  REQUIRE( slots[1].held() ) ;
+  REQUIRE( s.num_running(klfengine::job_stage::gs_render) == 9 ) ;
+
+  slots.clear();
+  REQUIRE( s.num_running(klfengine::job_stage::gs_render) == 0 ) ;
+}
+
+TEST_CASE( "job_scheduler limits each stage separately", "[job_scheduler]" )
+{
+  klfengine::job_scheduler s;
+  s.set_max_concurrent(klfengine::job_stage::gs_render, 2);
+  s.set_max_concurrent(klfengine::job_stage::latex, 1);
+
+  std::atomic<int> running(0);
+  std::atomic<int> max_running(0);
+
+  std::vector<std::thread> threads;
+  for (int j = 0; j < 6; ++j) {
+    threads.push_back(std::thread([&]() {
+      klfengine::job_scheduler::slot slot = s.acquire(klfengine::job_stage::gs_render);
+      int n = ++running;
+      int m = max_running;
+      while (n > m && !max_running.compare_exchange_weak(m, n)) { }
+      std::this_thread::sleep_for(std::chrono::milliseconds(30));
+      --running;
+    }));
+  }
+
+  // other stages are not held up by the render jobs
+  REQUIRE( wait_until([&]() { return s.num_running(klfengine::job_stage::gs_render) == 2; }) ) ;
+  {
+    klfengine::job_scheduler::slot slot = s.acquire(klfengine::job_stage::latex);
+    REQUIRE( s.num_running(klfengine::job_stage::latex) == 1 ) ;
+  }
+
+  for (auto & t : threads) {
+    t.join();
+  }
+
+  REQUIRE( max_running == 2 ) ;
+  REQUIRE( s.num_running(klfengine::job_stage::gs_render) == 0 ) ;
+  REQUIRE( s.num_waiting(klfengine::job_stage::gs_render) == 0 ) ;
+}
+
+TEST_CASE( "job_scheduler starts interactive jobs first, otherwise in order",
+           "[job_scheduler]" )
+{
+  klfengine::job_scheduler s;
+  s.set_max_concurrent(klfengine::job_stage::latex, 1);
+
+  klfengine::job_scheduler::slot blocker = s.acquire(klfengine::job_stage::latex);
+
+  std::mutex order_mutex;
+  std::vector<std::string> order;
+
+  std::vector<std::thread> threads;
+  auto start_job = [&](std::string name, klfengine::job_priority priority) {
+    std::size_t n_waiting = s.num_waiting(klfengine::job_stage::latex);
+    threads.push_back(std::thread([&s,&order_mutex,&order,name,priority]() {
+      klfengine::job_scheduler::slot slot = s.acquire(klfengine::job_stage::latex, priority);
+      std::lock_guard<std::mutex> lck(order_mutex);
+      order.push_back(name);
+    }));
+    // make sure the jobs queue up in this order
+    REQUIRE( wait_until([&]() {
+          return s.num_waiting(klfengine::job_stage::latex) == n_waiting + 1;
+        }) ) ;
+  };
+
+  start_job("batch-1", klfengine::job_priority::batch);
+  start_job("batch-2", klfengine::job_priority::batch);
+  start_job("interactive-1", klfengine::job_priority::interactive);
+  start_job("interactive-2", klfengine::job_priority::interactive);
+
+  REQUIRE( s.num_waiting(klfengine::job_stage::latex) == 4 ) ;
+
+  blocker.release();
+  for (auto & t : threads) {
+    t.join();
+  }
+
+  REQUIRE( order == std::vector<std::string>{
+      "interactive-1", "interactive-2", "batch-1", "batch-2"
+    } ) ;
+}
+
+TEST_CASE( "job_scheduler lets waiting jobs start when the limit is raised",
+           "[job_scheduler]" )
+{
+  klfengine::job_scheduler s;
+  s.set_max_concurrent(klfengine::job_stage::gs_bbox, 1);
+
+  klfengine::job_scheduler::slot blocker = s.acquire(klfengine::job_stage::gs_bbox);
+
+  std::atomic<bool> started(false);
+  std::thread t([&]() {
+    klfengine::job_scheduler::slot slot = s.acquire(klfengine::job_stage::gs_bbox);
+    started = true;
+  });
+
+  REQUIRE( wait_until([&]() { return s.num_waiting(klfengine::job_stage::gs_bbox) == 1; }) ) ;
+  REQUIRE( ! started ) ;
+
+  s.set_max_concurrent(klfengine::job_stage::gs_bbox, 0);
+  t.join();
+  REQUIRE( started ) ;
+}
@@ -0,0 +1,146 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2020 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// header we are testing gets included first (helps detect missing #include's)
+#include <klfengine/latex_log>
+
+#include <catch2/catch.hpp>
+
+
+
+static const std::string test_latex_output{
+  "This is pdfTeX, Version 3.14159265-2.6-1.40.21 (TeX Live 2020) (preloaded format=pdflatex)\n"
+  " restricted \\write18 enabled.\n"
+  "entering extended mode\n"
+  "(/tmp/klfetmp/klfetemp.tex\n"
+  "LaTeX2e <2020-02-02> patch level 5\n"
+  "(/usr/local/texlive/2020/texmf-dist/tex/latex/base/article.cls\n"
+  "Document Class: article 2019/12/20 v1.4l Standard LaTeX document class\n"
+  ")\n"
+  "/tmp/klfetmp/klfetemp.tex:4: LaTeX Error: File `nonexistent.sty' not found.\n"
+  "\n"
+  "Type X to quit or <RETURN> to proceed,\n"
+  "or enter new name. (Default extension: sty)\n"
+  "\n"
+  "Enter file name: \n"
+  "LaTeX Warning: Reference `eq:x' on page 1 undefined on input line 7.\n"
+  "\n"
+  "Package amsmath Warning: Foreign command \\over;\n"
+  "(amsmath)                \\frac or \\genfrac should be used instead\n"
+  "(amsmath)                 on input line 8.\n"
+  "\n"
+  "/tmp/klfetmp/klfetemp.tex:9: Undefined control sequence.\r\n"
+  "l.9 \\foo\n"
+  "         x\n"
+  "Overfull \\hbox (12.34pt too wide) in paragraph at lines 10--11\n"
+  "[]\\OT1/cmr/m/n/10 aaaaaaa\n"
+  "\n"
+  "Underfull \\vbox (badness 10000) has occurred while \\output is active\n"
+  "! Emergency stop.\n"
+  "<*> /tmp/klfetmp/klfetemp.tex\n"
+  "                             \n"
+  "l.12 \\end{document}\n"
+  "No pages of output.\n"
+  "Transcript written on klfetemp.log."
+};
+
+TEST_CASE( "latex_log_parser finds errors, warnings and boxes", "[latex_log]" )
+{
+  using namespace klfengine;
+
+  latex_diagnostics d = latex_log_parser::parse(
+      binary_data{test_latex_output.begin(), test_latex_output.end()}
+  );
+
+  std::vector<latex_diagnostic> expected{
+    {latex_diagnostic_kind::MissingFile, "nonexistent.sty", 4,
+     "LaTeX Error: File `nonexistent.sty' not found."},
+    {latex_diagnostic_kind::Warning, "", 7,
+     "Reference `eq:x' on page 1 undefined on input line 7."},
+    {latex_diagnostic_kind::Warning, "", -1,
+     "Foreign command \\over;"},
+    {latex_diagnostic_kind::Error, "/tmp/klfetmp/klfetemp.tex", 9,
+     "Undefined control sequence."},
+    {latex_diagnostic_kind::OverfullBox, "", 10,
+     "Overfull \\hbox (12.34pt too wide) in paragraph at lines 10--11"},
+    {latex_diagnostic_kind::UnderfullBox, "", -1,
+     "Underfull \\vbox (badness 10000) has occurred while \\output is active"},
+    {latex_diagnostic_kind::Error, "", 12,
+     "Emergency stop."}
+  };
+
+  REQUIRE( d.entries.size() == expected.size() ) ;
+  for (std::size_t j = 0; j < expected.size(); ++j) {
+    CAPTURE( j );
+    CAPTURE( d.entries[j].file );
+    CAPTURE( d.entries[j].line );
+    CAPTURE( d.entries[j].message );
+    REQUIRE( d.entries[j] == expected[j] ) ;
+  }
+
+  REQUIRE( d.has_errors() ) ;
+  REQUIRE( d.first_error() == &d.entries[0] ) ;
+  REQUIRE( d.count(latex_diagnostic_kind::Warning) == 2 ) ;
+  REQUIRE( d.count(latex_diagnostic_kind::Error) == 2 ) ;
+}
+
+TEST_CASE( "latex_log_parser handles output fed in small chunks", "[latex_log]" )
+{
+  using namespace klfengine;
+
+  latex_diagnostics d_all = latex_log_parser::parse(
+      binary_data{test_latex_output.begin(), test_latex_output.end()}
+  );
+
+  for (std::size_t chunk_size : {1, 3, 17, 64}) {
+    CAPTURE( chunk_size );
+    latex_log_parser p;
+    for (std::size_t pos = 0; pos < test_latex_output.size(); pos += chunk_size) {
+      std::size_t n = std::min(chunk_size, test_latex_output.size() - pos);
+      p.feed(test_latex_output.data() + pos, n);
+    }
+    p.finish();
+    REQUIRE( p.diagnostics().entries == d_all.entries ) ;
+  }
+}
+
+TEST_CASE( "latex_log_parser without errors", "[latex_log]" )
+{
+  using namespace klfengine;
+
+  std::string out{
+    "This is pdfTeX, Version 3.14159265-2.6-1.40.21 (TeX Live 2020)\n"
+    "(./file.tex (/usr/share/texmf/tex/latex/base/size10.clo))\n"
+    "Output written on file.pdf (1 page, 12345 bytes).\n"
+    "Transcript written on file.log.\n"
+  };
+  latex_diagnostics d = latex_log_parser::parse(binary_data{out.begin(), out.end()});
+  REQUIRE( d.entries.empty() ) ;
+  REQUIRE( ! d.has_errors() ) ;
+  REQUIRE( d.first_error() == nullptr ) ;
+}
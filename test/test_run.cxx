@@ -29,6 +29,10 @@
 // header we are testing gets included first (helps detect missing #include's)
 #include <klfengine/run>
 
+#include <cstdio>
+
+#include <klfengine/temporary_directory>
+#include <klfengine/h/detail/utils.h>
 
 #include <catch2/catch.hpp>
 
@@ -165,15 +169,86 @@ TEST_CASE( "run methods call engine_run_implementation methods", "[run]" )
     } );
 
   // get_data() works too (note data is not produced a second time in recorded
-  // function calls)
+  // function calls, and the canonical form of the format was remembered)
   dimpl->record_calls.clear();
   REQUIRE( r.get_data({"TEX", {}})
            == klfengine::binary_data(data_tex.begin(), data_tex.end()) ) ;
+  REQUIRE( dimpl->record_calls == std::vector<std::string>{} );
+}
+
+
+
+TEST_CASE( "get_data_shared() shares the cached data beyond the run's lifetime",
+           "[run]" )
+{
+  klfengine::shared_binary_data d;
+  {
+    dummy_engine::dummy_run_impl * dimpl = make_dummy_run_impl_ptr("hello world");
+    klfengine::run r{std::unique_ptr<dummy_engine::dummy_run_impl>(dimpl)};
+    r.compile();
+
+    d = r.get_data_shared({"TEX", {}});
+
+    // same buffer as the one that is cached, no copy made
+    REQUIRE( d.data() == r.get_data_cref({"TEX", {}}).data() ) ;
+    REQUIRE( d.shares_buffer_with(r.get_data_shared({"TEX", {}})) ) ;
+  }
+
+  const std::string data_tex =
+    "<compiled data! input was `hello world'>";
+  REQUIRE( std::string(d.begin(), d.end()) == data_tex ) ;
+  REQUIRE( d.binary() == klfengine::binary_data(data_tex.begin(), data_tex.end()) ) ;
+}
+
+
+TEST_CASE( "write_data() writes to a callback or a file descriptor", "[run]" )
+{
+  dummy_engine::dummy_run_impl * dimpl = make_dummy_run_impl_ptr("hello world");
+  klfengine::run r{std::unique_ptr<dummy_engine::dummy_run_impl>(dimpl)};
+  r.compile();
+
+  const std::string data_txt =
+    "<compiled data! input was `hello world'>";
+
+  // not stored in cache -- produced each time
+  dimpl->record_calls.clear();
+  std::string out;
+  auto writer = [&out](const std::uint8_t * data, std::size_t size) {
+    out.append(reinterpret_cast<const char *>(data), size);
+  };
+  r.write_data({"TXT", {}}, writer, false);
+  REQUIRE( out == data_txt ) ;
+  out.clear();
+  r.write_data({"TXT", {}}, writer, false);
+  REQUIRE( out == data_txt ) ;
   REQUIRE( dimpl->record_calls == std::vector<std::string>{
-      "impl_make_canonical(TEX, 0)"
+      "impl_make_canonical(TXT, 0)",
+      "impl_produce_data(TXT)",
+      "impl_produce_data(TXT)"
     } );
-}
 
+  // stored in cache by default
+  dimpl->record_calls.clear();
+  out.clear();
+  r.write_data({"TXT", {}}, writer);
+  out.clear();
+  r.write_data({"TXT", {}}, writer);
+  REQUIRE( out == data_txt ) ;
+  REQUIRE( dimpl->record_calls == std::vector<std::string>{
+      "impl_produce_data(TXT)"
+    } );
+
+#if !defined(_KLFENGINE_OS_WIN)
+  klfengine::temporary_directory tmp;
+  klfengine::fs::path fname = tmp.path() / "out.txt";
+  std::FILE * fp = std::fopen(fname.c_str(), "wb");
+  REQUIRE( fp != nullptr ) ;
+  r.write_data({"TXT", {}}, fileno(fp));
+  std::fclose(fp);
+  auto fdata = klfengine::detail::utils::load_file_data(fname.native());
+  REQUIRE( std::string(fdata.begin(), fdata.end()) == data_txt ) ;
+#endif
+}
 
 
 TEST_CASE( "find_format finds acceptable formats", "[run]" )
@@ -30,6 +30,10 @@
 #include <klfengine/settings>
 
 #include <klfengine/h/detail/filesystem.h>
+#include <klfengine/temporary_directory>
+
+#include <fstream>
+#include <limits>
 
 #include <catch2/catch.hpp>
 
@@ -147,8 +151,129 @@ TEST_CASE( "struct settings converts to/from JSON", "[settings]" )
   REQUIRE( s == s2 );
 }
 
+TEST_CASE( "struct settings loads JSON without newer optional fields", "[settings]" )
+{
+  nlohmann::json j = nlohmann::json{
+    {"temporary_directory", "/tmp"},
+    {"texbin_directory", "/usr/local/texlive/20xx/somewhere/bin/"},
+    {"gs_method", "process-server"},
+    {"gs_executable_path", "/usr/local/bin/gs"},
+    {"gs_libgs_path", "/usr/lib/libgs.so"},
+    {"subprocess_add_environment", nlohmann::json::object()}
+  };
+
+  klfengine::settings s;
+  j.get_to(s);
+
+  REQUIRE( s.gs_method == "process-server" );
+  REQUIRE( s.gs_process_server_pool_size == 1 );
+
+  j["gs_process_server_pool_size"] = 4;
+  j.get_to(s);
+  REQUIRE( s.gs_process_server_pool_size == 4 );
+
+  REQUIRE( s.gs_process_server_job_timeout_ms == 300000 );
+  j["gs_process_server_job_timeout_ms"] = 1500;
+  j.get_to(s);
+  REQUIRE( s.gs_process_server_job_timeout_ms == 1500 );
+}
+
+
+
+TEST_CASE( "detect_settings_cached() reuses its cache file while it's up to date",
+           "[settings]" )
+{
+  namespace fs = klfengine::fs;
+
+  klfengine::temporary_directory tmpdir{fs::path{}, "klfenginetestsettingscache"};
 
+  // provide a fake texbin directory, so that we know what should be detected
+  fs::path texbin = tmpdir.path() / "texbin";
+  fs::create_directories(texbin);
+  {
+    std::ofstream f{(texbin / "latex").native()};
+    f << "#!/bin/sh\n";
+  }
+  fs::permissions(texbin / "latex", fs::perms::owner_all);
 
+  const std::vector<std::string> extra_paths{ texbin.native() };
+  const std::string cache_file{ (tmpdir.path() / "cache" / "settings.json").native() };
+
+  auto load_cache = [&]() {
+    std::ifstream f{cache_file};
+    return nlohmann::json::parse(f);
+  };
+  auto save_cache = [&](const nlohmann::json & j) {
+    std::ofstream f{cache_file};
+    f << j.dump();
+  };
+
+  klfengine::settings s = klfengine::settings::detect_settings_cached(cache_file, extra_paths);
+  REQUIRE( fs::is_regular_file(cache_file) ) ;
+  REQUIRE( s == klfengine::settings::detect_settings(extra_paths) ) ;
+  REQUIRE( fs::path{s.texbin_directory} == texbin ) ;
+
+  // alter the cached settings -- they should be returned as is, proving that the
+  // cache is used
+  nlohmann::json j = load_cache();
+  j["settings"]["gs_method"] = "cached-value";
+  save_cache(j);
+
+  klfengine::settings s2 = klfengine::settings::detect_settings_cached(cache_file, extra_paths);
+  REQUIRE( s2.gs_method == "cached-value" ) ;
+
+  // different extra_paths invalidate the cache
+  klfengine::settings s3 = klfengine::settings::detect_settings_cached(cache_file);
+  REQUIRE( s3.gs_method != "cached-value" ) ;
+
+  // a changed modification time invalidates the cache
+  klfengine::settings::detect_settings_cached(cache_file, extra_paths);
+  j = load_cache();
+  REQUIRE( j["stamps"].contains(texbin.native()) ) ;
+  j["settings"]["gs_method"] = "cached-value";
+  j["stamps"][texbin.native()] = 0;
+  save_cache(j);
+
+  klfengine::settings s4 = klfengine::settings::detect_settings_cached(cache_file, extra_paths);
+  REQUIRE( s4 == s ) ;
+
+  // a corrupt cache file is ignored and rewritten
+  {
+    std::ofstream f{cache_file};
+    f << "{ not valid json";
+  }
+  klfengine::settings s5 = klfengine::settings::detect_settings_cached(cache_file, extra_paths);
+  REQUIRE( s5 == s ) ;
+  REQUIRE( load_cache()["settings"].get<klfengine::settings>() == s ) ;
+}
+
+
+
+
+TEST_CASE( "get_temporary_directory_path() falls back if short on space",
+           "[settings]" )
+{
+  namespace fs = klfengine::fs;
+
+  klfengine::settings s;
+  REQUIRE( s.get_temporary_directory_path()
+           == fs::temp_directory_path().generic_string() );
+
+  s.temporary_directory = fs::current_path().generic_string();
+  REQUIRE( s.get_temporary_directory_path() == s.temporary_directory );
+
+  // no file system has this much space
+  s.temporary_directory_min_free_bytes = std::numeric_limits<std::int64_t>::max();
+  REQUIRE( s.get_temporary_directory_path()
+           == fs::temp_directory_path().generic_string() );
+
+  s.temporary_directory_min_free_bytes = 0;
+  s.temporary_directory = "/this/directory/does/not/exist";
+  REQUIRE( s.get_temporary_directory_path() == s.temporary_directory );
+  s.temporary_directory_min_free_bytes = 1;
+  REQUIRE( s.get_temporary_directory_path()
+           == fs::temp_directory_path().generic_string() );
+}
 
 // TEST_CASE( "can detect a temporary directory", "[settings]" )
 // {
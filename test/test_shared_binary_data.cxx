@@ -0,0 +1,92 @@
+/* This file is part of the klfengine library, which is distributed under the
+ * terms of the MIT license.
+ *
+ *     https://github.com/klatexformula/klfengine
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright 2021 Philippe Faist
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// header we are testing gets included first (helps detect missing #include's)
+#include <klfengine/shared_binary_data>
+
+#include <catch2/catch.hpp>
+
+
+
+TEST_CASE( "shared_binary_data holds data without copying", "[shared_binary_data]" )
+{
+  klfengine::shared_binary_data e;
+  REQUIRE( e.empty() ) ;
+  REQUIRE( e.size() == 0 ) ;
+  REQUIRE( e.begin() == e.end() ) ;
+  REQUIRE( e.binary().empty() ) ;
+  REQUIRE( e.has_binary() ) ;
+
+  klfengine::binary_data v{'a', 'b', 'c'};
+  const std::uint8_t * vdata = v.data();
+
+  klfengine::shared_binary_data d{std::move(v)};
+  REQUIRE( d.size() == 3 ) ;
+  REQUIRE( d.data() == vdata ) ; // moved, not copied
+  REQUIRE( d.binary() == klfengine::binary_data{'a', 'b', 'c'} ) ;
+  REQUIRE( d.has_binary() ) ;
+
+  klfengine::shared_binary_data d2 = d;
+  REQUIRE( d2.data() == vdata ) ;
+  REQUIRE( d2.shares_buffer_with(d) ) ;
+  REQUIRE( d2 == d ) ;
+
+  klfengine::shared_binary_data d3{klfengine::binary_data{'a', 'b', 'c'}};
+  REQUIRE( ! d3.shares_buffer_with(d) ) ;
+  REQUIRE( d3 == d ) ;
+  REQUIRE( d3 != e ) ;
+}
+
+TEST_CASE( "shared_binary_data keeps its buffer alive", "[shared_binary_data]" )
+{
+  auto p = std::make_shared<const klfengine::binary_data>(
+      klfengine::binary_data{'x', 'y'}
+  );
+  std::weak_ptr<const klfengine::binary_data> w = p;
+
+  klfengine::shared_binary_data d{std::move(p)};
+  REQUIRE( ! w.expired() ) ;
+  REQUIRE( &d.binary() == w.lock().get() ) ;
+
+  {
+    klfengine::shared_binary_data d2 = d;
+    d = klfengine::shared_binary_data{};
+    REQUIRE( ! w.expired() ) ;
+    REQUIRE( std::string(d2.begin(), d2.end()) == "xy" ) ;
+  }
+  REQUIRE( w.expired() ) ;
+
+  // memory that isn't held in a binary_data is copied by binary()
+  auto owner = std::make_shared<std::string>("abc");
+  klfengine::shared_binary_data m{
+    owner, reinterpret_cast<const std::uint8_t *>(owner->data()), owner->size()
+  };
+  REQUIRE( ! m.has_binary() ) ;
+  REQUIRE( m.binary() == klfengine::binary_data{'a', 'b', 'c'} ) ;
+  REQUIRE( m.binary().data() != m.data() ) ;
+}
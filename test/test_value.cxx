@@ -1000,3 +1000,49 @@ TEST_CASE("parameter_taker.finished() checks that all parameters were take()en",
   };
 
 }
+
+
+TEST_CASE("parameter_taker gives a view of the remaining parameters", "[value]")
+{
+  const klfengine::value::dict d{
+    {"A", klfengine::value{1}},
+    {"B", klfengine::value{2}},
+    {"C", klfengine::value{3}},
+    {"D", klfengine::value{4}}
+  };
+
+  klfengine::parameter_taker param(d, "phase 3");
+  REQUIRE( param.num_remaining() == 4 ) ;
+
+  REQUIRE( param.take<int>("B") == 2 ) ;
+  REQUIRE( param.take<int>("D") == 4 ) ;
+
+  // taken keys are gone, also for take() with a default value and has()
+  REQUIRE( ! param.has("B") ) ;
+  REQUIRE( param.take<int>("B", -1) == -1 ) ;
+  REQUIRE_THROWS_AS( param.take("D"), std::out_of_range ) ;
+
+  auto rem = param.remaining();
+  REQUIRE( rem.size() == 2 ) ;
+  std::string keys;
+  for (const auto & p : rem) {
+    // no copies -- we see the entries of the original dictionary
+    REQUIRE( &p.second == &d.at(p.first) ) ;
+    keys += p.first;
+  }
+  REQUIRE( keys == "AC" ) ;
+
+  REQUIRE( param.get_remaining() == klfengine::value::dict{
+      {"A", klfengine::value{1}},
+      {"C", klfengine::value{3}}
+    } ) ;
+
+  REQUIRE( param.take<int>("A") == 1 ) ;
+  REQUIRE( param.remaining().size() == 1 ) ;
+  REQUIRE( param.remaining().begin()->first == "C" ) ;
+
+  REQUIRE( param.take_remaining() == klfengine::value::dict{{"C", klfengine::value{3}}} ) ;
+  REQUIRE( param.remaining().empty() ) ;
+  REQUIRE( param.remaining().begin() == param.remaining().end() ) ;
+  param.finished();
+}